@@ -0,0 +1,5 @@
+OPTION(ENABLE_ALLOC_COUNTER "Count heap allocations per frame (replaces global operator new)" ON)
+IF (ENABLE_ALLOC_COUNTER)
+	ADD_DEFINITIONS(-DOCEAN_ALLOC_COUNTER)
+	MESSAGE(STATUS "Heap allocation counter enabled")
+ENDIF ()
@@ -0,0 +1,10 @@
+FIND_PATH(EGL_INCLUDE_DIR EGL/egl.h)
+FIND_LIBRARY(EGL_LIBRARY NAMES EGL)
+IF (EGL_INCLUDE_DIR AND EGL_LIBRARY)
+	ADD_DEFINITIONS(-DOCEAN_EGL)
+	INCLUDE_DIRECTORIES(${EGL_INCLUDE_DIR})
+	LIST(APPEND stdgl_libraries ${EGL_LIBRARY})
+	MESSAGE(STATUS "EGL found, --context egl renders surfaceless")
+ELSE ()
+	MESSAGE(STATUS "EGL not found, --context egl is not available")
+ENDIF ()
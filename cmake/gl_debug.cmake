@@ -0,0 +1,24 @@
+# GL diagnostics (see gl_debug.h): off, callback or sync. Defaults to sync for
+# Debug and untyped builds, callback for RelWithDebInfo, off for release
+SET(GL_DEBUG "" CACHE STRING "GL diagnostics: off, callback or sync")
+IF (GL_DEBUG STREQUAL "")
+	IF (CMAKE_BUILD_TYPE STREQUAL "Release" OR CMAKE_BUILD_TYPE STREQUAL "MinSizeRel")
+		SET(GL_DEBUG_MODE "off")
+	ELSEIF (CMAKE_BUILD_TYPE STREQUAL "RelWithDebInfo")
+		SET(GL_DEBUG_MODE "callback")
+	ELSE ()
+		SET(GL_DEBUG_MODE "sync")
+	ENDIF ()
+ELSE ()
+	SET(GL_DEBUG_MODE ${GL_DEBUG})
+ENDIF ()
+IF (GL_DEBUG_MODE STREQUAL "off")
+	ADD_DEFINITIONS(-DGL_DEBUG_LEVEL=0)
+ELSEIF (GL_DEBUG_MODE STREQUAL "callback")
+	ADD_DEFINITIONS(-DGL_DEBUG_LEVEL=1)
+ELSEIF (GL_DEBUG_MODE STREQUAL "sync")
+	ADD_DEFINITIONS(-DGL_DEBUG_LEVEL=2)
+ELSE ()
+	MESSAGE(FATAL_ERROR "GL_DEBUG must be off, callback or sync, not ${GL_DEBUG_MODE}")
+ENDIF ()
+MESSAGE(STATUS "GL diagnostics: ${GL_DEBUG_MODE}")
@@ -0,0 +1,5 @@
+OPTION(ENABLE_PROFILER "Build the frame profiler (CPU scopes, GPU timer queries)" ON)
+IF (ENABLE_PROFILER)
+	ADD_DEFINITIONS(-DOCEAN_PROFILER)
+	MESSAGE(STATUS "Frame profiler enabled")
+ENDIF ()
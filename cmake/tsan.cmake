@@ -0,0 +1,6 @@
+OPTION(ENABLE_TSAN "Build with ThreadSanitizer, e.g. to check the simulation/render handoff" OFF)
+IF (ENABLE_TSAN)
+	SET(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -fsanitize=thread -g -O1")
+	SET(CMAKE_EXE_LINKER_FLAGS "${CMAKE_EXE_LINKER_FLAGS} -fsanitize=thread")
+	MESSAGE(STATUS "ThreadSanitizer enabled")
+ENDIF ()
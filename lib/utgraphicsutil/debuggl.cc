@@ -2,6 +2,8 @@
 #include <GLFW/glfw3.h>
 #include <portable_gl.h>
 
+std::atomic<const DebugGLLocation *> debuggl_location{nullptr};
+
 const char *DebugGLErrorToString(int error) {
   switch (error) {
   case GL_NO_ERROR:
@@ -1,6 +1,8 @@
 #ifndef DEBUGGL_H
 #define DEBUGGL_H
 
+#include <atomic>
+
 void debugglTerminate();
 
 #define CHECK_SUCCESS(x)                                                       \
@@ -46,8 +48,39 @@ void debugglTerminate();
     }                                                                          \
   } while (0)
 
+/*
+ * GL_DEBUG_LEVEL picks what CHECK_GL_ERROR costs:
+ *
+ *   0  nothing, it only runs the statement
+ *   1  it records its call site (one relaxed store), so the messages of the
+ *      asynchronous debug output callback name the last checked call
+ *   2  it also calls glGetError after the statement and exits on an error,
+ *      which stalls the driver on every check (the default)
+ */
+#ifndef GL_DEBUG_LEVEL
+#define GL_DEBUG_LEVEL 2
+#endif
+
+struct DebugGLLocation {
+  const char *file;
+  const char *func;
+  int line;
+};
+
+// Last call site passed through CHECK_GL_ERROR, nullptr if none yet
+extern std::atomic<const DebugGLLocation *> debuggl_location;
+
+#define DEBUGGL_MARK_LOCATION()                                                \
+  do {                                                                         \
+    static const DebugGLLocation debuggl_here = {__FILE__, __func__,           \
+                                                 __LINE__};                    \
+    debuggl_location.store(&debuggl_here, std::memory_order_relaxed);          \
+  } while (0)
+
+#if GL_DEBUG_LEVEL >= 2
 #define CHECK_GL_ERROR(statement)                                              \
   do {                                                                         \
+    DEBUGGL_MARK_LOCATION();                                                   \
     { statement; }                                                             \
     GLenum error = GL_NO_ERROR;                                                \
     if ((error = glGetError()) != GL_NO_ERROR) {                               \
@@ -58,6 +91,18 @@ void debugglTerminate();
       exit(EXIT_FAILURE);                                                      \
     }                                                                          \
   } while (0)
+#elif GL_DEBUG_LEVEL == 1
+#define CHECK_GL_ERROR(statement)                                              \
+  do {                                                                         \
+    DEBUGGL_MARK_LOCATION();                                                   \
+    { statement; }                                                             \
+  } while (0)
+#else
+#define CHECK_GL_ERROR(statement)                                              \
+  do {                                                                         \
+    statement;                                                                 \
+  } while (0)
+#endif
 
 const char *DebugGLErrorToString(int error);
 
@@ -5,7 +5,7 @@
 
 struct Image {
   /*
-   * Image data in GL_RGB sequence.
+   * Image data in GL_RGB sequence, or GL_RGBA when channels is 4.
    * Notes: because of some funny alignment problem it's recommended to
    * transform the data into GL_RGBA format before calling
    * glTexSubImage2D if you want to use the data for texture mapping
@@ -13,6 +13,7 @@ struct Image {
   std::vector<unsigned char> bytes;
   int width;
   int height;
+  int channels = 3;
   int stride; // Stores the actual number of bytes for a scan line, you can
               // ignore this for our current case.
 };
@@ -43,46 +43,70 @@ bool SaveJPEG(const std::string &filename, int image_width, int image_height,
   return true;
 }
 
-std::unique_ptr<Image> LoadJPEG(const std::string &file_name) {
+std::unique_ptr<Image> LoadJPEG(const std::string &file_name, int channels) {
   FILE *file = fopen(file_name.c_str(), "rb");
+  if (file == NULL) {
+    return nullptr;
+  }
   struct jpeg_decompress_struct info;
   struct jpeg_error_mgr err;
 
   info.err = jpeg_std_error(&err);
   jpeg_create_decompress(&info);
 
-  if (file == NULL) {
-    return nullptr;
-  }
   auto image = std::make_unique<Image>();
   jpeg_stdio_src(&info, file);
   jpeg_read_header(&info, (boolean) true);
+  // Textures do not need the slow, exact IDCT
+  info.dct_method = JDCT_IFAST;
+
+#ifdef JCS_ALPHA_EXTENSIONS
+  // libjpeg-turbo converts straight to the output layout, skipping the repack
+  bool direct = info.jpeg_color_space != JCS_CMYK &&
+                info.jpeg_color_space != JCS_YCCK;
+  if (direct) {
+    info.out_color_space = channels == 4 ? JCS_EXT_RGBA : JCS_EXT_RGB;
+  }
+#else
+  bool direct = false;
+#endif
   jpeg_start_decompress(&info);
 
   image->width = info.output_width;
   image->height = info.output_height;
+  image->channels = channels;
+  image->stride = image->width * channels;
+  image->bytes.resize(size_t(image->stride) * image->height);
 
-  int channels = info.num_components;
-  long size = image->width * image->height * 3;
-
-  image->bytes.resize(size);
-
-  int a = (channels > 2 ? 1 : 0);
-  int b = (channels > 2 ? 2 : 0);
-  std::vector<unsigned char> scan_line(image->width * channels, 0);
-  unsigned char *p1 = &scan_line[0];
-  unsigned char **p2 = &p1;
   unsigned char *out_scan_line = image->bytes.data();
-  while (info.output_scanline < info.output_height) {
-    jpeg_read_scanlines(&info, p2, 1);
-    for (int i = 0; i < image->width; ++i) {
-      out_scan_line[3 * i] = scan_line[channels * i];
-      out_scan_line[3 * i + 1] = scan_line[channels * i + a];
-      out_scan_line[3 * i + 2] = scan_line[channels * i + b];
+  if (direct) {
+    while (info.output_scanline < info.output_height) {
+      jpeg_read_scanlines(&info, &out_scan_line, 1);
+      out_scan_line += image->stride;
+    }
+  } else {
+    int components = info.output_components;
+    int a = (components > 2 ? 1 : 0);
+    int b = (components > 2 ? 2 : 0);
+    std::vector<unsigned char> scan_line(image->width * components, 0);
+    unsigned char *p1 = &scan_line[0];
+    unsigned char **p2 = &p1;
+    while (info.output_scanline < info.output_height) {
+      jpeg_read_scanlines(&info, p2, 1);
+      for (int i = 0; i < image->width; ++i) {
+        unsigned char *out = out_scan_line + channels * i;
+        out[0] = scan_line[components * i];
+        out[1] = scan_line[components * i + a];
+        out[2] = scan_line[components * i + b];
+        if (channels == 4) {
+          out[3] = 0xFF;
+        }
+      }
+      out_scan_line += image->stride;
     }
-    out_scan_line += image->width * 3;
   }
   jpeg_finish_decompress(&info);
+  jpeg_destroy_decompress(&info);
   fclose(file);
   return image;
 }
@@ -7,6 +7,8 @@
 
 bool SaveJPEG(const std::string &filename, int image_width, int image_height,
               const unsigned char *pixels);
-std::unique_ptr<Image> LoadJPEG(const std::string &file_name);
+// channels is 3 for RGB or 4 for RGBA with opaque alpha
+std::unique_ptr<Image> LoadJPEG(const std::string &file_name,
+                                int channels = 3);
 
 #endif
@@ -0,0 +1,59 @@
+#include "alloc_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef OCEAN_ALLOC_COUNTER
+
+namespace {
+
+thread_local size_t allocations = 0;
+
+void *countedAllocate(size_t size) {
+  allocations++;
+  return std::malloc(size == 0 ? 1 : size);
+}
+}
+
+void *operator new(size_t size) {
+  if (void *pointer = countedAllocate(size)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+  if (void *pointer = countedAllocate(size)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return countedAllocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return countedAllocate(size);
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete[](void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { std::free(pointer); }
+
+namespace alloc_counter {
+
+bool enabled() { return true; }
+size_t threadAllocations() { return allocations; }
+}
+
+#else
+
+namespace alloc_counter {
+
+bool enabled() { return false; }
+size_t threadAllocations() { return 0; }
+}
+
+#endif
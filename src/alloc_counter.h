@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+/*
+ * Counts the calls to the global operator new made by each thread, so the
+ * main loop can verify that it runs without heap allocations once warmed up.
+ * Configuring with -DENABLE_ALLOC_COUNTER=OFF keeps the default operator new
+ * and makes every count 0.
+ */
+namespace alloc_counter {
+
+bool enabled();
+
+// Allocations made by the calling thread so far
+size_t threadAllocations();
+}
@@ -0,0 +1,107 @@
+#include "atmosphere.h"
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <cmath>
+#include <debuggl.h>
+#include <iostream>
+
+constexpr int Atmosphere::kWidth;
+constexpr int Atmosphere::kTextureUnit;
+constexpr float Atmosphere::kRebakeMinutes;
+
+namespace {
+
+constexpr float kMinutesPerDay = 1440.0f;
+const glm::vec3 kSunBase = {0.98f, 0.83f, 0.25f};
+
+// Per channel extinction, blue scatters out first so a low sun reddens
+const glm::vec3 kExtinction = {0.01f, 0.03f, 0.08f};
+
+/**
+ * Relative optical air mass looking up at the given elevation (Kasten and
+ * Young), 1 at the zenith and about 38 at the horizon.
+ */
+float airMass(float elevation) {
+  float sine = std::max(elevation, 0.0f);
+  float degrees = std::asin(sine) * 180.0f / float(M_PI);
+  return 1.0f / (sine + 0.50572f * std::pow(degrees + 6.07995f, -1.6364f));
+}
+}
+
+Atmosphere::Atmosphere() : texels_(kWidth * 2) {
+  CHECK_GL_ERROR(glCreateTextures(GL_TEXTURE_2D, 1, &texture_));
+  CHECK_GL_ERROR(glTextureStorage2D(texture_, 1, GL_RGBA16F, kWidth, 2));
+  glTextureParameteri(texture_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTextureParameteri(texture_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTextureParameteri(texture_, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTextureParameteri(texture_, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+Atmosphere::~Atmosphere() { glDeleteTextures(1, &texture_); }
+
+bool Atmosphere::update(float time_of_day) {
+  if (baked_time_ >= 0.0f &&
+      std::abs(time_of_day - baked_time_) < kRebakeMinutes) {
+    return false;
+  }
+  bake(time_of_day);
+  return true;
+}
+
+std::vector<ShaderUniform> Atmosphere::uniforms() const {
+  auto lut_binder = [](int loc, const void *data) {
+    glBindTextureUnit(kTextureUnit, *(const GLuint *)data);
+    glUniform1i(loc, kTextureUnit);
+  };
+  auto vector_binder = [](int loc, const void *data) {
+    glUniform4fv(loc, 1, (const GLfloat *)data);
+  };
+  auto lut_data = [this]() -> const void * { return &texture_; };
+  auto sun_data = [this]() -> const void * { return &sun_color_; };
+  return {{"atmosphere", lut_binder, lut_data},
+          {"sun_color", vector_binder, sun_data}};
+}
+
+glm::vec3 Atmosphere::skyColor(float time_of_day, bool raining,
+                               float elevation) {
+  glm::vec3 day = raining ? glm::vec3(0.66f) : glm::vec3(0.53f, 0.81f, 0.92f);
+  glm::vec3 dark = raining ? glm::vec3(0.0f) : glm::vec3(0.1f, 0.1f, 0.3f);
+  // Before 5 AM, After 7 PM
+  if (time_of_day < 300.0f || time_of_day > 1140.0f) {
+    return dark;
+  }
+  float scale = std::pow(std::abs(720.0f - time_of_day) / 420.0f, 2.0f);
+  glm::vec3 zenith = glm::mix(day, dark, scale);
+  if (raining) {
+    return zenith;
+  }
+  // Daylight scattered along the longer path brightens the horizon
+  float haze = 1.0f - std::exp(-0.1f * (airMass(elevation) - 1.0f));
+  glm::vec3 horizon = glm::mix(zenith, glm::vec3(1.0f), 0.5f);
+  return glm::mix(zenith, horizon, 0.5f * haze * (1.0f - scale));
+}
+
+glm::vec3 Atmosphere::sunColor(float sun_elevation) {
+  float mass = airMass(sun_elevation) - 1.0f;
+  return kSunBase * glm::vec3(std::exp(-kExtinction.x * mass),
+                              std::exp(-kExtinction.y * mass),
+                              std::exp(-kExtinction.z * mass));
+}
+
+void Atmosphere::bake(float time_of_day) {
+  for (int row = 0; row < 2; row++) {
+    for (int col = 0; col < kWidth; col++) {
+      float elevation = 2.0f * col / (kWidth - 1) - 1.0f;
+      texels_[row * kWidth + col] =
+          glm::vec4(skyColor(time_of_day, row == 1, elevation), 1.0f);
+    }
+  }
+  CHECK_GL_ERROR(glTextureSubImage2D(texture_, 0, 0, 0, kWidth, 2, GL_RGBA,
+                                     GL_FLOAT, texels_.data()));
+
+  // Same orbit as the light position in main
+  float angle = (time_of_day / kMinutesPerDay) * 2.0f * float(M_PI);
+  sun_color_ = glm::vec4(sunColor(-std::cos(angle)), 1.0f);
+  baked_time_ = time_of_day;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "render_pass.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+/*
+ * Sky colour lookup table shared by the sky, terrain and ocean shaders.
+ *
+ * The table is a kWidth x 2 texture, one row for clear and one for stormy
+ * weather, indexed by view elevation from straight down to straight up. It is
+ * baked on the CPU and only rebaked once time_of_day has moved by
+ * kRebakeMinutes, so the shaders replace the per-pixel time of day branching
+ * with one texture fetch. Fog samples the same table along the view ray,
+ * which makes distant geometry fade into exactly the sky behind it.
+ *
+ * The sun colour, the base colour dimmed by its transmittance through the
+ * atmosphere, is updated along with the table.
+ */
+class Atmosphere {
+public:
+  static constexpr int kWidth = 64;
+  static constexpr int kTextureUnit = 3;
+  static constexpr float kRebakeMinutes = 2.0f;
+
+  Atmosphere();
+  ~Atmosphere();
+  Atmosphere(const Atmosphere &) = delete;
+  Atmosphere &operator=(const Atmosphere &) = delete;
+
+  // Returns true when the table was rebaked
+  bool update(float time_of_day);
+
+  // "atmosphere" sampler and "sun_color"
+  std::vector<ShaderUniform> uniforms() const;
+
+  // Colour of the sky in a direction with the given elevation (its y)
+  static glm::vec3 skyColor(float time_of_day, bool raining, float elevation);
+  static glm::vec3 sunColor(float sun_elevation);
+
+private:
+  void bake(float time_of_day);
+
+  unsigned texture_ = 0;
+  float baked_time_ = -1.0f;
+  glm::vec4 sun_color_;
+  std::vector<glm::vec4> texels_;
+};
@@ -0,0 +1,213 @@
+#include "bench.h"
+
+#include "alloc_counter.h"
+#include "gl_state.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+constexpr float BenchRecorder::kStep;
+constexpr int BenchRecorder::kLatency;
+constexpr int BenchRecorder::kWarmupFrames;
+
+namespace {
+
+void printBenchUsage(const char *program) {
+  std::cerr << "Usage: " << program
+            << " [--bench [path_file]] [--frames N] [--csv file]"
+               " [--context egl|osmesa] [--capture jpeg|y4m] [--seed N]"
+               " [--record log | --replay log] [--quality low|medium|high]"
+               " [--no-fog] [--no-occlusion]"
+            << std::endl;
+}
+
+float percentile(std::vector<float> values, float p) {
+  if (values.empty()) {
+    return 0.0f;
+  }
+  size_t k = std::min(values.size() - 1, size_t(values.size() * p));
+  std::nth_element(values.begin(), values.begin() + k, values.end());
+  return values[k];
+}
+
+// Over the frames after the first skip, all of them on shorter runs
+void printSummary(const char *name, const std::vector<float> &all,
+                  size_t skip) {
+  auto ms = std::vector<float>(
+      all.begin() + (all.size() > skip ? skip : 0), all.end());
+  float sum = 0.0f;
+  for (float value : ms) {
+    sum += value;
+  }
+  std::cout << "  " << name << " avg " << (ms.empty() ? 0.0f : sum / ms.size())
+            << " p50 " << percentile(ms, 0.5f) << " p99 "
+            << percentile(ms, 0.99f) << " ms" << std::endl;
+}
+
+#ifdef OCEAN_PROFILER
+
+// The GPU zones of every frame are needed, even if that means waiting
+void watchGpuZones() { Profiler::instance().setWaitForGpu(true); }
+void flushGpuZones() { Profiler::instance().flushGpu(); }
+size_t profilerFrame() { return Profiler::instance().frame(); }
+float gpuZonesMs(size_t frame) {
+  double ms = 0.0;
+  Profiler::instance().gpuFrameMs(frame, ms);
+  return float(ms);
+}
+
+#else
+
+// Without the profiler there are no GPU zones, the GPU time is 0
+void watchGpuZones() {}
+void flushGpuZones() {}
+size_t profilerFrame() { return 0; }
+float gpuZonesMs(size_t) { return 0.0f; }
+
+#endif
+
+} // namespace
+
+bool parseBenchArgs(int argc, char *argv[], BenchOptions &options) {
+  for (int i = 1; i < argc; i++) {
+    bool has_value = i + 1 < argc && argv[i + 1][0] != '-';
+    if (std::strcmp(argv[i], "--bench") == 0) {
+      options.enabled = true;
+      if (has_value) {
+        options.path_file = argv[++i];
+      }
+    } else if (std::strcmp(argv[i], "--frames") == 0 && has_value) {
+      options.max_frames = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--csv") == 0 && has_value) {
+      options.csv_file = argv[++i];
+    } else if (std::strcmp(argv[i], "--capture") == 0 && has_value) {
+      options.capture = argv[++i];
+      if (options.capture != "jpeg" && options.capture != "y4m") {
+        printBenchUsage(argv[0]);
+        return false;
+      }
+    } else if (std::strcmp(argv[i], "--seed") == 0 && has_value) {
+      // Decimal or 0x prefixed hex
+      options.seed = uint32_t(std::strtoul(argv[++i], nullptr, 0));
+    } else if (std::strcmp(argv[i], "--record") == 0 && has_value) {
+      options.record_file = argv[++i];
+    } else if (std::strcmp(argv[i], "--replay") == 0 && has_value) {
+      options.enabled = true;
+      options.replay_file = argv[++i];
+    } else if (std::strcmp(argv[i], "--quality") == 0 && has_value) {
+      options.quality = argv[++i];
+      if (options.quality != "low" && options.quality != "medium" &&
+          options.quality != "high") {
+        printBenchUsage(argv[0]);
+        return false;
+      }
+    } else if (std::strcmp(argv[i], "--no-fog") == 0) {
+      options.fog = false;
+    } else if (std::strcmp(argv[i], "--no-occlusion") == 0) {
+      options.occlusion = false;
+    } else if (std::strcmp(argv[i], "--context") == 0 && has_value) {
+      std::string api = argv[++i];
+      if (api == "egl") {
+        options.context = BenchContext::EGL;
+      } else if (api == "osmesa") {
+        options.context = BenchContext::OSMesa;
+      } else {
+        printBenchUsage(argv[0]);
+        return false;
+      }
+    } else {
+      printBenchUsage(argv[0]);
+      return false;
+    }
+  }
+  if (!options.record_file.empty() && options.enabled) {
+    // A replayed path or log would fight the recorded input
+    printBenchUsage(argv[0]);
+    return false;
+  }
+  return true;
+}
+
+bool BenchRecorder::open(const std::string &csv_file, int frames) {
+  csv_.open(csv_file);
+  if (!csv_.is_open()) {
+    std::cerr << "Failed to open benchmark output: " << csv_file << std::endl;
+    return false;
+  }
+  csv_ << "frame,path_time,cpu_ms,gpu_ms,allocs,storm,gl_calls,"
+          "gl_calls_uncached\n";
+  cpu_ms_.reserve(frames);
+  gpu_ms_.reserve(frames);
+  watchGpuZones();
+  return true;
+}
+
+void BenchRecorder::beginFrame() {
+  // The slot was last used kLatency frames ago, its result should be ready
+  auto &frame = in_flight_[next_frame_ % kLatency];
+  resolve(frame);
+  frame_start_ = std::chrono::high_resolution_clock::now();
+  allocations_start_ = alloc_counter::threadAllocations();
+  frame.profiler_frame = profilerFrame();
+}
+
+void BenchRecorder::endFrame(bool stormy, size_t simulation_allocations) {
+  auto &frame = in_flight_[next_frame_ % kLatency];
+  auto now = std::chrono::high_resolution_clock::now();
+  frame.index = next_frame_++;
+  frame.cpu_ms =
+      std::chrono::duration<float, std::milli>(now - frame_start_).count();
+  frame.allocations = alloc_counter::threadAllocations() -
+                      allocations_start_ + simulation_allocations;
+  frame.stormy = stormy;
+  frame.gl_calls = GLState::instance().issuedCalls();
+  frame.gl_calls_uncached = GLState::instance().requestedCalls();
+  gl_calls_ += frame.gl_calls;
+  gl_calls_uncached_ += frame.gl_calls_uncached;
+  if (frame.index >= kWarmupFrames) {
+    steady_allocations_ += frame.allocations;
+  }
+}
+
+void BenchRecorder::resolve(Frame &frame) {
+  if (frame.index < 0) {
+    return;
+  }
+  float gpu_ms = gpuZonesMs(frame.profiler_frame);
+  csv_ << frame.index << "," << frame.index * kStep << "," << frame.cpu_ms
+       << "," << gpu_ms << "," << frame.allocations << "," << frame.stormy
+       << "," << frame.gl_calls << "," << frame.gl_calls_uncached << "\n";
+  cpu_ms_.push_back(frame.cpu_ms);
+  gpu_ms_.push_back(gpu_ms);
+  frame.index = -1;
+}
+
+bool BenchRecorder::finish() {
+  // Drain the frames still in flight, oldest first
+  flushGpuZones();
+  for (int i = 0; i < kLatency; i++) {
+    resolve(in_flight_[(next_frame_ + i) % kLatency]);
+  }
+  csv_.flush();
+  std::cout << "Benchmark: " << next_frame_ << " frames" << std::endl;
+  printSummary("CPU", cpu_ms_, kWarmupFrames);
+  printSummary("GPU", gpu_ms_, kWarmupFrames);
+  if (next_frame_ > 0) {
+    std::cout << "  GL calls per frame: " << gl_calls_ / next_frame_ << " ("
+              << gl_calls_uncached_ / next_frame_
+              << " without the state cache)" << std::endl;
+  }
+  if (!alloc_counter::enabled()) {
+    return true;
+  }
+  std::cout << "  Heap allocations after " << kWarmupFrames
+            << " warm up frames: " << steady_allocations_ << std::endl;
+  if (steady_allocations_ > 0) {
+    std::cerr << "Benchmark: the main loop allocated from the heap"
+              << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "camera_path.h"
+#include "perlin.hpp"
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+ * Headless benchmark mode (--bench). The scene is rendered offscreen with
+ * vsync off while a recorded camera path (or with --replay, an input log, see
+ * InputLog) is replayed, and the CPU and GPU time of every frame is written
+ * out as CSV.
+ */
+
+enum class BenchContext { Default, EGL, OSMesa };
+
+struct BenchOptions {
+  bool enabled = false;
+  std::string path_file = "../assets/bench_path.txt";
+  std::string csv_file = "bench.csv";
+  int max_frames = 0; /* 0 replays the whole path */
+  std::string capture;  /* "jpeg" or "y4m" records every frame */
+  BenchContext context = BenchContext::Default;
+  uint32_t seed = perlin::kDefaultSeed; /* --seed, also outside --bench */
+  std::string record_file; /* --record, log the input of a live session */
+  std::string replay_file; /* --replay, headless like --bench */
+  std::string quality = "medium"; /* --quality, see OceanQuality */
+  bool fog = true;                /* off with --no-fog */
+  bool occlusion = true;          /* off with --no-occlusion */
+};
+
+// Returns false (after printing usage) on unknown or malformed arguments
+bool parseBenchArgs(int argc, char *argv[], BenchOptions &options);
+
+/*
+ * Per-frame CPU time (start of the frame until its draws are submitted) and
+ * GPU time, plus the GL calls of the frame with and without the state cache.
+ * The GPU time is the sum of the profiler's GL_TIME_ELAPSED zones of the
+ * frame, so unlike a timestamp delta across the frame it leaves out the time
+ * the GPU sits idle waiting for the CPU; it needs the profiler built in.
+ * Results are read back kLatency frames later, so recording does not stall
+ * the pipeline. The summaries leave out the kWarmupFrames.
+ */
+class BenchRecorder {
+public:
+  static constexpr float kStep = 1.0f / 60.0f; /* path time per frame */
+
+  // frames sizes the result buffers, so recording does not allocate
+  bool open(const std::string &csv_file, int frames);
+  void beginFrame();
+  // simulation_allocations are those of the simulation step of the frame,
+  // counted on the simulation thread
+  void endFrame(bool stormy, size_t simulation_allocations);
+  // Returns false if a frame after the warm up allocated from the heap
+  bool finish();
+  int frames() const { return next_frame_; }
+
+private:
+  static constexpr int kLatency = 3;
+  static constexpr int kWarmupFrames = 60; /* may allocate */
+
+  struct Frame {
+    int index = -1;
+    float cpu_ms = 0.0f;
+    size_t allocations = 0; /* render and simulation thread */
+    bool stormy = false;
+    size_t gl_calls = 0;          /* issued, see GLState */
+    size_t gl_calls_uncached = 0; /* asked for, redundant ones included */
+    size_t profiler_frame = 0;    /* whose GPU zones are summed */
+  };
+
+  void resolve(Frame &frame);
+
+  std::ofstream csv_;
+  std::array<Frame, kLatency> in_flight_;
+  std::vector<float> cpu_ms_;
+  std::vector<float> gpu_ms_;
+  std::chrono::high_resolution_clock::time_point frame_start_;
+  size_t allocations_start_ = 0;
+  size_t steady_allocations_ = 0;
+  size_t gl_calls_ = 0;
+  size_t gl_calls_uncached_ = 0;
+  int next_frame_ = 0;
+};
@@ -0,0 +1,1011 @@
+/*
+ * CPU micro-benchmarks for the GL-free hot paths: terrain noise, heightfield
+ * rebuilds (serial, on the job system, OpenMP and a thread per task), wave
+ * sampling (per preset wave count), collision, shore distances, terrain
+ * raycasts, occlusion culling, navigation, rain, the simulation to render
+ * frame handoff and OBJ loading. Results are written to ocean_bench.json
+ * (unless --benchmark_out is given) so runs can be diffed between commits,
+ * e.g. with tools/compare.py from Google Benchmark.
+ */
+
+#include "mesh_util.hpp"
+#include "perlin.hpp"
+#include "world/heightfield.h"
+#include "world/job_system.h"
+#include "world/navigation.h"
+#include "world/occlusion_culler.h"
+#include "world/rain.h"
+#include "world/shore_distance.h"
+#include "world/terrain_raycast.h"
+#include "world/triple_buffer.h"
+#include "world/world.h"
+
+#include <algorithm>
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <cstring>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+std::vector<glm::vec3> samplePositions(size_t count, float extent) {
+  std::mt19937 engine(7);
+  auto dist = std::uniform_real_distribution<float>(-extent, extent);
+  auto height_dist = std::uniform_real_distribution<float>(-2.0f, 10.0f);
+  auto positions = std::vector<glm::vec3>(count);
+  for (auto &position : positions) {
+    position = {dist(engine), height_dist(engine), dist(engine)};
+  }
+  return positions;
+}
+
+void BM_PerlinGetHeight(benchmark::State &state) {
+  int n = state.range(0);
+  for (auto _ : state) {
+    for (int i = 0; i < n; i++) {
+      for (int j = 0; j < n; j++) {
+        benchmark::DoNotOptimize(perlin::getHeight(float(i), float(j),
+                                                     perlin::kDefaultSeed));
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * n * n);
+}
+BENCHMARK(BM_PerlinGetHeight)->RangeMultiplier(2)->Range(32, 256);
+
+// Height plus analytic slope, what a heightfield rebuild samples per corner
+void BM_PerlinHeightAndGradient(benchmark::State &state) {
+  int n = state.range(0);
+  for (auto _ : state) {
+    for (int i = 0; i < n; i++) {
+      for (int j = 0; j < n; j++) {
+        benchmark::DoNotOptimize(perlin::heightAndGradient(
+            float(i), float(j), perlin::kDefaultSeed));
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * n * n);
+}
+BENCHMARK(BM_PerlinHeightAndGradient)->RangeMultiplier(2)->Range(32, 256);
+
+void BM_MultipassNoise(benchmark::State &state) {
+  int n = state.range(0);
+  for (auto _ : state) {
+    for (int i = 0; i < n; i++) {
+      for (int j = 0; j < n; j++) {
+        benchmark::DoNotOptimize(perlin::multipass_noise(
+            i / 20.0f, j / 20.0f, perlin::kDefaultSeed));
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * n * n);
+}
+BENCHMARK(BM_MultipassNoise)->RangeMultiplier(2)->Range(32, 256);
+
+// Fractal sums over the old sin hash and the integer hash, by octave count
+void BM_LegacyNoise(benchmark::State &state) {
+  int octaves = state.range(0);
+  auto noise = [](float x, float z) { return perlin::perlin(x, z); };
+  for (auto _ : state) {
+    for (int i = 0; i < 64; i++) {
+      for (int j = 0; j < 64; j++) {
+        benchmark::DoNotOptimize(
+            perlin::fractalSum(i / 20.0f, j / 20.0f, octaves, noise));
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * 64 * 64);
+}
+BENCHMARK(BM_LegacyNoise)->Arg(1)->Arg(3)->Arg(6);
+
+void BM_GradientNoise(benchmark::State &state) {
+  int octaves = state.range(0);
+  auto noise = [](float x, float z) {
+    return perlin::gradientNoise(x, z, perlin::kDefaultSeed);
+  };
+  for (auto _ : state) {
+    for (int i = 0; i < 64; i++) {
+      for (int j = 0; j < 64; j++) {
+        benchmark::DoNotOptimize(
+            perlin::fractalSum(i / 20.0f, j / 20.0f, octaves, noise));
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * 64 * 64);
+}
+BENCHMARK(BM_GradientNoise)->Arg(1)->Arg(3)->Arg(6);
+
+// What TerrainRender does whenever the player crosses UPDATE_STEP cells
+void BM_HeightfieldRebuild(benchmark::State &state) {
+  size_t n = state.range(0);
+  Heightfield field(n, n, perlin::kDefaultSeed);
+  int x = 0;
+  for (auto _ : state) {
+    field.rebuild(x, x);
+    x += 5;
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n * n);
+}
+BENCHMARK(BM_HeightfieldRebuild)
+    ->Arg(50)
+    ->Arg(150)
+    ->Arg(300)
+    ->Unit(benchmark::kMillisecond);
+
+// The same rebuild split into Heightfield::kRebuildGrain rows per task, on
+// the job system, on OpenMP (when built with it) and on a thread per task
+size_t rebuildThreads() {
+  return std::max<size_t>(std::thread::hardware_concurrency(), 2) - 1;
+}
+
+void BM_HeightfieldRebuildJobs(benchmark::State &state) {
+  size_t n = state.range(0);
+  JobSystem jobs(rebuildThreads());
+  Heightfield field(n, n, perlin::kDefaultSeed, &jobs);
+  int x = 0;
+  for (auto _ : state) {
+    field.rebuild(x, x);
+    x += 5;
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n * n);
+}
+BENCHMARK(BM_HeightfieldRebuildJobs)
+    ->Arg(50)
+    ->Arg(150)
+    ->Arg(300)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+#ifdef _OPENMP
+void BM_HeightfieldRebuildOpenMP(benchmark::State &state) {
+  size_t n = state.range(0);
+  Heightfield field(n, n, perlin::kDefaultSeed);
+  auto parallel_for = [](size_t count, auto fn) {
+    size_t grain = Heightfield::kRebuildGrain;
+    long chunks = long((count + grain - 1) / grain);
+#pragma omp parallel for schedule(dynamic)
+    for (long chunk = 0; chunk < chunks; chunk++) {
+      size_t begin = size_t(chunk) * grain;
+      fn(begin, std::min(begin + grain, count));
+    }
+  };
+  int x = 0;
+  for (auto _ : state) {
+    field.rebuildWith(x, x, parallel_for);
+    x += 5;
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n * n);
+}
+BENCHMARK(BM_HeightfieldRebuildOpenMP)
+    ->Arg(50)
+    ->Arg(150)
+    ->Arg(300)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+#endif
+
+void BM_HeightfieldRebuildThreadPerTask(benchmark::State &state) {
+  size_t n = state.range(0);
+  Heightfield field(n, n, perlin::kDefaultSeed);
+  auto parallel_for = [](size_t count, auto fn) {
+    size_t grain = Heightfield::kRebuildGrain;
+    auto threads = std::vector<std::thread>();
+    for (size_t begin = 0; begin < count; begin += grain) {
+      threads.emplace_back(fn, begin, std::min(begin + grain, count));
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  };
+  int x = 0;
+  for (auto _ : state) {
+    field.rebuildWith(x, x, parallel_for);
+    x += 5;
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n * n);
+}
+BENCHMARK(BM_HeightfieldRebuildThreadPerTask)
+    ->Arg(50)
+    ->Arg(150)
+    ->Arg(300)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+void BM_IsPositionLegal(benchmark::State &state) {
+  size_t n = state.range(0);
+  Heightfield field(n, n, perlin::kDefaultSeed);
+  auto positions = samplePositions(4096, n / 2.0f - 2.0f);
+  for (auto _ : state) {
+    for (const auto &position : positions) {
+      benchmark::DoNotOptimize(field.isPositionLegal(position));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * positions.size());
+}
+BENCHMARK(BM_IsPositionLegal)->Arg(50)->Arg(150)->Arg(300);
+
+// Picking and line of sight like rays: from a few units above the water
+// anywhere in the window, looking slightly to steeply down
+std::vector<TerrainRay> sampleRays(size_t count, float extent) {
+  std::mt19937 engine(11);
+  auto dist = std::uniform_real_distribution<float>(-extent, extent);
+  auto height_dist = std::uniform_real_distribution<float>(2.0f, 15.0f);
+  auto azimuth_dist = std::uniform_real_distribution<float>(0.0f, 6.2831853f);
+  auto pitch_dist = std::uniform_real_distribution<float>(0.05f, 0.6f);
+  auto rays = std::vector<TerrainRay>(count);
+  for (auto &ray : rays) {
+    float azimuth = azimuth_dist(engine);
+    float pitch = pitch_dist(engine);
+    ray.origin = {dist(engine), height_dist(engine), dist(engine)};
+    ray.direction = {std::cos(azimuth) * std::cos(pitch), -std::sin(pitch),
+                     std::sin(azimuth) * std::cos(pitch)};
+    ray.max_t = 200.0f;
+  }
+  return rays;
+}
+
+// Brute force reference: steps cell by cell along the ray (Amanatides and
+// Woo) and samples the corners of every cell from perlin::getHeight
+TerrainHit ddaRaycast(const TerrainRay &ray, const Heightfield &field) {
+  TerrainHit hit;
+  float cell = perlin::kBlockSize;
+  glm::vec2 origin =
+      glm::vec2{float(field.cachedX()) - float(field.rows() / 2),
+                float(field.cachedZ()) - float(field.cols() / 2)} *
+      cell;
+  glm::vec2 extent = glm::vec2{float(field.rows()), float(field.cols())};
+  auto inverse = [](float value) {
+    return std::abs(value) > 1e-12f ? 1.0f / value
+                                    : std::copysign(1e30f, value);
+  };
+  glm::vec2 inv = {inverse(ray.direction.x), inverse(ray.direction.z)};
+  float tx0 = (origin.x - ray.origin.x) * inv.x;
+  float tx1 = (origin.x + extent.x * cell - ray.origin.x) * inv.x;
+  float tz0 = (origin.y - ray.origin.z) * inv.y;
+  float tz1 = (origin.y + extent.y * cell - ray.origin.z) * inv.y;
+  float t = std::max(0.0f, std::max(std::min(tx0, tx1), std::min(tz0, tz1)));
+  float t_end =
+      std::min(ray.max_t, std::min(std::max(tx0, tx1), std::max(tz0, tz1)));
+  if (t > t_end) {
+    return hit;
+  }
+  glm::vec3 entry = ray.origin + ray.direction * t;
+  int i = glm::clamp(int(std::floor((entry.x - origin.x) / cell)), 0,
+                     int(extent.x) - 1);
+  int j = glm::clamp(int(std::floor((entry.z - origin.y) / cell)), 0,
+                     int(extent.y) - 1);
+  int step_i = ray.direction.x >= 0.0f ? 1 : -1;
+  int step_j = ray.direction.z >= 0.0f ? 1 : -1;
+  float next_i =
+      (origin.x + (i + (step_i > 0)) * cell - ray.origin.x) * inv.x;
+  float next_j =
+      (origin.y + (j + (step_j > 0)) * cell - ray.origin.z) * inv.y;
+  while (i >= 0 && i < int(extent.x) && j >= 0 && j < int(extent.y)) {
+    float cell_exit = std::min(t_end, std::min(next_i, next_j));
+    glm::vec2 corner = origin + glm::vec2{float(i), float(j)} * cell;
+    uint32_t seed = field.seed();
+    glm::vec4 heights = {
+        perlin::getHeight(corner.x, corner.y, seed),
+        perlin::getHeight(corner.x + cell, corner.y, seed),
+        perlin::getHeight(corner.x, corner.y + cell, seed),
+        perlin::getHeight(corner.x + cell, corner.y + cell, seed)};
+    if (intersectTerrainCell(ray, corner, cell, heights, t, cell_exit, hit) ||
+        cell_exit >= t_end) {
+      break;
+    }
+    if (next_i < next_j) {
+      i += step_i;
+      next_i += cell * std::abs(inv.x);
+    } else {
+      j += step_j;
+      next_j += cell * std::abs(inv.y);
+    }
+    t = cell_exit;
+  }
+  return hit;
+}
+
+void BM_RaycastDDA(benchmark::State &state) {
+  size_t n = state.range(0);
+  Heightfield field(n, n, perlin::kDefaultSeed);
+  auto rays = sampleRays(1024, n / 2.0f - 2.0f);
+  for (auto _ : state) {
+    for (const auto &ray : rays) {
+      benchmark::DoNotOptimize(ddaRaycast(ray, field));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * rays.size());
+}
+BENCHMARK(BM_RaycastDDA)->Arg(150)->Arg(300)->Unit(benchmark::kMillisecond);
+
+void BM_RaycastPyramid(benchmark::State &state) {
+  size_t n = state.range(0);
+  Heightfield field(n, n, perlin::kDefaultSeed);
+  TerrainRaycaster raycaster(field);
+  auto rays = sampleRays(1024, n / 2.0f - 2.0f);
+  // Both walks must find the same crossings before their times mean anything
+  for (const auto &ray : rays) {
+    auto expected = ddaRaycast(ray, field);
+    auto actual = raycaster.cast(ray);
+    if (expected.hit != actual.hit ||
+        (expected.hit && std::abs(expected.t - actual.t) > 1e-3f)) {
+      state.SkipWithError("pyramid and DDA hits differ");
+      return;
+    }
+  }
+  for (auto _ : state) {
+    for (const auto &ray : rays) {
+      benchmark::DoNotOptimize(raycaster.cast(ray));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * rays.size());
+}
+BENCHMARK(BM_RaycastPyramid)
+    ->Arg(150)
+    ->Arg(300)
+    ->Unit(benchmark::kMillisecond);
+
+// A frame's worth of rays in one castBatch across the job system
+void BM_RaycastBatch(benchmark::State &state) {
+  size_t n = state.range(0);
+  JobSystem jobs(rebuildThreads());
+  Heightfield field(n, n, perlin::kDefaultSeed);
+  TerrainRaycaster raycaster(field, &jobs);
+  auto rays = sampleRays(4096, n / 2.0f - 2.0f);
+  auto hits = std::vector<TerrainHit>(rays.size());
+  for (auto _ : state) {
+    raycaster.castBatch(rays.data(), hits.data(), rays.size());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * rays.size());
+}
+BENCHMARK(BM_RaycastBatch)
+    ->Arg(150)
+    ->Arg(300)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Height of cell corner (i, j) of the window, i <= rows and j <= cols
+float cornerHeight(const Heightfield &field, size_t i, size_t j) {
+  size_t cell_i = std::min(i, field.rows() - 1);
+  size_t cell_j = std::min(j, field.cols() - 1);
+  const glm::vec4 &corners = field.heightVec()[cell_i * field.cols() + cell_j];
+  return corners[(i > cell_i ? 1 : 0) + (j > cell_j ? 2 : 0)];
+}
+
+// Every 7th corner against the nearest corner across the shore, brute force
+bool checkShoreDistance(const Heightfield &field, const ShoreDistance &shore) {
+  size_t rows = field.rows() + 1, cols = field.cols() + 1;
+  for (size_t p = 0; p < rows * cols; p += 7) {
+    size_t pi = p / cols, pj = p % cols;
+    bool land = cornerHeight(field, pi, pj) >= ShoreDistance::kWaterLevel;
+    float nearest = std::numeric_limits<float>::max();
+    for (size_t i = 0; i < rows; i++) {
+      for (size_t j = 0; j < cols; j++) {
+        if ((cornerHeight(field, i, j) >= ShoreDistance::kWaterLevel) != land) {
+          float di = float(i) - float(pi), dj = float(j) - float(pj);
+          nearest = std::min(nearest, di * di + dj * dj);
+        }
+      }
+    }
+    if (nearest == std::numeric_limits<float>::max()) {
+      continue;
+    }
+    float expected = (std::sqrt(nearest) - 0.5f) * (land ? -1.0f : 1.0f);
+    if (std::abs(shore.corner(pi, pj) - expected) > 1e-3f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// What World::recenter adds to a terrain rebuild, serial (0) or on the job
+// system (1)
+void BM_ShoreDistanceRebuild(benchmark::State &state) {
+  size_t n = state.range(0);
+  std::unique_ptr<JobSystem> jobs;
+  if (state.range(1)) {
+    jobs = std::make_unique<JobSystem>(rebuildThreads());
+  }
+  Heightfield field(n, n, perlin::kDefaultSeed);
+  ShoreDistance shore(field, jobs.get());
+  if (!checkShoreDistance(field, shore)) {
+    state.SkipWithError("distance transform and brute force differ");
+    return;
+  }
+  for (auto _ : state) {
+    shore.rebuild();
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * (n + 1) * (n + 1));
+}
+BENCHMARK(BM_ShoreDistanceRebuild)
+    ->Args({150, 0})
+    ->Args({150, 1})
+    ->Args({300, 0})
+    ->Args({300, 1})
+    ->UseRealTime();
+
+// Compare with BM_IsPositionLegal, which only sees the adjacent cells
+void BM_ShoreDistance(benchmark::State &state) {
+  size_t n = state.range(0);
+  Heightfield field(n, n, perlin::kDefaultSeed);
+  ShoreDistance shore(field);
+  auto positions = samplePositions(4096, n / 2.0f - 2.0f);
+  for (auto _ : state) {
+    for (const auto &position : positions) {
+      benchmark::DoNotOptimize(shore.distance(position));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * positions.size());
+}
+BENCHMARK(BM_ShoreDistance)->Arg(150)->Arg(300);
+
+// Pairs of water positions distance apart, starting anywhere in a square
+// map of 2 * extent cells
+std::vector<std::pair<glm::vec3, glm::vec3>>
+sampleRoutes(const NavGraph &graph, size_t count, float distance,
+             float extent = 2048.0f) {
+  std::mt19937 engine(11);
+  auto position_dist = std::uniform_real_distribution<float>(-extent, extent);
+  auto angle_dist =
+      std::uniform_real_distribution<float>(0.0f, 2.0f * perlin::kPi);
+  auto water = [&graph](const glm::vec3 &position) {
+    return graph.isWater(int(std::floor(position.x)),
+                         int(std::floor(position.z)));
+  };
+  auto routes = std::vector<std::pair<glm::vec3, glm::vec3>>();
+  while (routes.size() < count) {
+    float angle = angle_dist(engine);
+    glm::vec3 from{position_dist(engine), 0.0f, position_dist(engine)};
+    glm::vec3 to =
+        from + distance * glm::vec3{std::cos(angle), 0.0f, std::sin(angle)};
+    if (water(from) && water(to)) {
+      routes.emplace_back(from, to);
+    }
+  }
+  return routes;
+}
+
+/**
+ * The naive search: A* cell by cell, sampling the noise for every neighbour
+ * it looks at. Kept to the same cluster box as NavGraph::findPath, so both
+ * answer the same question. Returns the length, or -1 without a route.
+ */
+float cellAStar(const NavGraph &graph, const glm::vec3 &from,
+                const glm::vec3 &to) {
+  const float diagonal = std::sqrt(2.0f);
+  glm::ivec2 start{int(std::floor(from.x)), int(std::floor(from.z))};
+  glm::ivec2 goal{int(std::floor(to.x)), int(std::floor(to.z))};
+  auto cluster = [](const glm::ivec2 &cell) {
+    return glm::ivec2{glm::floor(glm::vec2(cell) /
+                                 float(NavGraph::kClusterCells))};
+  };
+  glm::ivec2 lo = (glm::min(cluster(start), cluster(goal)) -
+                   NavGraph::kSearchMargin) *
+                  NavGraph::kClusterCells;
+  glm::ivec2 hi = (glm::max(cluster(start), cluster(goal)) +
+                   NavGraph::kSearchMargin + 1) *
+                      NavGraph::kClusterCells -
+                  1;
+  auto key = [](const glm::ivec2 &cell) {
+    return (uint64_t(uint32_t(cell.x)) << 32) | uint32_t(cell.y);
+  };
+  auto heuristic = [&goal, diagonal](const glm::ivec2 &cell) {
+    int dx = std::abs(cell.x - goal.x), dz = std::abs(cell.y - goal.y);
+    return float(std::max(dx, dz)) +
+           (diagonal - 1.0f) * float(std::min(dx, dz));
+  };
+  using Entry = std::pair<float, glm::ivec2>;
+  auto later = [](const Entry &a, const Entry &b) { return a.first > b.first; };
+  std::priority_queue<Entry, std::vector<Entry>, decltype(later)> open(later);
+  std::unordered_map<uint64_t, float> costs;
+  std::unordered_map<uint64_t, bool> closed;
+  if (!graph.isWater(start.x, start.y) || !graph.isWater(goal.x, goal.y)) {
+    return -1.0f;
+  }
+  costs[key(start)] = 0.0f;
+  open.emplace(heuristic(start), start);
+  while (!open.empty()) {
+    glm::ivec2 cell = open.top().second;
+    open.pop();
+    if (closed[key(cell)]) {
+      continue;
+    }
+    closed[key(cell)] = true;
+    float cost = costs[key(cell)];
+    if (cell == goal) {
+      return cost;
+    }
+    for (int dx = -1; dx <= 1; dx++) {
+      for (int dz = -1; dz <= 1; dz++) {
+        glm::ivec2 next = cell + glm::ivec2{dx, dz};
+        if ((dx == 0 && dz == 0) || next.x < lo.x || next.y < lo.y ||
+            next.x > hi.x || next.y > hi.y || !graph.isWater(next.x, next.y) ||
+            !graph.isWater(next.x, cell.y) || !graph.isWater(cell.x, next.y)) {
+          continue;
+        }
+        float next_cost = cost + (dx != 0 && dz != 0 ? diagonal : 1.0f);
+        auto known = costs.find(key(next));
+        if (known == costs.end() || next_cost < known->second) {
+          costs[key(next)] = next_cost;
+          open.emplace(next_cost + heuristic(next), next);
+        }
+      }
+    }
+  }
+  return -1.0f;
+}
+
+// Every cell between the waypoints is water and no step cuts past land
+bool isWaterRoute(const NavGraph &graph, const NavPath &path) {
+  for (size_t i = 1; i < path.waypoints.size(); i++) {
+    glm::ivec2 cell{glm::floor(glm::vec2{path.waypoints[i - 1].x,
+                                         path.waypoints[i - 1].z})};
+    glm::ivec2 end{
+        glm::floor(glm::vec2{path.waypoints[i].x, path.waypoints[i].z})};
+    glm::ivec2 step{(end.x > cell.x) - (end.x < cell.x),
+                    (end.y > cell.y) - (end.y < cell.y)};
+    while (cell != end) {
+      glm::ivec2 next = cell + step;
+      if (!graph.isWater(next.x, next.y) || !graph.isWater(next.x, cell.y) ||
+          !graph.isWater(cell.x, next.y)) {
+        return false;
+      }
+      cell = next;
+    }
+  }
+  return true;
+}
+
+// HPA* paths per second between water positions state.range(0) cells
+// apart, with the clusters already cached, after checking the routes
+// against the naive search
+void BM_NavPath(benchmark::State &state) {
+  NavGraph graph(perlin::kDefaultSeed);
+  auto routes = sampleRoutes(graph, 64, float(state.range(0)));
+  float detour = 0.0f;
+  size_t found = 0;
+  NavPath path;
+  for (const auto &route : routes) {
+    float expected = cellAStar(graph, route.first, route.second);
+    bool hit = graph.findPath(route.first, route.second, path);
+    if (hit != (expected >= 0.0f) || (hit && !isWaterRoute(graph, path))) {
+      state.SkipWithError("hierarchical and cell routes differ");
+      return;
+    }
+    if (hit && expected > 0.0f) {
+      detour += path.length / expected;
+      found++;
+    }
+  }
+  size_t built = graph.builtClusters();
+  for (auto _ : state) {
+    for (const auto &route : routes) {
+      benchmark::DoNotOptimize(
+          graph.findPath(route.first, route.second, path));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * routes.size());
+  state.counters["detour"] = found ? detour / float(found) : 0.0f;
+  state.counters["found"] = float(found) / float(routes.size());
+  state.counters["rebuilt"] = float(graph.builtClusters() - built);
+}
+BENCHMARK(BM_NavPath)->Arg(64)->Arg(256)->Unit(benchmark::kMillisecond);
+
+void BM_NavPathCellAStar(benchmark::State &state) {
+  NavGraph graph(perlin::kDefaultSeed);
+  auto routes = sampleRoutes(graph, 64, float(state.range(0)));
+  for (auto _ : state) {
+    for (const auto &route : routes) {
+      benchmark::DoNotOptimize(cellAStar(graph, route.first, route.second));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * routes.size());
+}
+BENCHMARK(BM_NavPathCellAStar)
+    ->Arg(64)
+    ->Arg(256)
+    ->Unit(benchmark::kMillisecond);
+
+// A fleet of boats in the same waters asking for routes at once through the
+// planner. Every frame starts one budget of searches and waits for them,
+// helping out, in place of the rest of the frame. Clusters are built on the
+// way (0) or already cached (1).
+void BM_PathPlanner(benchmark::State &state) {
+  JobSystem jobs(rebuildThreads());
+  auto graph = std::make_unique<NavGraph>(perlin::kDefaultSeed);
+  auto routes = sampleRoutes(*graph, 256, 128.0f, 384.0f);
+  auto tickets = std::vector<uint32_t>(routes.size());
+  NavPath path;
+  for (const auto &route : routes) {
+    graph->findPath(route.first, route.second, path);
+  }
+  size_t frames = 0;
+  for (auto _ : state) {
+    if (state.range(0) == 0) {
+      state.PauseTiming();
+      graph = std::make_unique<NavGraph>(perlin::kDefaultSeed);
+      state.ResumeTiming();
+    }
+    PathPlanner planner(*graph, jobs);
+    for (size_t i = 0; i < routes.size(); i++) {
+      tickets[i] = planner.request(routes[i].first, routes[i].second);
+    }
+    size_t finished = 0;
+    while (finished < routes.size()) {
+      planner.update();
+      planner.wait();
+      frames++;
+      for (uint32_t ticket : tickets) {
+        auto status = planner.result(ticket, path);
+        finished += status == PathPlanner::Status::Found ||
+                    status == PathPlanner::Status::NotFound;
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * routes.size());
+  state.counters["frames"] = float(frames) / float(state.iterations());
+}
+BENCHMARK(BM_PathPlanner)
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Camera a couple of units above the water (or the terrain) 25 units from
+// the highest point of the window, looking at it from one of 8 directions,
+// with the GUI's projection
+glm::mat4 islandViewProjection(const Heightfield &field, int view,
+                               glm::vec3 &eye) {
+  const auto &offsets = field.offsets();
+  auto peak = *std::max_element(
+      offsets.begin(), offsets.end(),
+      [](const glm::vec3 &a, const glm::vec3 &b) { return a.y < b.y; });
+  float yaw = float(view) * 0.785398f;
+  eye = peak + glm::vec3{std::cos(yaw), 0.0f, std::sin(yaw)} * 25.0f;
+  eye.y = std::max(perlin::getHeight(eye.x, eye.z, field.seed()), 0.0f) + 2.0f;
+  auto center = glm::vec3{peak.x, eye.y, peak.z};
+  return glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 1000.0f) *
+         glm::lookAt(eye, center, glm::vec3{0.0f, 1.0f, 0.0f});
+}
+
+// Occluders under the cells of a heightfield window
+OccluderMesh windowOccluders(const Heightfield &field) {
+  int verts = int(field.rows()) + 1;
+  auto heights = std::vector<float>(size_t(verts * verts));
+  for (size_t i = 0; i < field.rows(); i++) {
+    for (size_t j = 0; j < field.cols(); j++) {
+      const glm::vec4 &corners = field.heightVec()[i * field.cols() + j];
+      heights[i * verts + j] = corners[0];
+      heights[(i + 1) * verts + j] = corners[1];
+      heights[i * verts + j + 1] = corners[2];
+      heights[(i + 1) * verts + j + 1] = corners[3];
+    }
+  }
+  OccluderMesh occluders;
+  occluders.addTerrain(heights.data(), verts,
+                       {field.offsets()[0].x, field.offsets()[0].z},
+                       perlin::kBlockSize);
+  return occluders;
+}
+
+// Boxes around 16 x 16 unit terrain chunks out to extent, past the window
+// like the outer clipmap levels, bounding the heights at every unit
+std::vector<std::pair<glm::vec3, glm::vec3>> chunkBoxes(uint32_t seed,
+                                                        int extent) {
+  constexpr int size = 16;
+  auto boxes = std::vector<std::pair<glm::vec3, glm::vec3>>{};
+  for (int x = -extent; x < extent; x += size) {
+    for (int z = -extent; z < extent; z += size) {
+      float lowest = std::numeric_limits<float>::max();
+      float highest = std::numeric_limits<float>::lowest();
+      for (int i = x; i <= x + size; i++) {
+        for (int j = z; j <= z + size; j++) {
+          float height = perlin::getHeight(float(i), float(j), seed);
+          lowest = std::min(lowest, height);
+          highest = std::max(highest, height);
+        }
+      }
+      boxes.push_back({{float(x), lowest, float(z)},
+                       {float(x + size), highest, float(z + size)}});
+    }
+  }
+  return boxes;
+}
+
+// A flat window with a 30 unit ridge across it, 50 to 80 units in front of
+// the camera: what is low behind it must be culled, anything in front of it
+// or rising above it must not
+const char *checkRidgeScene() {
+  constexpr int verts = 129;
+  auto heights = std::vector<float>(verts * verts);
+  for (int i = 0; i < verts; i++) {
+    for (int j = 0; j < verts; j++) {
+      heights[i * verts + j] = i >= 48 && i <= 80 ? 30.0f : 0.0f;
+    }
+  }
+  OccluderMesh occluders;
+  occluders.addTerrain(heights.data(), verts, {0.0f, 0.0f}, 1.0f);
+  OcclusionCuller culler;
+  culler.setOccluders(occluders);
+  auto eye = glm::vec3{0.0f, 20.0f, 64.0f};
+  culler.render(
+      glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 1000.0f) *
+      glm::lookAt(eye, glm::vec3{100.0f, 20.0f, 64.0f},
+                  glm::vec3{0.0f, 1.0f, 0.0f}));
+  if (!culler.isOccluded({90.0f, 0.0f, 60.0f}, {100.0f, 2.0f, 68.0f})) {
+    return "box behind the ridge not culled";
+  }
+  if (culler.isOccluded({20.0f, 0.0f, 60.0f}, {30.0f, 2.0f, 68.0f})) {
+    return "box in front of the ridge culled";
+  }
+  if (culler.isOccluded({90.0f, 0.0f, 60.0f}, {100.0f, 50.0f, 68.0f})) {
+    return "box over the ridge culled";
+  }
+  return nullptr;
+}
+
+// Rasterizing the occluders of a window, serially and on the job system
+void BM_OcclusionRender(benchmark::State &state) {
+  if (const char *error = checkRidgeScene()) {
+    state.SkipWithError(error);
+    return;
+  }
+  size_t n = state.range(0);
+  std::unique_ptr<JobSystem> jobs;
+  if (state.range(1)) {
+    jobs = std::make_unique<JobSystem>(rebuildThreads());
+  }
+  Heightfield field(n, n, perlin::kDefaultSeed);
+  OcclusionCuller culler(jobs.get());
+  culler.setOccluders(windowOccluders(field));
+  glm::vec3 eye;
+  auto view_projection = islandViewProjection(field, 0, eye);
+  for (auto _ : state) {
+    culler.render(view_projection);
+    benchmark::ClobberMemory();
+  }
+  state.counters["triangles"] = double(culler.occluderTriangles());
+}
+BENCHMARK(BM_OcclusionRender)
+    ->Args({150, 0})
+    ->Args({150, 1})
+    ->Args({300, 0})
+    ->Args({300, 1})
+    ->UseRealTime();
+
+// Testing terrain chunks against the occluders of a window. Every box
+// reported hidden is checked first: the terrain must be hit on the way to
+// each of its corners on screen.
+void BM_OcclusionTest(benchmark::State &state) {
+  size_t n = state.range(0);
+  Heightfield field(n, n, perlin::kDefaultSeed);
+  TerrainRaycaster raycaster(field);
+  OcclusionCuller culler;
+  culler.setOccluders(windowOccluders(field));
+  auto boxes = chunkBoxes(field.seed(), int(2 * n));
+  size_t tested = 0;
+  size_t culled = 0;
+  for (int view = 0; view < 8; view++) {
+    glm::vec3 eye;
+    auto view_projection = islandViewProjection(field, view, eye);
+    culler.render(view_projection);
+    for (const auto &box : boxes) {
+      tested++;
+      if (!culler.isOccluded(box.first, box.second)) {
+        continue;
+      }
+      culled++;
+      for (int corner = 0; corner < 8; corner++) {
+        auto point = glm::vec3{
+            corner & 1 ? box.second.x : box.first.x,
+            corner & 2 ? box.second.y : box.first.y,
+            corner & 4 ? box.second.z : box.first.z};
+        glm::vec4 clip = view_projection * glm::vec4(point, 1.0f);
+        if (std::abs(clip.x) > clip.w || std::abs(clip.y) > clip.w) {
+          continue;
+        }
+        TerrainRay ray;
+        ray.origin = eye;
+        ray.direction = point - eye;
+        ray.max_t = 1.0f;
+        if (!raycaster.cast(ray).hit) {
+          state.SkipWithError("visible chunk culled");
+          return;
+        }
+      }
+    }
+  }
+  for (auto _ : state) {
+    for (const auto &box : boxes) {
+      benchmark::DoNotOptimize(culler.isOccluded(box.first, box.second));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * boxes.size());
+  state.counters["culled"] = double(culled) / double(tested);
+}
+BENCHMARK(BM_OcclusionTest)->Arg(150)->Arg(300);
+
+void BM_WaveHeight(benchmark::State &state) {
+  WaveModel waves(perlin::kDefaultSeed);
+  waves.advance(10.0);
+  auto positions = samplePositions(state.range(0), 100.0f);
+  for (auto _ : state) {
+    for (const auto &position : positions) {
+      benchmark::DoNotOptimize(waves.height(position));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * positions.size());
+}
+BENCHMARK(BM_WaveHeight)->RangeMultiplier(8)->Range(64, 4096);
+
+void BM_WaveNormal(benchmark::State &state) {
+  WaveModel waves(perlin::kDefaultSeed);
+  waves.advance(10.0);
+  auto positions = samplePositions(state.range(0), 100.0f);
+  for (auto _ : state) {
+    for (const auto &position : positions) {
+      benchmark::DoNotOptimize(waves.normal(position));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * positions.size());
+}
+BENCHMARK(BM_WaveNormal)->RangeMultiplier(8)->Range(64, 4096);
+
+// The wave kernels of the quality presets, the count is a template argument
+// so the loops unroll
+template <int N> void BM_WaveKernel(benchmark::State &state) {
+  WaveModel waves(perlin::kDefaultSeed, N);
+  waves.advance(10.0);
+  const auto &constants = waves.constants();
+  auto positions = samplePositions(4096, 100.0f);
+  for (auto _ : state) {
+    for (const auto &position : positions) {
+      benchmark::DoNotOptimize(WaveKernel<N>::normal(constants, position));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * positions.size());
+}
+BENCHMARK_TEMPLATE(BM_WaveKernel, kLowWaves);
+BENCHMARK_TEMPLATE(BM_WaveKernel, kNumWaves);
+BENCHMARK_TEMPLATE(BM_WaveKernel, kHighWaves);
+
+// One simulated player per thread, each in its own World: every step moves
+// along x, advances the waves and runs the collision and buoyancy queries
+void BM_WorldStep(benchmark::State &state) {
+  World world(150, 150, perlin::kDefaultSeed);
+  glm::vec3 center = {0.0f, 0.0f, 0.0f};
+  double time = 0.0;
+  for (auto _ : state) {
+    center.x += 0.1f;
+    time += 1.0 / 60.0;
+    world.recenter(center);
+    world.advance(time);
+    benchmark::DoNotOptimize(world.isPositionLegal(center));
+    benchmark::DoNotOptimize(world.getWaveNormal(center));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_WorldStep)->ThreadRange(1, 8)->UseRealTime();
+
+// The simulation/render handoff without GL: a producer thread steps a World
+// and publishes what the renderer reads, the benchmark thread consumes every
+// frame in order. Run it from an ENABLE_TSAN build to check for data races.
+struct HandoffFrame {
+  int frame = -1;
+  WaveConstants waves;
+  uint64_t terrain_version = UINT64_MAX;
+  std::vector<glm::vec3> offsets;
+};
+
+void BM_FrameHandoff(benchmark::State &state) {
+  World world(150, 150, perlin::kDefaultSeed);
+  TripleBuffer<HandoffFrame> frames;
+  std::atomic<bool> running{true};
+  std::thread producer([&world, &frames, &running]() {
+    glm::vec3 center = {0.0f, 0.0f, 0.0f};
+    for (int frame = 0; running; frame++) {
+      center.x += 0.1f;
+      world.recenter(center);
+      world.advance(frame / 60.0);
+      auto &slot = frames.writeBuffer();
+      slot.frame = frame;
+      slot.waves = world.waves().constants();
+      if (slot.terrain_version != world.terrainVersion()) {
+        slot.terrain_version = world.terrainVersion();
+        slot.offsets = world.heightfield().offsets();
+      }
+      while (frames.hasUnread() && running) {
+        std::this_thread::yield();
+      }
+      frames.publish();
+    }
+  });
+  int last = -1;
+  for (auto _ : state) {
+    while (!frames.acquire()) {
+      std::this_thread::yield();
+    }
+    const auto &frame = frames.readBuffer();
+    if (frame.frame != last + 1) {
+      state.SkipWithError("frame dropped or reordered");
+      break;
+    }
+    last = frame.frame;
+    benchmark::DoNotOptimize(
+        waveHeight(frame.waves, frame.offsets[last % frame.offsets.size()]));
+  }
+  running = false;
+  producer.join();
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FrameHandoff)->UseRealTime();
+
+void BM_MoveRainDrops(benchmark::State &state) {
+  size_t n = state.range(0);
+  auto drops = spawnRainDrops(n, n, perlin::kDefaultSeed);
+  for (auto _ : state) {
+    moveRainDrops(drops, 1.0f / 60.0f);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * drops.size());
+}
+BENCHMARK(BM_MoveRainDrops)->Arg(50)->Arg(150)->Arg(300);
+
+void BM_LoadObj(benchmark::State &state) {
+  const std::string filename = "../assets/rowboat.obj";
+  // LoadObj reports progress on stdout, keep it out of the console output
+  std::ostringstream sink;
+  auto *stdout_buffer = std::cout.rdbuf(sink.rdbuf());
+  for (auto _ : state) {
+    try {
+      benchmark::DoNotOptimize(util::LoadObj(filename));
+    } catch (const std::exception &e) {
+      state.SkipWithError(e.what());
+      break;
+    }
+    sink.str("");
+  }
+  std::cout.rdbuf(stdout_buffer);
+}
+BENCHMARK(BM_LoadObj)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+int main(int argc, char **argv) {
+  // Default to JSON output next to the console report
+  auto args = std::vector<char *>(argv, argv + argc);
+  bool has_out = false;
+  for (int i = 1; i < argc; i++) {
+    has_out |= std::strncmp(argv[i], "--benchmark_out=", 16) == 0;
+  }
+  std::string out = "--benchmark_out=ocean_bench.json";
+  std::string format = "--benchmark_out_format=json";
+  if (!has_out) {
+    args.push_back(&out[0]);
+    args.push_back(&format[0]);
+  }
+  int count = int(args.size());
+  benchmark::Initialize(&count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(count, args.data())) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * Steps the real Simulation on its own thread against this one standing in
+ * for the render thread, without a GL context or a window, to check the
+ * handoff between them under ThreadSanitizer (-DENABLE_TSAN=ON). The render
+ * side queues input on the GUI like the GLFW callbacks would and records
+ * profiler zones, while the simulation takes the input from the GUI, records
+ * it into an InputLog and records its own zones. A second run replays the
+ * log.
+ *
+ * Fails when a frame is skipped or repeated, when the simulation thread
+ * allocates after the warm up, or when the replay ends on another camera.
+ *
+ *   simulation_stress [frames] [log]
+ */
+
+#include "alloc_counter.h"
+#include "gui.h"
+#include "input_log.h"
+#include "profiler.h"
+#include "simulation.h"
+#include "world/job_system.h"
+#include "world/world.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace {
+
+constexpr int kWidth = 1280;
+constexpr int kHeight = 720;
+constexpr size_t kRows = 150;
+constexpr size_t kCols = 150;
+constexpr uint32_t kSeed = 0x5eed;
+constexpr int kWarmupFrames = 60; /* may allocate, as in BenchRecorder */
+
+struct RunResult {
+  int frames = 0;
+  bool in_order = true;
+  size_t steady_allocations = 0; /* simulation thread, after the warm up */
+  int rebuilds = 0;              /* terrain versions seen after the first */
+  glm::vec3 eye{0.0f};
+  glm::vec3 center{0.0f};
+};
+
+void key(GUI &gui, int key, int action) {
+  InputEvent event;
+  event.type = InputEvent::Type::Key;
+  event.key = key;
+  event.action = action;
+  gui.onInput(event);
+}
+
+void cursor(GUI &gui, InputEvent::Type type, double x, double y) {
+  InputEvent event;
+  event.type = type;
+  event.x = x;
+  event.y = y;
+  gui.onInput(event);
+}
+
+/**
+ * The same input for the same frame on every run: sail forward for one
+ * second out of two, so terrain rebuilds run, look around and now and then
+ * toggle the rain and zoom.
+ */
+void feedInput(GUI &gui, int frame) {
+  if (frame % 120 == 0) {
+    key(gui, GLFW_KEY_W, GLFW_PRESS);
+  } else if (frame % 120 == 60) {
+    key(gui, GLFW_KEY_W, GLFW_RELEASE);
+  }
+  if (frame % 90 == 45) {
+    key(gui, GLFW_KEY_1, GLFW_RELEASE);
+  }
+  if (frame % 30 == 15) {
+    cursor(gui, InputEvent::Type::Scroll, 0.0, frame % 60 < 30 ? 1.0 : -1.0);
+  }
+  cursor(gui, InputEvent::Type::CursorPos,
+         kWidth / 2 + 200.0 * std::sin(frame * 0.05),
+         kHeight / 2 + 50.0 * std::cos(frame * 0.03));
+}
+
+RunResult run(InputLog &input_log, int frames) {
+  JobSystem workers;
+  GUI gui(kWidth, kHeight);
+  World world(kRows, kCols, kSeed, &workers);
+  gui.world = &world;
+  bool replaying = input_log.mode() == InputLog::Mode::Replay;
+  Simulation simulation(world, gui, input_log, nullptr, true,
+                        replaying ? input_log.frames() : frames,
+                        Simulation::Clock::now());
+
+  RunResult result;
+  uint64_t terrain_version = world.terrainVersion();
+  simulation.start();
+  while (const FrameSnapshot *frame = simulation.nextFrame()) {
+    PROFILE_BEGIN_FRAME();
+    {
+      PROFILE_CPU_SCOPE("render");
+      if (frame->frame != result.frames) {
+        std::cerr << "Frame " << frame->frame << " handed over as frame "
+                  << result.frames << std::endl;
+        result.in_order = false;
+      }
+      if (frame->frame >= kWarmupFrames) {
+        result.steady_allocations += frame->allocations;
+      }
+      if (frame->terrain.version != terrain_version) {
+        terrain_version = frame->terrain.version;
+        result.rebuilds++;
+      }
+      result.eye = frame->eye;
+      result.center = frame->center;
+      result.frames++;
+      // A replay ignores live input, the simulation dispatches the log
+      if (!replaying) {
+        feedInput(gui, frame->frame);
+      }
+    }
+    PROFILE_END_FRAME();
+  }
+  simulation.stop();
+  return result;
+}
+
+bool check(const char *name, const RunResult &result, int frames) {
+  bool passed = result.in_order && result.frames == frames;
+  std::cout << name << ": " << result.frames << " frames, "
+            << result.rebuilds << " terrain rebuilds";
+  if (alloc_counter::enabled()) {
+    std::cout << ", " << result.steady_allocations
+              << " simulation heap allocations after " << kWarmupFrames
+              << " warm up frames";
+    passed = passed && result.steady_allocations == 0;
+  }
+  std::cout << std::endl;
+  return passed;
+}
+}
+
+int main(int argc, char *argv[]) {
+  int frames = argc > 1 ? std::atoi(argv[1]) : 600;
+  std::string log_file = argc > 2 ? argv[2] : "simulation_stress.log";
+
+  InputLog recording;
+  if (!recording.startRecording(log_file, kSeed, "medium")) {
+    return EXIT_FAILURE;
+  }
+  RunResult recorded = run(recording, frames);
+  bool passed = check("Recorded", recorded, frames) &&
+                recording.save(recorded.frames);
+
+  InputLog replay;
+  if (passed && replay.load(log_file)) {
+    RunResult replayed = run(replay, frames);
+    passed = check("Replayed", replayed, frames);
+    if (replayed.eye != recorded.eye || replayed.center != recorded.center) {
+      std::cerr << "The replay ended on another camera" << std::endl;
+      passed = false;
+    }
+  } else {
+    passed = false;
+  }
+  PROFILE_REPORT(std::cout);
+  std::cout << (passed ? "Passed" : "Failed") << std::endl;
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,83 @@
+#include "camera_path.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+bool CameraPath::load(const std::string &filename) {
+  std::ifstream file{filename};
+  if (!file.is_open()) {
+    std::cerr << "Failed to open camera path: " << filename << std::endl;
+    return false;
+  }
+  keyframes_.clear();
+  storm_toggles_.clear();
+
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line)) {
+    line_number++;
+    std::istringstream stream{line};
+    std::string first;
+    if (!(stream >> first) || first[0] == '#') {
+      continue;
+    }
+    bool ok;
+    if (first == "storm") {
+      float time;
+      ok = bool(stream >> time);
+      if (ok) {
+        storm_toggles_.push_back(time);
+      }
+    } else {
+      Keyframe key;
+      ok = bool(std::istringstream{first} >> key.time) &&
+           bool(stream >> key.center.x >> key.center.y >> key.center.z >>
+                key.look.x >> key.look.y >> key.look.z) &&
+           (keyframes_.empty() || key.time > keyframes_.back().time);
+      if (ok) {
+        key.look = glm::normalize(key.look);
+        keyframes_.push_back(key);
+      }
+    }
+    if (!ok) {
+      std::cerr << filename << ":" << line_number << ": bad path entry"
+                << std::endl;
+      return false;
+    }
+  }
+  if (keyframes_.empty()) {
+    std::cerr << filename << ": no keyframes" << std::endl;
+    return false;
+  }
+  std::sort(storm_toggles_.begin(), storm_toggles_.end());
+  return true;
+}
+
+float CameraPath::duration() const {
+  return keyframes_.empty() ? 0.0f : keyframes_.back().time;
+}
+
+void CameraPath::sample(float time, glm::vec3 &center, glm::vec3 &look) const {
+  auto next = std::find_if(
+      keyframes_.begin(), keyframes_.end(),
+      [time](const Keyframe &key) { return key.time > time; });
+  if (next == keyframes_.begin() || next == keyframes_.end()) {
+    const auto &key = next == keyframes_.end() ? keyframes_.back() : *next;
+    center = key.center;
+    look = key.look;
+    return;
+  }
+  auto prev = next - 1;
+  float t = (time - prev->time) / (next->time - prev->time);
+  center = glm::mix(prev->center, next->center, t);
+  look = glm::normalize(glm::mix(prev->look, next->look, t));
+}
+
+bool CameraPath::isStormy(float time) const {
+  auto toggles = std::upper_bound(storm_toggles_.begin(), storm_toggles_.end(),
+                                  time) -
+                 storm_toggles_.begin();
+  return toggles % 2 == 1;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+/*
+ * Camera path file, one entry per line:
+ *
+ *   <time> <center x y z> <look x y z>   keyframe of the boat and camera
+ *   storm <time>                          toggle the storm at that time
+ *
+ * Blank lines and lines starting with '#' are ignored. Keyframes must be in
+ * increasing time order, the pose in between is linearly interpolated.
+ */
+class CameraPath {
+public:
+  bool load(const std::string &filename);
+  float duration() const;
+  void sample(float time, glm::vec3 &center, glm::vec3 &look) const;
+  bool isStormy(float time) const;
+
+private:
+  struct Keyframe {
+    float time;
+    glm::vec3 center;
+    glm::vec3 look;
+  };
+  std::vector<Keyframe> keyframes_;
+  std::vector<float> storm_toggles_;
+};
@@ -0,0 +1,284 @@
+#include "clipmap_render.h"
+
+#include "perlin.hpp"
+#include "profiler.h"
+#include "world/frame_arena.h"
+#include <GL/glew.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <limits>
+
+const char *clipmap_vertex_shader =
+#include "shaders/terrain_clipmap.vert"
+    ;
+
+const char *clipmap_fragment_shader =
+#include "shaders/terrain.frag"
+    ;
+
+using std::vector;
+
+// Must match the constants in terrain_clipmap.vert
+constexpr int kClipmapLevels = 6;
+constexpr int kClipmapGrid = 64; /* quads per side of every level */
+constexpr int kClipmapVerts = kClipmapGrid + 1;
+constexpr int kApronVerts = kClipmapVerts + 2;
+constexpr float kClipmapSpacing = 1.0f; /* spacing of the finest level */
+constexpr int kChunksPerSide = kClipmapGrid / 8; /* kChunkQuads each */
+
+ClipmapRender::ClipmapRender(uint32_t seed,
+                             std::vector<ShaderUniform> uniforms,
+                             const ShaderDefines &defines)
+    : seed_(seed), centers_(kClipmapLevels, glm::ivec2{INT_MIN, INT_MIN}),
+      positions_(kClipmapLevels * kClipmapVerts * kClipmapVerts),
+      normals_(positions_.size()), coarse_normals_(positions_.size()) {
+  static_assert(kChunksPerSide * kChunkQuads == kClipmapGrid,
+                "chunks must tile a level");
+  size_t max_chunks = size_t(kClipmapLevels * kChunksPerSide * kChunksPerSide);
+  chunks_.reserve(max_chunks);
+  draw_counts_.reserve(max_chunks);
+  draw_offsets_.reserve(max_chunks);
+  // At most a top and two walls per addTerrain block
+  constexpr int kLevelBlocks = kClipmapGrid / OccluderMesh::kBlockQuads *
+                               kClipmapGrid / OccluderMesh::kBlockQuads;
+  occluders_.vertices.reserve(kClipmapLevels * kLevelBlocks * 12);
+  occluders_.triangles.reserve(kClipmapLevels * kLevelBlocks * 6);
+  for (int level = 0; level < kClipmapLevels; level++) {
+    updateLevel(level, 0, 0);
+  }
+  updateFaces();
+
+  auto clipmap_pass_input = RenderDataInput{};
+  clipmap_pass_input.assign(0, "vertex_position", positions_.data(),
+                            positions_.size(), 4, GL_FLOAT);
+  clipmap_pass_input.assign(1, "vertex_normal", normals_.data(),
+                            normals_.size(), 4, GL_FLOAT);
+  clipmap_pass_input.assign(2, "coarse_normal", coarse_normals_.data(),
+                            coarse_normals_.size(), 3, GL_FLOAT);
+  clipmap_pass_input.assignIndex(faces_.data(), faces_.size(), 3);
+
+  // No geometry shader: the vertex shader does all per-vertex work
+  auto clipmap_shaders = vector<const char *>{
+      {clipmap_vertex_shader, nullptr,
+       shaderVariant(clipmap_fragment_shader, defines)}};
+  auto output = vector<const char *>{{"fragment_color"}};
+  clipmap_pass_ = std::make_unique<RenderPass>(-1, clipmap_pass_input,
+                                               clipmap_shaders, uniforms,
+                                               output);
+}
+
+bool ClipmapRender::update(const glm::vec3 &eye) {
+  // Level centers snap to twice their own spacing so that every level lines
+  // up with the even vertices of the next finer one
+  bool moved = false;
+  for (int level = 0; level < kClipmapLevels; level++) {
+    int snap_step = 2 * (1 << level);
+    float snap = kClipmapSpacing * snap_step;
+    int center_x = int(std::floor(eye.x / snap)) * snap_step;
+    int center_z = int(std::floor(eye.z / snap)) * snap_step;
+    if (centers_[level] != glm::ivec2{center_x, center_z}) {
+      updateLevel(level, center_x, center_z);
+      moved = true;
+    }
+  }
+
+  if (moved) {
+    PROFILE_CPU_SCOPE("terrain rebuild");
+    updateFaces();
+    clipmap_pass_->updateVBO(0, positions_.data(), positions_.size());
+    clipmap_pass_->updateVBO(1, normals_.data(), normals_.size());
+    clipmap_pass_->updateVBO(2, coarse_normals_.data(),
+                             coarse_normals_.size());
+    clipmap_pass_->updateIndex(faces_.data(), faces_.size());
+  }
+  return moved;
+}
+
+void ClipmapRender::cull(const OcclusionCuller *culler) {
+  draw_counts_.clear();
+  draw_offsets_.clear();
+  drawn_lo_ = glm::vec3{std::numeric_limits<float>::max()};
+  drawn_hi_ = glm::vec3{-std::numeric_limits<float>::max()};
+  for (const auto &chunk : chunks_) {
+    if (!culler || !culler->isOccluded(chunk.lo, chunk.hi)) {
+      draw_counts_.push_back(chunk.count);
+      draw_offsets_.push_back(
+          reinterpret_cast<const void *>(chunk.first * sizeof(unsigned)));
+      drawn_lo_ = glm::min(drawn_lo_, chunk.lo);
+      drawn_hi_ = glm::max(drawn_hi_, chunk.hi);
+    }
+  }
+}
+
+void ClipmapRender::draw() {
+  clipmap_pass_->setup();
+  PROFILE_GPU_SCOPE("terrain");
+  glMultiDrawElements(GL_TRIANGLES, draw_counts_.data(), GL_UNSIGNED_INT,
+                      draw_offsets_.data(), GLsizei(draw_counts_.size()));
+}
+
+/**
+ * Sample the heights of one level (with a one vertex apron for central
+ * difference normals) and derive the coarse height and normal each vertex
+ * morphs to. Odd vertices take the average of the two even vertices on the
+ * coarse edge they lie on, which is exactly what the next level renders.
+ */
+void ClipmapRender::updateLevel(int level, int center_x, int center_z) {
+  PROFILE_CPU_SCOPE("terrain rebuild");
+  int step = 1 << level;
+  float spacing = kClipmapSpacing * step;
+  float origin_x = (center_x - kClipmapGrid / 2 * step) * kClipmapSpacing;
+  float origin_z = (center_z - kClipmapGrid / 2 * step) * kClipmapSpacing;
+
+  // One level plus a 1 vertex apron
+  FrameArena::Scope scope;
+  auto heights = ArenaVector<float>(kApronVerts * kApronVerts);
+  for (int a = 0; a < kApronVerts; a++) {
+    for (int b = 0; b < kApronVerts; b++) {
+      heights[a * kApronVerts + b] =
+          perlin::getHeight(origin_x + (a - 1) * spacing,
+                            origin_z + (b - 1) * spacing, seed_);
+    }
+  }
+  auto height = [&heights](int i, int j) {
+    return heights[(i + 1) * kApronVerts + (j + 1)];
+  };
+  auto normal = [&height, spacing](int i, int j) {
+    float dhx = (height(i + 1, j) - height(i - 1, j)) / (2.0f * spacing);
+    float dhz = (height(i, j + 1) - height(i, j - 1)) / (2.0f * spacing);
+    return glm::normalize(glm::vec3{-dhx, 1.0f, -dhz});
+  };
+
+  size_t base = size_t(level) * kClipmapVerts * kClipmapVerts;
+  for (int i = 0; i < kClipmapVerts; i++) {
+    for (int j = 0; j < kClipmapVerts; j++) {
+      // Neighbours along the coarse edge (or diagonal) this vertex lies on
+      int i0 = i - (i & 1), i1 = i + (i & 1);
+      int j0 = j - (j & 1), j1 = j + (j & 1);
+      float coarse_height = 0.5f * (height(i0, j0) + height(i1, j1));
+      glm::vec3 coarse_normal =
+          glm::normalize(normal(i0, j0) + normal(i1, j1));
+
+      size_t index = base + i * kClipmapVerts + j;
+      positions_[index] = {origin_x + i * spacing, height(i, j),
+                           origin_z + j * spacing, coarse_height};
+      normals_[index] = glm::vec4(normal(i, j), float(level));
+      coarse_normals_[index] = coarse_normal;
+    }
+  }
+  centers_[level] = {center_x, center_z};
+}
+
+/**
+ * Rebuild the index buffer, chunk by chunk, and draw every chunk until the
+ * next cull(). Every level except the finest skips the kClipmapGrid / 2
+ * square of cells covered by the level inside it.
+ */
+void ClipmapRender::updateFaces() {
+  faces_.clear();
+  occluders_.clear();
+  chunks_.clear();
+  draw_counts_.clear();
+  draw_offsets_.clear();
+  for (int level = 0; level < kClipmapLevels; level++) {
+    int step = 1 << level;
+    int hole_x = kClipmapGrid, hole_z = kClipmapGrid;
+    if (level > 0) {
+      // The finer level is half as wide, its origin is aligned to our grid
+      int inner_step = step / 2;
+      hole_x = (centers_[level - 1].x - kClipmapGrid / 2 * inner_step -
+                (centers_[level].x - kClipmapGrid / 2 * step)) /
+               step;
+      hole_z = (centers_[level - 1].y - kClipmapGrid / 2 * inner_step -
+                (centers_[level].y - kClipmapGrid / 2 * step)) /
+               step;
+    }
+
+    unsigned base = unsigned(level) * kClipmapVerts * kClipmapVerts;
+    for (int chunk_x = 0; chunk_x < kChunksPerSide; chunk_x++) {
+      for (int chunk_z = 0; chunk_z < kChunksPerSide; chunk_z++) {
+        size_t first = faces_.size();
+        float lowest = std::numeric_limits<float>::max();
+        float highest = std::numeric_limits<float>::lowest();
+        for (int i = chunk_x * kChunkQuads; i < (chunk_x + 1) * kChunkQuads;
+             i++) {
+          for (int j = chunk_z * kChunkQuads;
+               j < (chunk_z + 1) * kChunkQuads; j++) {
+            if (i >= hole_x && i < hole_x + kClipmapGrid / 2 && j >= hole_z &&
+                j < hole_z + kClipmapGrid / 2) {
+              continue;
+            }
+            unsigned v00 = base + i * kClipmapVerts + j;
+            unsigned v01 = v00 + 1;
+            unsigned v10 = v00 + kClipmapVerts;
+            unsigned v11 = v10 + 1;
+            // Split along the v00-v11 diagonal, same winding as cube_faces
+            faces_.emplace_back(v00, v11, v10);
+            faces_.emplace_back(v00, v01, v11);
+            // The vertex shader morphs between the two heights
+            for (unsigned v : {v00, v01, v10, v11}) {
+              const glm::vec4 &position = positions_[v];
+              lowest = std::min(lowest, std::min(position.y, position.w));
+              highest = std::max(highest, std::max(position.y, position.w));
+            }
+          }
+        }
+        if (faces_.size() == first) {
+          continue;
+        }
+        unsigned corner = base + chunk_x * kChunkQuads * kClipmapVerts +
+                          chunk_z * kChunkQuads;
+        unsigned far_corner =
+            corner + kChunkQuads * kClipmapVerts + kChunkQuads;
+        Chunk chunk;
+        chunk.first = int(first * 3);
+        chunk.count = int((faces_.size() - first) * 3);
+        chunk.lo = {positions_[corner].x, lowest, positions_[corner].z};
+        chunk.hi = {positions_[far_corner].x, highest,
+                    positions_[far_corner].z};
+        chunks_.push_back(chunk);
+        draw_counts_.push_back(chunk.count);
+        draw_offsets_.push_back(
+            reinterpret_cast<const void *>(chunk.first * sizeof(unsigned)));
+      }
+    }
+    addLevelOccluders(level, hole_x, hole_z);
+  }
+}
+
+/**
+ * Occluders under one level (see OccluderMesh::addTerrain), from the lower of
+ * the two heights every vertex morphs between. Blocks reaching into the hole
+ * also cover the finer level drawn there, so its vertices are folded into the
+ * vertices around them first.
+ */
+void ClipmapRender::addLevelOccluders(int level, int hole_x, int hole_z) {
+  FrameArena::Scope scope;
+  auto lower = ArenaVector<float>(kClipmapVerts * kClipmapVerts);
+  size_t base = size_t(level) * kClipmapVerts * kClipmapVerts;
+  for (size_t v = 0; v < lower.size(); v++) {
+    lower[v] = std::min(positions_[base + v].y, positions_[base + v].w);
+  }
+  if (level > 0) {
+    // Finer vertex a lies 2 * hole_x + a half quads into this level
+    size_t inner = base - kClipmapVerts * kClipmapVerts;
+    for (int a = 0; a < kClipmapVerts; a++) {
+      for (int b = 0; b < kClipmapVerts; b++) {
+        const glm::vec4 &position = positions_[inner + a * kClipmapVerts + b];
+        float height = std::min(position.y, position.w);
+        int x = 2 * hole_x + a, z = 2 * hole_z + b;
+        for (int i : {x / 2, (x + 1) / 2}) {
+          for (int j : {z / 2, (z + 1) / 2}) {
+            float &low = lower[i * kClipmapVerts + j];
+            low = std::min(low, height);
+          }
+        }
+      }
+    }
+  }
+  const glm::vec4 &origin = positions_[base];
+  occluders_.addTerrain(lower.data(), kClipmapVerts, {origin.x, origin.z},
+                        kClipmapSpacing * (1 << level),
+                        {hole_x, hole_z, kClipmapGrid / 2, kClipmapGrid / 2});
+}
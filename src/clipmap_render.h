@@ -0,0 +1,78 @@
+#pragma once
+
+#include "render_pass.h"
+#include "shader_variants.h"
+#include "world/occlusion_culler.h"
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+/*
+ * Geometry clipmap terrain: kClipmapLevels nested square rings of grid
+ * vertices centered on the camera, where every level doubles the spacing of
+ * the one inside it. The finest level is a full grid, every other level
+ * leaves a hole where the finer level sits. Heights come from
+ * perlin::getHeight with the world seed and are only recomputed for a level
+ * when its snapped center moves. Each vertex also carries the height (and
+ * normal) of the next coarser level so the vertex shader can morph towards it
+ * near the outer edge of its ring, which hides the seams and the popping
+ * between levels.
+ *
+ * The index buffer is laid out in chunks of kChunkQuads x kChunkQuads quads
+ * with their bounds, so cull() can leave out the ones behind the terrain,
+ * and the levels double as the occluders they are tested against.
+ */
+class ClipmapRender {
+public:
+  // defines select the terrain.frag permutation, see shader_variants.h
+  ClipmapRender(uint32_t seed, std::vector<ShaderUniform> uniforms,
+                const ShaderDefines &defines = ShaderDefines{});
+  // Recenter the levels on eye, then draw() with the pass set up. True if a
+  // level moved, which also rebuilds the chunks and the occluders.
+  bool update(const glm::vec3 &eye);
+  // Only the chunks culler can not prove hidden are drawn, every chunk if it
+  // is null, until the next update() that moves a level
+  void cull(const OcclusionCuller *culler);
+  void draw();
+
+  const RenderPass &pass() const { return *clipmap_pass_; }
+  size_t getNumTriangles() const { return faces_.size(); }
+  size_t visibleChunks() const { return draw_counts_.size(); }
+  // Box around the chunks cull() kept, empty (lo > hi) if it kept none
+  void bounds(glm::vec3 &lo, glm::vec3 &hi) const {
+    lo = drawn_lo_;
+    hi = drawn_hi_;
+  }
+  // Below every level as drawn, for an OcclusionCuller
+  const OccluderMesh &occluders() const { return occluders_; }
+
+private:
+  static constexpr int kChunkQuads = 8;
+
+  // A run of the index buffer and the box its triangles stay in
+  struct Chunk {
+    int first; /* first index */
+    int count; /* indices */
+    glm::vec3 lo;
+    glm::vec3 hi;
+  };
+
+  void updateLevel(int level, int center_x, int center_z);
+  void updateFaces();
+  void addLevelOccluders(int level, int hole_x, int hole_z);
+
+  uint32_t seed_;
+  std::unique_ptr<RenderPass> clipmap_pass_;
+  std::vector<glm::ivec2> centers_;
+  std::vector<glm::vec4> positions_; // x, height, z, coarse height
+  std::vector<glm::vec4> normals_;   // normal, level
+  std::vector<glm::vec3> coarse_normals_;
+  std::vector<glm::uvec3> faces_;
+  std::vector<Chunk> chunks_;
+  std::vector<int> draw_counts_; /* glMultiDrawElements arguments */
+  std::vector<const void *> draw_offsets_;
+  glm::vec3 drawn_lo_{0.0f};
+  glm::vec3 drawn_hi_{-1.0f};
+  OccluderMesh occluders_;
+};
@@ -24,4 +24,7 @@ const float kFloorY = -0.75617 - kFloorEps;
 
 const float kScrollSpeed = 64.0f;
 
+// Distance of the sun (and the light) from the boat
+const float SUN_RADIUS = 100.0f;
+
 #endif
@@ -0,0 +1,283 @@
+#include "frame_capture.h"
+
+#include "world/frame_arena.h"
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <jpegio.h>
+
+constexpr int FrameCapture::kRingSize;
+constexpr int FrameCapture::kMaxQueued;
+
+// How long stop() waits for each outstanding read back
+constexpr GLuint64 kFlushTimeout = 1000000000; /* 1 s */
+
+inline unsigned char toByte(float value) {
+  return (unsigned char)std::min(std::max(value + 0.5f, 0.0f), 255.0f);
+}
+
+FrameCapture::FrameCapture(JobSystem &jobs) : jobs_(jobs) {
+  buffers_.reserve(kMaxQueued);
+  free_buffers_.reserve(kMaxQueued);
+}
+
+FrameCapture::~FrameCapture() { stop(); }
+
+bool FrameCapture::start(int width, int height, Format format,
+                         const std::string &output) {
+  stop();
+  width_ = width;
+  height_ = height;
+  format_ = format;
+  output_ = output;
+  frame_ = 0;
+  sequence_ = 0;
+  dropped_ = 0;
+  next_write_ = 0;
+  converted_.fill(nullptr);
+  written_ = 0;
+
+  if (format_ == Format::Y4M) {
+    video_ = std::fopen(output_.c_str(), "wb");
+    if (video_ == nullptr) {
+      std::cerr << "Failed to open capture file: " << output_ << std::endl;
+      return false;
+    }
+    // 4:2:0 with full range (JPEG) chroma, matching the conversion below
+    std::fprintf(video_, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n", width_,
+                 height_);
+  }
+
+  // Pixel sizes may have changed, start from fresh buffers, all of them up
+  // front so capture() does not allocate
+  buffers_.clear();
+  free_buffers_.clear();
+  size_t size = size_t(width_) * height_ * 3;
+  for (int i = 0; i < kMaxQueued; i++) {
+    buffers_.emplace_back(size);
+    free_buffers_.push_back(&buffers_.back());
+  }
+  for (auto &slot : ring_) {
+    glCreateBuffers(1, &slot.pbo);
+    glNamedBufferStorage(slot.pbo, size, nullptr, GL_MAP_READ_BIT);
+    slot.fence = nullptr;
+    slot.frame = -1;
+  }
+  next_slot_ = 0;
+  recording_ = true;
+  std::cout << "Capture started: " << output_ << std::endl;
+  return true;
+}
+
+/**
+ * Wait for the frames still in flight and for their encoders. This is the
+ * only place that blocks, and only when the user ends a recording.
+ */
+void FrameCapture::stop() {
+  if (!recording_) {
+    return;
+  }
+  collect(true);
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() { return queued_ == 0; });
+  }
+  for (auto &slot : ring_) {
+    glDeleteBuffers(1, &slot.pbo);
+    slot.pbo = 0;
+  }
+  if (video_ != nullptr) {
+    std::fclose(video_);
+    video_ = nullptr;
+  }
+  recording_ = false;
+  std::cout << "Capture stopped: " << written_ << " frames written, "
+            << dropped_ << " dropped" << std::endl;
+}
+
+void FrameCapture::capture() {
+  if (!recording_) {
+    return;
+  }
+  collect(false);
+
+  auto &slot = ring_[next_slot_];
+  int frame = frame_++;
+  if (slot.fence != nullptr) {
+    // The oldest read back has not finished yet, skip this frame
+    dropped_++;
+    return;
+  }
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+  glReadPixels(0, 0, width_, height_, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot.frame = frame;
+  next_slot_ = (next_slot_ + 1) % kRingSize;
+}
+
+/**
+ * Map the read backs whose fences have signaled, oldest first, and queue
+ * them for encoding. Stops at the first one still pending unless wait is set.
+ */
+void FrameCapture::collect(bool wait) {
+  for (int i = 0; i < kRingSize; i++) {
+    auto &slot = ring_[(next_slot_ + i) % kRingSize];
+    if (slot.fence == nullptr) {
+      continue;
+    }
+    auto fence = static_cast<GLsync>(slot.fence);
+    GLenum status =
+        glClientWaitSync(fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                         wait ? kFlushTimeout : 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      if (!wait) {
+        break;
+      }
+      dropped_++;
+    } else if (auto *pixels = takeBuffer()) {
+      size_t size = pixels->size();
+      auto *mapped = glMapNamedBufferRange(slot.pbo, 0, size, GL_MAP_READ_BIT);
+      std::memcpy(pixels->data(), mapped, size);
+      glUnmapNamedBuffer(slot.pbo);
+      // The buffer is taken until its encode is done, and so is its entry
+      size_t buffer = pixels - buffers_.data();
+      encodes_[buffer].frame = slot.frame;
+      encodes_[buffer].sequence = sequence_++;
+      Job job;
+      job.function = [](void *data, size_t buffer, size_t) {
+        static_cast<FrameCapture *>(data)->encode(buffer);
+      };
+      job.data = this;
+      job.begin = buffer;
+      jobs_.runInBackground(job);
+    } else {
+      // Encoders are behind
+      dropped_++;
+    }
+    glDeleteSync(fence);
+    slot.fence = nullptr;
+  }
+}
+
+std::vector<unsigned char> *FrameCapture::takeBuffer() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (queued_ >= kMaxQueued) {
+    return nullptr;
+  }
+  queued_++;
+  auto *pixels = free_buffers_.back();
+  free_buffers_.pop_back();
+  return pixels;
+}
+
+void FrameCapture::releaseBuffer(std::vector<unsigned char> *pixels) {
+  // Notified under the lock, stop() may return and the capture be destroyed
+  // as soon as it is released
+  std::lock_guard<std::mutex> lock(mutex_);
+  free_buffers_.push_back(pixels);
+  queued_--;
+  cv_.notify_all();
+}
+
+// Runs on a worker
+void FrameCapture::encode(size_t buffer) {
+  auto *pixels = &buffers_[buffer];
+  int sequence = encodes_[buffer].sequence;
+  if (format_ == Format::JPEG) {
+    char suffix[16];
+    std::snprintf(suffix, sizeof(suffix), "_%06d.jpg",
+                  encodes_[buffer].frame);
+    // SaveJPEG expects the bottom-up rows glReadPixels returns
+    SaveJPEG(output_ + suffix, width_, height_, pixels->data());
+    written_++;
+    releaseBuffer(pixels);
+  } else {
+    convertY4M(*pixels);
+    writeY4M(pixels, sequence);
+  }
+}
+
+/**
+ * Convert one bottom-up RGB frame to top-down YUV 4:2:0 in place. The planes
+ * take half the size of the RGB frame, they are built in scratch and copied
+ * back.
+ */
+void FrameCapture::convertY4M(std::vector<unsigned char> &pixels) {
+  int chroma_width = (width_ + 1) / 2;
+  int chroma_height = (height_ + 1) / 2;
+  // Scratch from the encoder thread's arena
+  FrameArena::Scope scope;
+  auto yuv = ArenaVector<unsigned char>(size_t(width_) * height_ +
+                                        2 * chroma_width * chroma_height);
+  unsigned char *y_plane = yuv.data();
+  unsigned char *u_plane = y_plane + size_t(width_) * height_;
+  unsigned char *v_plane = u_plane + chroma_width * chroma_height;
+  auto rgb = [&](int x, int y) {
+    x = std::min(x, width_ - 1);
+    y = std::min(y, height_ - 1);
+    return &pixels[(size_t(height_ - 1 - y) * width_ + x) * 3];
+  };
+  for (int y = 0; y < height_; y++) {
+    for (int x = 0; x < width_; x++) {
+      const unsigned char *p = rgb(x, y);
+      y_plane[y * width_ + x] =
+          toByte(0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2]);
+    }
+  }
+  for (int y = 0; y < chroma_height; y++) {
+    for (int x = 0; x < chroma_width; x++) {
+      float r = 0.0f, g = 0.0f, b = 0.0f;
+      for (int dy = 0; dy < 2; dy++) {
+        for (int dx = 0; dx < 2; dx++) {
+          const unsigned char *p = rgb(2 * x + dx, 2 * y + dy);
+          r += p[0];
+          g += p[1];
+          b += p[2];
+        }
+      }
+      r /= 4.0f;
+      g /= 4.0f;
+      b /= 4.0f;
+      float u = -0.168736f * r - 0.331264f * g + 0.5f * b + 128.0f;
+      float v = 0.5f * r - 0.418688f * g - 0.081312f * b + 128.0f;
+      u_plane[y * chroma_width + x] = toByte(u);
+      v_plane[y * chroma_width + x] = toByte(v);
+    }
+  }
+
+  std::copy(yuv.begin(), yuv.end(), pixels.begin());
+}
+
+/**
+ * Append converted frames in capture order without waiting for any: the
+ * encoder that finishes the next frame due writes it, then every later one
+ * that is already converted. The others leave theirs in converted_.
+ */
+void FrameCapture::writeY4M(std::vector<unsigned char> *frame, int sequence) {
+  size_t size = size_t(width_) * height_ +
+                2 * size_t((width_ + 1) / 2) * ((height_ + 1) / 2);
+  std::unique_lock<std::mutex> lock(mutex_);
+  // Frames in flight are less than kMaxQueued apart
+  converted_[sequence % kMaxQueued] = frame;
+  if (writing_ || sequence != next_write_) {
+    return;
+  }
+  writing_ = true;
+  while (auto *next = converted_[next_write_ % kMaxQueued]) {
+    converted_[next_write_ % kMaxQueued] = nullptr;
+    lock.unlock();
+    std::fputs("FRAME\n", video_);
+    std::fwrite(next->data(), 1, size, video_);
+    written_++;
+    lock.lock();
+    next_write_++;
+    free_buffers_.push_back(next);
+    queued_--;
+  }
+  writing_ = false;
+  // Under the lock, stop() may return and destroy cv_ once it is released
+  cv_.notify_all();
+}
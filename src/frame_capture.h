@@ -0,0 +1,87 @@
+#pragma once
+
+#include "world/job_system.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * Records the rendered frames without stalling the render loop.
+ *
+ * capture() issues glReadPixels into the next of kRingSize pixel pack
+ * buffers and drops a fence behind it. Later frames poll the fences without
+ * waiting, map the finished buffers, and hand a copy to the job system,
+ * which encodes a JPEG per frame (SaveJPEG) or appends the frame to one raw
+ * Y4M video. A frame is dropped, and counted, when the ring is still busy or
+ * when kMaxQueued frames are already waiting for an encoder. The copies and
+ * their encode jobs come from fixed pools, so capturing does not allocate
+ * once started.
+ */
+class FrameCapture {
+public:
+  enum class Format { JPEG, Y4M };
+
+  explicit FrameCapture(JobSystem &jobs);
+  ~FrameCapture();
+
+  // output is a file name prefix for JPEG and the video file for Y4M
+  bool start(int width, int height, Format format, const std::string &output);
+  void stop();
+  bool isRecording() const { return recording_; }
+
+  // Call once per frame after drawing, with the target framebuffer bound
+  void capture();
+
+private:
+  static constexpr int kRingSize = 3;
+  static constexpr int kMaxQueued = 8;
+
+  struct Slot {
+    unsigned pbo = 0;
+    void *fence = nullptr; /* GLsync */
+    int frame = -1;
+  };
+  // The frame in buffers_[i] goes with encodes_[i]
+  struct Encode {
+    int frame = -1;
+    int sequence = -1;
+  };
+
+  void collect(bool wait);
+  void encode(size_t buffer);
+  void convertY4M(std::vector<unsigned char> &pixels);
+  void writeY4M(std::vector<unsigned char> *frame, int sequence);
+  std::vector<unsigned char> *takeBuffer();
+  void releaseBuffer(std::vector<unsigned char> *pixels);
+
+  JobSystem &jobs_;
+  bool recording_ = false;
+  Format format_ = Format::JPEG;
+  std::string output_;
+  int width_ = 0;
+  int height_ = 0;
+  std::array<Slot, kRingSize> ring_;
+  int next_slot_ = 0;
+  int frame_ = 0;
+  int sequence_ = 0;
+  int dropped_ = 0;
+
+  // Shared with the encoders
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::vector<unsigned char>> buffers_; /* kMaxQueued */
+  std::array<Encode, kMaxQueued> encodes_;
+  std::vector<std::vector<unsigned char> *> free_buffers_;
+  int queued_ = 0;
+  // Y4M frames are appended in sequence order, converted frames wait here
+  // until the ones before them are written, at sequence % kMaxQueued
+  int next_write_ = 0;
+  std::array<std::vector<unsigned char> *, kMaxQueued> converted_{};
+  bool writing_ = false;
+  std::FILE *video_ = nullptr;
+  std::atomic<int> written_{0};
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "world/waves.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Copy of the heightfield instance buffers, see Heightfield
+struct TerrainSnapshot {
+  uint64_t version = UINT64_MAX; /* World::terrainVersion() of the copy */
+  int x = 0;
+  int z = 0;
+  std::vector<glm::vec3> offsets;
+  std::vector<glm::vec4> heightVec;
+  std::vector<glm::vec3> norm0;
+  std::vector<glm::vec3> norm1;
+  std::vector<glm::vec3> norm2;
+  std::vector<glm::vec3> norm3;
+};
+
+/*
+ * Everything the render thread needs to draw one simulated frame. The
+ * simulation thread fills it in and publishes it (see Simulation), after
+ * which it is immutable, so rendering never reads live simulation state.
+ */
+struct FrameSnapshot {
+  int frame = -1;
+  float time = 0.0f;        /* simulation seconds, the "time" uniform */
+  float time_of_day = 0.0f; /* minutes */
+  int raining = 0;
+  unsigned actions = 0; /* GUI::Action bits to run on the render thread */
+  size_t allocations = 0; /* by the simulation thread since the last frame */
+
+  glm::vec3 eye{0.0f};
+  glm::vec3 center{0.0f};
+  glm::vec3 prev_move{0.0f};
+  glm::vec3 boat_normal{0.0f, 1.0f, 0.0f};
+  glm::vec4 light_position{0.0f};
+  glm::mat4 model{1.0f};
+  glm::mat4 view{1.0f};
+  glm::mat4 projection{1.0f};
+  glm::mat4 inv_proj_view{1.0f};
+
+  WaveConstants waves;
+  TerrainSnapshot terrain; /* only copied into a slot when it is stale */
+  std::vector<glm::vec3> rain;
+};
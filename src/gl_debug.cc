@@ -0,0 +1,127 @@
+#include "gl_debug.h"
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <cstdlib>
+#include <debuggl.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace gl_debug {
+
+namespace {
+
+const char *sourceName(GLenum source) {
+  switch (source) {
+  case GL_DEBUG_SOURCE_API:
+    return "api";
+  case GL_DEBUG_SOURCE_WINDOW_SYSTEM:
+    return "window system";
+  case GL_DEBUG_SOURCE_SHADER_COMPILER:
+    return "shader compiler";
+  case GL_DEBUG_SOURCE_THIRD_PARTY:
+    return "third party";
+  case GL_DEBUG_SOURCE_APPLICATION:
+    return "application";
+  default:
+    return "other";
+  }
+}
+
+const char *typeName(GLenum type) {
+  switch (type) {
+  case GL_DEBUG_TYPE_ERROR:
+    return "error";
+  case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+    return "deprecated";
+  case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+    return "undefined behavior";
+  case GL_DEBUG_TYPE_PORTABILITY:
+    return "portability";
+  case GL_DEBUG_TYPE_PERFORMANCE:
+    return "performance";
+  default:
+    return "other";
+  }
+}
+
+const char *severityName(GLenum severity) {
+  switch (severity) {
+  case GL_DEBUG_SEVERITY_HIGH:
+    return "high";
+  case GL_DEBUG_SEVERITY_MEDIUM:
+    return "medium";
+  case GL_DEBUG_SEVERITY_LOW:
+    return "low";
+  default:
+    return "notification";
+  }
+}
+
+/**
+ * May run on a driver thread, so the message is written with one call. Only
+ * runs when the driver has something to say, allocating here is fine.
+ */
+void GLAPIENTRY onMessage(GLenum source, GLenum type, GLuint id,
+                          GLenum severity, GLsizei length,
+                          const GLchar *message, const void *) {
+  std::ostringstream line;
+  line << "GL " << severityName(severity) << " " << typeName(type) << " ("
+       << sourceName(source) << " " << id << "): "
+       << std::string(message, length > 0 ? size_t(length) : 0);
+  if (auto *where = debuggl_location.load(std::memory_order_relaxed)) {
+    line << (level() == Level::Sync ? " at " : " after ") << where->file
+         << ":" << where->line << " in " << where->func;
+  }
+  line << "\n";
+  std::cerr << line.str() << std::flush;
+}
+}
+
+Level level() {
+#if GL_DEBUG_LEVEL >= 2
+  return Level::Sync;
+#elif GL_DEBUG_LEVEL == 1
+  return Level::Callback;
+#else
+  return Level::Off;
+#endif
+}
+
+const char *levelName(Level level) {
+  switch (level) {
+  case Level::Sync:
+    return "sync";
+  case Level::Callback:
+    return "callback";
+  default:
+    return "off";
+  }
+}
+
+void hintContext() {
+  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT,
+                 level() == Level::Off ? GL_FALSE : GL_TRUE);
+}
+
+bool install() {
+  if (level() == Level::Off) {
+    return true;
+  }
+  if (!GLEW_VERSION_4_3 && !GLEW_KHR_debug) {
+    std::cerr << "GL diagnostics: no debug output in this context"
+              << std::endl;
+    return false;
+  }
+  glEnable(GL_DEBUG_OUTPUT);
+  if (level() == Level::Sync) {
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  }
+  glDebugMessageCallback(onMessage, nullptr);
+  // Drivers report every buffer placement as a notification
+  glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE,
+                        GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+  return true;
+}
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+/*
+ * GL diagnostics, picked per build by GL_DEBUG_LEVEL (see debuggl.h and
+ * cmake/gl_debug.cmake):
+ *
+ *   Off       no debug context, CHECK_GL_ERROR compiles to its statement
+ *   Callback  KHR_debug messages are logged as the driver reports them,
+ *             asynchronously, with the last CHECK_GL_ERROR call site
+ *   Sync      messages are synchronous, so the call site is the offending
+ *             call, and CHECK_GL_ERROR also checks glGetError
+ */
+namespace gl_debug {
+
+enum class Level { Off, Callback, Sync };
+
+Level level();
+const char *levelName(Level level);
+
+// Before the window is created: asks for a debug context unless Off
+void hintContext();
+// With the context current: installs the message callback unless Off,
+// false if the context has no debug output
+bool install();
+}
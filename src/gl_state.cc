@@ -0,0 +1,98 @@
+#include "gl_state.h"
+
+#include <GL/glew.h>
+#include <cstdlib>
+#include <debuggl.h>
+#include <iostream>
+
+namespace {
+
+const std::array<GLenum, 5> kCachedCapabilities = {
+    {GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST, GL_MULTISAMPLE, GL_LINE_SMOOTH}};
+}
+
+GLState &GLState::instance() {
+  static GLState state;
+  return state;
+}
+
+bool GLState::change(unsigned &cached, unsigned value) {
+  requested_++;
+  if (cached == value) {
+    return false;
+  }
+  cached = value;
+  issued_++;
+  return true;
+}
+
+void GLState::setEnabled(unsigned capability, bool enabled) {
+  unsigned uncached = kUnknown;
+  unsigned *cached = &uncached;
+  for (size_t i = 0; i < kCachedCapabilities.size(); i++) {
+    if (kCachedCapabilities[i] == capability) {
+      cached = &enabled_[i];
+    }
+  }
+  if (!change(*cached, enabled)) {
+    return;
+  }
+  if (enabled) {
+    CHECK_GL_ERROR(glEnable(capability));
+  } else {
+    CHECK_GL_ERROR(glDisable(capability));
+  }
+}
+
+void GLState::depthMask(bool write) {
+  if (change(depth_mask_, write)) {
+    CHECK_GL_ERROR(glDepthMask(write));
+  }
+}
+
+void GLState::depthFunc(unsigned func) {
+  if (change(depth_func_, func)) {
+    CHECK_GL_ERROR(glDepthFunc(func));
+  }
+}
+
+void GLState::blendFunc(unsigned source, unsigned destination) {
+  // One call sets both
+  requested_++;
+  if (blend_source_ == source && blend_destination_ == destination) {
+    return;
+  }
+  blend_source_ = source;
+  blend_destination_ = destination;
+  issued_++;
+  CHECK_GL_ERROR(glBlendFunc(source, destination));
+}
+
+void GLState::cullFace(unsigned face) {
+  if (change(cull_face_, face)) {
+    CHECK_GL_ERROR(glCullFace(face));
+  }
+}
+
+void GLState::bindVertexArray(unsigned vao) {
+  if (change(vao_, vao)) {
+    CHECK_GL_ERROR(glBindVertexArray(vao));
+  }
+}
+
+void GLState::useProgram(unsigned program) {
+  if (change(program_, program)) {
+    CHECK_GL_ERROR(glUseProgram(program));
+  }
+}
+
+void GLState::invalidate() {
+  enabled_.fill(kUnknown);
+  depth_mask_ = kUnknown;
+  depth_func_ = kUnknown;
+  blend_source_ = kUnknown;
+  blend_destination_ = kUnknown;
+  cull_face_ = kUnknown;
+  vao_ = kUnknown;
+  program_ = kUnknown;
+}
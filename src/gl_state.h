@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+/*
+ * Shadow copy of the GL state that changes between draws (capabilities,
+ * depth and blend functions, the bound VAO and program), so asking for the
+ * state that is already set costs no GL call. Everything that changes this
+ * state has to go through here, or the copy goes stale; code that cannot
+ * calls invalidate() afterwards.
+ *
+ * Also counts the GL calls of a frame: the ones issued, and the ones that
+ * were asked for, which is what the frame cost before the cache skipped the
+ * redundant ones. Calls made around the cache (uniforms, draws) are added
+ * with countCalls().
+ *
+ * Render thread only.
+ */
+class GLState {
+public:
+  static GLState &instance();
+
+  // Cached for GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST, GL_MULTISAMPLE and
+  // GL_LINE_SMOOTH, any other capability is always set
+  void setEnabled(unsigned capability, bool enabled);
+  void depthMask(bool write);
+  void depthFunc(unsigned func);
+  void blendFunc(unsigned source, unsigned destination);
+  void cullFace(unsigned face);
+  void bindVertexArray(unsigned vao);
+  void useProgram(unsigned program);
+  void invalidate();
+
+  void countCalls(size_t calls) {
+    issued_ += calls;
+    requested_ += calls;
+  }
+  void beginFrame() { issued_ = requested_ = 0; }
+  size_t issuedCalls() const { return issued_; }
+  size_t requestedCalls() const { return requested_; }
+
+private:
+  static constexpr unsigned kUnknown = ~0u;
+  static constexpr size_t kCapabilities = 5;
+
+  GLState() { invalidate(); }
+  // Returns true (and counts it) if the call has to be issued
+  bool change(unsigned &cached, unsigned value);
+
+  std::array<unsigned, kCapabilities> enabled_;
+  unsigned depth_mask_;
+  unsigned depth_func_;
+  unsigned blend_source_;
+  unsigned blend_destination_;
+  unsigned cull_face_;
+  unsigned vao_;
+  unsigned program_;
+  size_t issued_ = 0;
+  size_t requested_ = 0;
+};
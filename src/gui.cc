@@ -1,13 +1,12 @@
 #include "gui.h"
 #include "config.h"
+#include "world/world.h"
 #include <chrono>
-#include <debuggl.h>
 #include <glm/gtc/matrix_access.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/transform.hpp>
 #include <iostream>
-#include <jpegio.h>
 #include <vector>
 
 using std::vector;
@@ -15,14 +14,11 @@ using std::vector;
 // start ffmpeg telling it to expect raw rgba 720p-60hz frames
 // -i - tells it to read frames from stdin
 
-GUI::GUI(GLFWwindow *window) : window_(window) {
-  glfwSetWindowUserPointer(window_, this);
-  glfwSetKeyCallback(window_, KeyCallback);
-  glfwSetCursorPosCallback(window_, MousePosCallback);
-  glfwSetMouseButtonCallback(window_, MouseButtonCallback);
-  glfwSetScrollCallback(window_, MouseScrollCallback);
+GUI::GUI(int width, int height) : window_(nullptr) { init(width, height); }
 
-  glfwGetWindowSize(window_, &window_width_, &window_height_);
+void GUI::init(int width, int height) {
+  window_width_ = width;
+  window_height_ = height;
   float aspect_ = static_cast<float>(window_width_) / window_height_;
   projection_matrix_ =
       glm::perspective((float)(kFov * (M_PI / 180.0f)), aspect_, kNear, kFar);
@@ -32,27 +28,20 @@ GUI::GUI(GLFWwindow *window) : window_(window) {
   key_pressed_['D'] = false;
   key_pressed_['u'] = false;
   key_pressed_['d'] = false;
+  input_.reserve(256);
 }
 
 GUI::~GUI() {}
 
 void GUI::keyCallback(int key, int scancode, int action, int mods) {
   if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
-    glfwSetWindowShouldClose(window_, GL_TRUE);
+    actions_ |= kQuit;
     return;
   }
 
   // Save screenshot
   if (key == GLFW_KEY_J && action == GLFW_RELEASE) {
-    // Read pixels from the framebuffer
-    auto num_bytes = window_width_ * window_height_ * 3;
-    auto pixels = vector<unsigned char>(num_bytes);
-    glReadPixels(0, 0, window_width_, window_height_, GL_RGB, GL_UNSIGNED_BYTE,
-                 pixels.data());
-
-    // Write image out to file
-    SaveJPEG("screenshot.jpg", window_width_, window_height_, pixels.data());
-    std::cout << "Screenshot written out to \"screenshot.jpg\"" << std::endl;
+    actions_ |= kScreenshot;
     return;
   }
 
@@ -91,8 +80,22 @@ void GUI::keyCallback(int key, int scancode, int action, int mods) {
   }
 
   if (key == GLFW_KEY_1 && action == GLFW_RELEASE) {
-    raining_ = !raining_;
-    terrainRender->toggle_storm(raining_);
+    setRaining(!raining_);
+  }
+
+  // Toggle between clipmap LOD terrain and per-cell quads
+  if (key == GLFW_KEY_L && action == GLFW_RELEASE) {
+    actions_ |= kToggleClipmap;
+  }
+
+  // Record the session, V as a Y4M video and Shift+V as JPEG frames
+  if (key == GLFW_KEY_V && action == GLFW_RELEASE) {
+    actions_ |= (mods & GLFW_MOD_SHIFT) ? kToggleFrames : kToggleVideo;
+  }
+
+  // Write the recent profiler zones out as a Chrome trace
+  if (key == GLFW_KEY_P && action == GLFW_RELEASE) {
+    actions_ |= kDumpTrace;
   }
 
   if (mods == 0 && captureWASDUPDOWN(key, action))
@@ -138,6 +141,34 @@ void GUI::mouseScrollCallback(double dx, double dy) {
   // Pass
 }
 
+void GUI::handleInput(const InputEvent &event) {
+  switch (event.type) {
+  case InputEvent::Type::Key:
+    keyCallback(event.key, event.scancode, event.action, event.mods);
+    break;
+  case InputEvent::Type::CursorPos:
+    mousePosCallback(event.x, event.y);
+    break;
+  case InputEvent::Type::MouseButton:
+    mouseButtonCallback(event.key, event.action, event.mods);
+    break;
+  case InputEvent::Type::Scroll:
+    mouseScrollCallback(event.x, event.y);
+    break;
+  }
+}
+
+void GUI::onInput(const InputEvent &event) {
+  std::lock_guard<std::mutex> lock(input_mutex_);
+  input_.push_back(event);
+}
+
+void GUI::takeInput(std::vector<InputEvent> &events) {
+  events.clear();
+  std::lock_guard<std::mutex> lock(input_mutex_);
+  input_.swap(events);
+}
+
 void GUI::updateMatrices() {
   // Compute our view, and projection matrices.
   if (fps_mode_) {
@@ -168,6 +199,25 @@ MatrixPointers GUI::getMatrixPointers() const {
   return ret;
 }
 
+/**
+ * Place the boat and point the camera, used to replay a recorded path.
+ */
+void GUI::setPose(const glm::vec3 &center, const glm::vec3 &look) {
+  center_ = center;
+  look_ = glm::normalize(look);
+  tangent_ = glm::normalize(glm::cross(look_, glm::vec3{0.0f, 1.0f, 0.0f}));
+  up_ = glm::cross(tangent_, look_);
+  orientation_ = glm::mat3(tangent_, up_, look_);
+  y_velocity_ = 0.0f;
+}
+
+void GUI::setRaining(bool raining) {
+  if (bool(raining_) != raining) {
+    raining_ = raining;
+    world->setStormy(raining_);
+  }
+}
+
 void GUI::updatePosition() {
   if (fps_mode_) {
     if (gravity_enabled_) {
@@ -176,7 +226,7 @@ void GUI::updatePosition() {
       auto new_pos = eye_ + glm::vec3{0, y_velocity_, 0};
 
       // Check for ground collision
-      if (!terrainRender->isPositionLegal(new_pos)) {
+      if (!world->isPositionLegal(new_pos)) {
         y_velocity_ = 0.0f;
       } else {
         eye_ = new_pos;
@@ -184,35 +234,35 @@ void GUI::updatePosition() {
     }
     if (key_pressed_['W']) {
       glm::vec3 move_vec = getMoveVec(zoom_speed_ * look_);
-      if (terrainRender->isPositionLegal(eye_ + move_vec)) {
+      if (world->isPositionLegal(eye_ + move_vec)) {
         eye_ += move_vec;
       }
     }
     if (key_pressed_['S']) {
       glm::vec3 move_vec = getMoveVec(zoom_speed_ * look_);
-      if (terrainRender->isPositionLegal(eye_ - move_vec)) {
+      if (world->isPositionLegal(eye_ - move_vec)) {
         eye_ -= move_vec;
       }
     }
     if (key_pressed_['A']) {
       glm::vec3 move_vec = getMoveVec(pan_speed_ * tangent_);
-      if (terrainRender->isPositionLegal(eye_ - move_vec)) {
+      if (world->isPositionLegal(eye_ - move_vec)) {
         eye_ -= move_vec;
       }
     }
     if (key_pressed_['D']) {
       glm::vec3 move_vec = getMoveVec(pan_speed_ * tangent_);
-      if (terrainRender->isPositionLegal(eye_ + move_vec)) {
+      if (world->isPositionLegal(eye_ + move_vec)) {
         eye_ += move_vec;
       }
     }
     if (key_pressed_['u'] && !gravity_enabled_) {
-      if (terrainRender->isPositionLegal(eye_ + pan_speed_ * up_)) {
+      if (world->isPositionLegal(eye_ + pan_speed_ * up_)) {
         eye_ += pan_speed_ * up_;
       }
     }
     if (key_pressed_['d'] && !gravity_enabled_) {
-      if (terrainRender->isPositionLegal(eye_ - pan_speed_ * up_)) {
+      if (world->isPositionLegal(eye_ - pan_speed_ * up_)) {
         eye_ -= pan_speed_ * up_;
       }
     }
@@ -223,7 +273,7 @@ void GUI::updatePosition() {
       y_velocity_ -= 0.008f;
 
       // Check for ground collision
-      if (terrainRender->isPositionLegal(center_ +
+      if (world->isPositionLegal(center_ +
                                          glm::vec3{0, y_velocity_, 0})) {
         move_vec = glm::vec3{0, y_velocity_, 0};
       } else {
@@ -244,10 +294,15 @@ void GUI::updatePosition() {
       move_vec += getMoveVec(pan_speed_ * tangent_);
     }
     auto new_center = center_ + move_vec;
-    if (terrainRender->isPositionLegal(new_center)) {
+    // A floating boat keeps its clearance from the shore, but can always
+    // head back out if it is closer than that
+    float shore_distance = world->shoreDistance(new_center);
+    bool clear = !gravity_enabled_ || shore_distance >= boat_clearance_ ||
+                 shore_distance >= world->shoreDistance(center_);
+    if (clear && world->isPositionLegal(new_center)) {
       center_ += move_vec;
     }
-    float waveHeight = terrainRender->getWaveHeight(new_center);
+    float waveHeight = world->getWaveHeight(new_center);
     if (center_.y < waveHeight) {
       center_.y = waveHeight;
       y_velocity_ = 0.0f;
@@ -334,26 +389,3 @@ bool GUI::captureWASDUPDOWN(int key, int action) {
 
   return false;
 }
-
-// Delegrate to the actual GUI object.
-void GUI::KeyCallback(GLFWwindow *window, int key, int scancode, int action,
-                      int mods) {
-  GUI *gui = (GUI *)glfwGetWindowUserPointer(window);
-  gui->keyCallback(key, scancode, action, mods);
-}
-
-void GUI::MousePosCallback(GLFWwindow *window, double mouse_x, double mouse_y) {
-  GUI *gui = (GUI *)glfwGetWindowUserPointer(window);
-  gui->mousePosCallback(mouse_x, mouse_y);
-}
-
-void GUI::MouseButtonCallback(GLFWwindow *window, int button, int action,
-                              int mods) {
-  GUI *gui = (GUI *)glfwGetWindowUserPointer(window);
-  gui->mouseButtonCallback(button, action, mods);
-}
-
-void GUI::MouseScrollCallback(GLFWwindow *window, double dx, double dy) {
-  GUI *gui = (GUI *)glfwGetWindowUserPointer(window);
-  gui->mouseScrollCallback(dx, dy);
-}
@@ -1,16 +1,23 @@
 #ifndef SKINNING_GUI_H
 #define SKINNING_GUI_H
 
-#include "terrain_render.h"
+#include "frame_capture.h"
+#include "input_log.h"
+// Only the window handle and the key codes, gui.cc is GL-free
+#define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 #include <chrono>
+#include <cmath>
 #include <cstdio>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
 struct Mesh;
+class TerrainRender;
+class World;
 
 /*
  * Hint: call glUniformMatrix4fv on thest pointers
@@ -22,12 +29,43 @@ struct MatrixPointers {
 class GUI {
 public:
   GUI(GLFWwindow *);
+  // No window (--context egl): input then only comes from an InputLog or a
+  // camera path, and the viewport is width x height
+  GUI(int width, int height);
   ~GUI();
 
   void keyCallback(int key, int scancode, int action, int mods);
   void mousePosCallback(double mouse_x, double mouse_y);
   void mouseButtonCallback(int button, int action, int mods);
   void mouseScrollCallback(double dx, double dy);
+  // Dispatch to the callbacks above, for live and replayed input alike. Runs
+  // on the simulation thread, see Simulation
+  void handleInput(const InputEvent &event);
+  // Queues input for the simulation thread. The GLFW callbacks below call it,
+  // so can a driver without a window
+  void onInput(const InputEvent &event);
+  // Swaps out the input polled since the last call (render thread -> sim)
+  void takeInput(std::vector<InputEvent> &events);
+
+  // Input handling that needs GL or the window, deferred to the render thread
+  enum Action : unsigned {
+    kQuit = 1 << 0,
+    kScreenshot = 1 << 1,
+    kToggleClipmap = 1 << 2,
+    kToggleVideo = 1 << 3,  /* V, Y4M recording */
+    kToggleFrames = 1 << 4, /* Shift+V, JPEG frames */
+    kDumpTrace = 1 << 5,
+  };
+  // Simulation thread: the actions requested since the last call
+  unsigned takeActions() {
+    unsigned actions = actions_;
+    actions_ = 0;
+    return actions;
+  }
+  // Render thread
+  void runActions(unsigned actions);
+  // Render thread: the window was closed, or Escape asked to quit
+  bool shouldClose() const;
   void updateMatrices();
   MatrixPointers getMatrixPointers() const;
 
@@ -44,8 +82,12 @@ public:
   const float *getLightPositionPtr() const { return &light_position_[0]; }
 
   void updatePosition();
+  void setPose(const glm::vec3 &center, const glm::vec3 &look);
+  void setRaining(bool raining);
   glm::vec3 getMoveVec(const glm::vec3 &input);
+  World *world = nullptr;
   TerrainRender *terrainRender = nullptr;
+  FrameCapture *frameCapture = nullptr;
   const float kMaxTimeOfDay = 1440.0f;
   void incrementTimeOfDay(float f) {
     time_of_day_ = fmodf(time_of_day_ + f, kMaxTimeOfDay);
@@ -56,7 +98,15 @@ public:
   glm::vec3 &getPreviousMoveVec() { return previous_move_; }
 
 private:
-  GLFWwindow *window_;
+  void init(int width, int height);
+  void toggleCapture(FrameCapture::Format format, const char *output);
+
+  std::mutex input_mutex_;
+  std::vector<InputEvent> input_;
+  unsigned actions_ = 0;
+  bool quit_ = false; /* without a window to flag */
+
+  GLFWwindow *window_; /* null without a window */
 
   // Dimension state
   int window_width_, window_height_;
@@ -73,6 +123,7 @@ private:
   float pan_speed_ = 0.1f;
   float rotation_speed_ = 0.02f;
   float zoom_speed_ = 0.1f;
+  float boat_clearance_ = 0.5f; /* from the shore */
   float aspect_;
 
   glm::vec3 eye_ = glm::vec3(0.0f, 10.0f, camera_distance_);
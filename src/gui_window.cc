@@ -0,0 +1,118 @@
+#include <GL/glew.h>
+
+#include "gui.h"
+#include "profiler.h"
+#include "terrain_render.h"
+#include <debuggl.h>
+#include <iostream>
+#include <jpegio.h>
+#include <vector>
+
+/*
+ * The parts of GUI bound to the GLFW window and the GL context, render
+ * thread only. gui.cc is GL-free and builds into the simulation library.
+ */
+
+GUI::GUI(GLFWwindow *window) : window_(window) {
+  glfwSetWindowUserPointer(window_, this);
+  glfwSetKeyCallback(window_, KeyCallback);
+  glfwSetCursorPosCallback(window_, MousePosCallback);
+  glfwSetMouseButtonCallback(window_, MouseButtonCallback);
+  glfwSetScrollCallback(window_, MouseScrollCallback);
+
+  int width, height;
+  glfwGetWindowSize(window_, &width, &height);
+  init(width, height);
+}
+
+void GUI::runActions(unsigned actions) {
+  if (actions & kQuit) {
+    if (window_) {
+      glfwSetWindowShouldClose(window_, GL_TRUE);
+    }
+    quit_ = true;
+  }
+  if (actions & kScreenshot) {
+    // Read pixels from the framebuffer
+    auto num_bytes = window_width_ * window_height_ * 3;
+    auto pixels = std::vector<unsigned char>(num_bytes);
+    glReadPixels(0, 0, window_width_, window_height_, GL_RGB, GL_UNSIGNED_BYTE,
+                 pixels.data());
+
+    // Write image out to file
+    SaveJPEG("screenshot.jpg", window_width_, window_height_, pixels.data());
+    std::cout << "Screenshot written out to \"screenshot.jpg\"" << std::endl;
+  }
+  if ((actions & kToggleClipmap) && terrainRender) {
+    terrainRender->toggleClipmap();
+  }
+  if ((actions & kToggleVideo) && frameCapture) {
+    toggleCapture(FrameCapture::Format::Y4M, "capture.y4m");
+  }
+  if ((actions & kToggleFrames) && frameCapture) {
+    toggleCapture(FrameCapture::Format::JPEG, "capture");
+  }
+  if (actions & kDumpTrace) {
+    PROFILE_DUMP_TRACE("trace.json");
+  }
+}
+
+bool GUI::shouldClose() const {
+  return quit_ || (window_ && glfwWindowShouldClose(window_));
+}
+
+// Starts recording, or stops the recording in progress
+void GUI::toggleCapture(FrameCapture::Format format, const char *output) {
+  if (frameCapture->isRecording()) {
+    frameCapture->stop();
+    return;
+  }
+  int width = window_width_;
+  int height = window_height_;
+  if (window_) {
+    glfwGetFramebufferSize(window_, &width, &height);
+  }
+  frameCapture->start(width, height, format, output);
+}
+
+// Delegrate to the actual GUI object.
+void GUI::KeyCallback(GLFWwindow *window, int key, int scancode, int action,
+                      int mods) {
+  GUI *gui = (GUI *)glfwGetWindowUserPointer(window);
+  InputEvent event;
+  event.type = InputEvent::Type::Key;
+  event.key = key;
+  event.scancode = scancode;
+  event.action = action;
+  event.mods = mods;
+  gui->onInput(event);
+}
+
+void GUI::MousePosCallback(GLFWwindow *window, double mouse_x, double mouse_y) {
+  GUI *gui = (GUI *)glfwGetWindowUserPointer(window);
+  InputEvent event;
+  event.type = InputEvent::Type::CursorPos;
+  event.x = mouse_x;
+  event.y = mouse_y;
+  gui->onInput(event);
+}
+
+void GUI::MouseButtonCallback(GLFWwindow *window, int button, int action,
+                              int mods) {
+  GUI *gui = (GUI *)glfwGetWindowUserPointer(window);
+  InputEvent event;
+  event.type = InputEvent::Type::MouseButton;
+  event.key = button;
+  event.action = action;
+  event.mods = mods;
+  gui->onInput(event);
+}
+
+void GUI::MouseScrollCallback(GLFWwindow *window, double dx, double dy) {
+  GUI *gui = (GUI *)glfwGetWindowUserPointer(window);
+  InputEvent event;
+  event.type = InputEvent::Type::Scroll;
+  event.x = dx;
+  event.y = dy;
+  gui->onInput(event);
+}
@@ -0,0 +1,129 @@
+#include "headless_context.h"
+
+#include <iostream>
+
+#ifdef OCEAN_EGL
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstring>
+
+namespace {
+
+// Whole names only, one extension name can be the prefix of another
+bool hasExtension(const char *extensions, const char *name) {
+  size_t length = std::strlen(name);
+  for (const char *found = extensions;
+       found != nullptr && (found = std::strstr(found, name)) != nullptr;
+       found += length) {
+    if ((found == extensions || found[-1] == ' ') &&
+        (found[length] == ' ' || found[length] == '\0')) {
+      return true;
+    }
+  }
+  return false;
+}
+
+EGLDisplay surfacelessDisplay() {
+  const char *client = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  if (!hasExtension(client, "EGL_MESA_platform_surfaceless")) {
+    return EGL_NO_DISPLAY;
+  }
+  auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+      eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  if (getPlatformDisplay == nullptr) {
+    return EGL_NO_DISPLAY;
+  }
+  return getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                            EGL_DEFAULT_DISPLAY, nullptr);
+}
+}
+
+HeadlessContext::~HeadlessContext() {
+  if (display_ == nullptr) {
+    return;
+  }
+  eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (context_ != nullptr) {
+    eglDestroyContext(display_, context_);
+  }
+  if (surface_ != nullptr) {
+    eglDestroySurface(display_, surface_);
+  }
+  eglTerminate(display_);
+}
+
+bool HeadlessContext::create(bool debug) {
+  EGLDisplay display = surfacelessDisplay();
+  EGLint major = 0;
+  EGLint minor = 0;
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+    std::cerr << "EGL: no surfaceless platform (EGL_MESA_platform_surfaceless)"
+              << std::endl;
+    return false;
+  }
+  display_ = display;
+  std::cout << "EGL " << major << "." << minor << ", "
+            << eglQueryString(display, EGL_VENDOR) << std::endl;
+
+  const EGLint config_attributes[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                                      EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                      EGL_NONE};
+  EGLConfig config = nullptr;
+  EGLint configs = 0;
+  if (!eglBindAPI(EGL_OPENGL_API) ||
+      !eglChooseConfig(display, config_attributes, &config, 1, &configs) ||
+      configs == 0) {
+    std::cerr << "EGL: no desktop OpenGL config" << std::endl;
+    return false;
+  }
+  // Same context as the GLFW path asks for
+  EGLint flags = EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE_BIT_KHR;
+  if (debug) {
+    flags |= EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR;
+  }
+  const EGLint context_attributes[] = {
+      EGL_CONTEXT_MAJOR_VERSION_KHR,
+      4,
+      EGL_CONTEXT_MINOR_VERSION_KHR,
+      5,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR,
+      EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+      EGL_CONTEXT_FLAGS_KHR,
+      flags,
+      EGL_NONE};
+  context_ =
+      eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+  if (context_ == EGL_NO_CONTEXT) {
+    std::cerr << "EGL: failed to create an OpenGL 4.5 core context"
+              << std::endl;
+    return false;
+  }
+  if (!hasExtension(eglQueryString(display, EGL_EXTENSIONS),
+                    "EGL_KHR_surfaceless_context")) {
+    const EGLint pbuffer_attributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1,
+                                         EGL_NONE};
+    surface_ = eglCreatePbufferSurface(display, config, pbuffer_attributes);
+    if (surface_ == EGL_NO_SURFACE) {
+      std::cerr << "EGL: failed to create a pbuffer" << std::endl;
+      return false;
+    }
+  }
+  if (!eglMakeCurrent(display, surface_, surface_, context_)) {
+    std::cerr << "EGL: failed to make the context current" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+#else
+
+HeadlessContext::~HeadlessContext() {}
+
+bool HeadlessContext::create(bool) {
+  std::cerr << "Built without EGL, --context egl is not available"
+            << std::endl;
+  return false;
+}
+
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+
+/*
+ * OpenGL 4.5 core context for --context egl that needs neither a window nor
+ * a display server: EGL on the surfaceless platform
+ * (EGL_MESA_platform_surfaceless, e.g. llvmpipe or a GPU render node), made
+ * current without a surface through EGL_KHR_surfaceless_context, or on a 1x1
+ * pbuffer where that is missing. The benchmark draws to its offscreen
+ * target, so the missing default framebuffer is never used.
+ *
+ * Only built when CMake finds EGL (OCEAN_EGL, see cmake/egl.cmake), create()
+ * fails otherwise.
+ */
+class HeadlessContext {
+public:
+  HeadlessContext() = default;
+  ~HeadlessContext();
+  HeadlessContext(const HeadlessContext &) = delete;
+  HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+  // Creates the context and makes it current on the calling thread, with
+  // debug output when debug is set
+  bool create(bool debug);
+
+private:
+  void *display_ = nullptr; /* EGLDisplay */
+  void *surface_ = nullptr; /* EGLSurface, only for the pbuffer fallback */
+  void *context_ = nullptr; /* EGLContext */
+};
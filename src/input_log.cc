@@ -0,0 +1,137 @@
+#include "input_log.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+bool InputLog::startRecording(const std::string &file, uint32_t seed,
+                              const std::string &quality) {
+  // Fail now rather than after the session
+  if (!std::ofstream{file}.is_open()) {
+    std::cerr << "Failed to open input log: " << file << std::endl;
+    return false;
+  }
+  mode_ = Mode::Record;
+  file_ = file;
+  seed_ = seed;
+  quality_ = quality;
+  events_.clear();
+  events_.reserve(1 << 16);
+  return true;
+}
+
+bool InputLog::load(const std::string &file) {
+  std::ifstream in{file};
+  if (!in.is_open()) {
+    std::cerr << "Failed to open input log: " << file << std::endl;
+    return false;
+  }
+  events_.clear();
+  frames_ = 0;
+  quality_.clear();
+  bool has_seed = false;
+
+  std::string line;
+  int line_number = 0;
+  while (std::getline(in, line)) {
+    line_number++;
+    std::istringstream stream{line};
+    std::string first;
+    if (!(stream >> first) || first[0] == '#') {
+      continue;
+    }
+    bool ok;
+    if (first == "seed") {
+      ok = has_seed = bool(stream >> seed_);
+    } else if (first == "quality") {
+      ok = bool(stream >> quality_) &&
+           (quality_ == "low" || quality_ == "medium" || quality_ == "high");
+    } else if (first == "frames") {
+      ok = bool(stream >> frames_);
+    } else {
+      InputEvent event;
+      std::string type;
+      ok = bool(std::istringstream{first} >> event.frame) &&
+           bool(stream >> type) &&
+           (events_.empty() || event.frame >= events_.back().frame);
+      if (ok && type == "key") {
+        event.type = InputEvent::Type::Key;
+        ok = bool(stream >> event.key >> event.scancode >> event.action >>
+                  event.mods);
+      } else if (ok && type == "cursor") {
+        event.type = InputEvent::Type::CursorPos;
+        ok = bool(stream >> event.x >> event.y);
+      } else if (ok && type == "button") {
+        event.type = InputEvent::Type::MouseButton;
+        ok = bool(stream >> event.key >> event.action >> event.mods);
+      } else if (ok && type == "scroll") {
+        event.type = InputEvent::Type::Scroll;
+        ok = bool(stream >> event.x >> event.y);
+      } else {
+        ok = false;
+      }
+      if (ok) {
+        events_.push_back(event);
+      }
+    }
+    if (!ok) {
+      std::cerr << file << ":" << line_number << ": bad input log entry"
+                << std::endl;
+      return false;
+    }
+  }
+  if (!has_seed) {
+    std::cerr << file << ": no seed" << std::endl;
+    return false;
+  }
+  if (!events_.empty() && frames_ <= events_.back().frame) {
+    // Cut short, e.g. the recording crashed, replay up to the last event
+    frames_ = events_.back().frame + 1;
+  }
+  mode_ = Mode::Replay;
+  file_ = file;
+  next_ = 0;
+  return true;
+}
+
+bool InputLog::save(int frames) {
+  std::ofstream out{file_};
+  if (!out.is_open()) {
+    std::cerr << "Failed to write input log: " << file_ << std::endl;
+    return false;
+  }
+  out << std::setprecision(std::numeric_limits<double>::max_digits10);
+  out << "seed " << seed_ << "\n";
+  out << "quality " << quality_ << "\n";
+  for (const auto &event : events_) {
+    out << event.frame << " ";
+    switch (event.type) {
+    case InputEvent::Type::Key:
+      out << "key " << event.key << " " << event.scancode << " "
+          << event.action << " " << event.mods;
+      break;
+    case InputEvent::Type::CursorPos:
+      out << "cursor " << event.x << " " << event.y;
+      break;
+    case InputEvent::Type::MouseButton:
+      out << "button " << event.key << " " << event.action << " "
+          << event.mods;
+      break;
+    case InputEvent::Type::Scroll:
+      out << "scroll " << event.x << " " << event.y;
+      break;
+    }
+    out << "\n";
+  }
+  out << "frames " << frames << "\n";
+  std::cout << "Input log written out to \"" << file_ << "\" (" << frames
+            << " frames, " << events_.size() << " events)" << std::endl;
+  return bool(out);
+}
+
+void InputLog::record(InputEvent event) {
+  event.frame = frame_;
+  events_.push_back(event);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * One GLFW input callback, stamped with the simulation frame whose
+ * glfwPollEvents delivered it. Fields not used by the type stay 0.
+ */
+struct InputEvent {
+  enum class Type { Key, CursorPos, MouseButton, Scroll };
+
+  int frame = 0;
+  Type type = Type::Key;
+  int key = 0; /* key or mouse button */
+  int scancode = 0;
+  int action = 0;
+  int mods = 0;
+  double x = 0.0; /* cursor position or scroll offset */
+  double y = 0.0;
+};
+
+/*
+ * Input recording and replay (--record / --replay). While recording, every
+ * event is appended in memory and the log is written out on exit. While
+ * replaying, live input is ignored and the logged events are dispatched at
+ * the same point of the same frame. Both modes step the simulation by a
+ * fixed clock, so a replay reproduces the session exactly, uncapped and
+ * headless.
+ *
+ * The log is text, one entry per line:
+ *
+ *   seed <world seed>
+ *   quality <ocean preset, see --quality>
+ *   <frame> key <key> <scancode> <action> <mods>
+ *   <frame> cursor <x> <y>
+ *   <frame> button <button> <action> <mods>
+ *   <frame> scroll <dx> <dy>
+ *   frames <frames recorded>
+ *
+ * Doubles are written with full precision so they round trip exactly. Logs
+ * from before the quality line was added replay with --quality.
+ */
+class InputLog {
+public:
+  enum class Mode { Off, Record, Replay };
+
+  bool startRecording(const std::string &file, uint32_t seed,
+                      const std::string &quality);
+  bool load(const std::string &file);
+  // Record mode: writes the log, frames is the number of frames played
+  bool save(int frames);
+
+  Mode mode() const { return mode_; }
+  uint32_t seed() const { return seed_; }
+  // Empty when the log does not say
+  const std::string &quality() const { return quality_; }
+  int frames() const { return frames_; }
+
+  // Record mode: append event, stamped with the current frame
+  void setFrame(int frame) { frame_ = frame; }
+  void record(InputEvent event);
+
+  // Replay mode: calls dispatch for every event of frame, in order
+  template <typename Dispatch> void replay(int frame, Dispatch dispatch) {
+    if (mode_ != Mode::Replay) {
+      return;
+    }
+    while (next_ < events_.size() && events_[next_].frame <= frame) {
+      dispatch(events_[next_++]);
+    }
+  }
+
+private:
+  Mode mode_ = Mode::Off;
+  std::string file_;
+  uint32_t seed_ = 0;
+  std::string quality_;
+  int frame_ = 0;
+  int frames_ = 0;
+  size_t next_ = 0;
+  std::vector<InputEvent> events_;
+};
@@ -1,13 +1,27 @@
 #include <GL/glew.h>
 #include <dirent.h>
 
+#include "alloc_counter.h"
+#include "atmosphere.h"
+#include "bench.h"
 #include "config.h"
+#include "frame_capture.h"
+#include "gl_debug.h"
+#include "gl_state.h"
 #include "gui.h"
+#include "headless_context.h"
+#include "input_log.h"
 #include "procedure_geometry.h"
+#include "profiler.h"
 #include "rain_render.h"
 #include "render_pass.h"
+#include "render_queue.h"
+#include "simulation.h"
 #include "terrain_render.h"
+#include "texture_to_render.h"
 #include "util.hpp"
+#include "world/frame_arena.h"
+#include "world/job_system.h"
 
 #include <algorithm>
 #include <chrono>
@@ -29,21 +43,6 @@ int window_height = 720;
 int height_map_rows = 150;
 int height_map_cols = 150;
 const std::string window_title = "Sea of Thieves";
-const float SUN_RADIUS = 100.0f;
-
-const std::vector<glm::vec4> SUN_VERTICES = {
-    {0.000f, 0.000f, 1.000f, 0.0f},   {0.894f, 0.000f, 0.447f, 0.0f},
-    {0.276f, 0.851f, 0.447f, 0.0f},   {-0.724f, 0.526f, 0.447f, 0.0f},
-    {-0.724f, -0.526f, 0.447f, 0.0f}, {0.276f, -0.851f, 0.447f, 0.0f},
-    {0.724f, 0.526f, -0.447f, 0.0f},  {-0.276f, 0.851f, -0.447f, 0.0f},
-    {-0.894f, 0.000f, -0.447f, 0.0f}, {-0.276f, -0.851f, -0.447f, 0.0f},
-    {0.724f, -0.526f, -0.447f, 0.0f}, {0.000f, 0.000f, -1.000f, 0.0f}};
-
-const std::vector<glm::uvec3> SUN_FACES = {
-    {2, 1, 0},  {3, 2, 0},  {4, 3, 0},  {5, 4, 0},   {1, 5, 0},
-    {11, 6, 7}, {11, 7, 8}, {11, 8, 9}, {11, 9, 10}, {11, 10, 6},
-    {1, 2, 6},  {2, 3, 7},  {3, 4, 8},  {4, 5, 9},   {5, 1, 10},
-    {2, 7, 6},  {3, 8, 7},  {4, 9, 8},  {5, 10, 9},  {1, 6, 10}};
 
 const char *vertex_shader =
 #include "shaders/default.vert"
@@ -81,27 +80,15 @@ const char *sun_vertex_shader =
 #include "shaders/sun.vert"
     ;
 
-const char *sun_geometry_shader =
-#include "shaders/sun.geom"
-    ;
-
 const char *sun_fragment_shader =
 #include "shaders/sun.frag"
     ;
 
-const char *sun_tcs_shader =
-#include "shaders/sun.tcs"
-    ;
-
-const char *sun_tes_shader =
-#include "shaders/sun.tes"
-    ;
-
 void ErrorCallback(int error, const char *description) {
   std::cerr << "GLFW Error: " << description << "\n";
 }
 
-GLFWwindow *init_glefw() {
+GLFWwindow *init_glfw(const BenchOptions &bench) {
   if (!glfwInit())
     exit(EXIT_FAILURE);
   glfwSetErrorCallback(ErrorCallback);
@@ -111,30 +98,96 @@ GLFWwindow *init_glefw() {
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
   glfwWindowHint(GLFW_RESIZABLE, GL_FALSE); // Disable resizing, for simplicity
   glfwWindowHint(GLFW_SAMPLES, 4);
+  gl_debug::hintContext();
+  if (bench.enabled) {
+    // Frames go to an offscreen target, the window only owns the context
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    glfwWindowHint(GLFW_SAMPLES, 0);
+#ifdef GLFW_OSMESA_CONTEXT_API
+    if (bench.context == BenchContext::OSMesa) {
+      glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+    }
+#endif
+  }
   auto ret = glfwCreateWindow(window_width, window_height, window_title.data(),
                               nullptr, nullptr);
   CHECK_SUCCESS(ret != nullptr);
-  glfwSetInputMode(ret, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+  if (!bench.enabled) {
+    glfwSetInputMode(ret, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+  }
   glfwMakeContextCurrent(ret);
+  return ret;
+}
+
+/**
+ * With headless set (--context egl) the GL context comes from EGL and GLFW is
+ * never initialized, so no display server is needed and the returned window
+ * is null. Input then only comes from the camera path or the replayed log.
+ */
+GLFWwindow *init_glefw(const BenchOptions &bench, HeadlessContext *headless) {
+  GLFWwindow *ret = nullptr;
   glewExperimental = GL_TRUE;
-  CHECK_SUCCESS(glewInit() == GLEW_OK);
+  if (headless) {
+    CHECK_SUCCESS(headless->create(gl_debug::level() != gl_debug::Level::Off));
+    // The rest of glewInit looks for a GLX display, the GL entry points are
+    // all this needs
+    CHECK_SUCCESS(glewContextInit() == GLEW_OK);
+  } else {
+    ret = init_glfw(bench);
+    CHECK_SUCCESS(glewInit() == GLEW_OK);
+    // No vsync when benchmarking, it would cap every measurement
+    glfwSwapInterval(bench.enabled ? 0 : 1);
+  }
   glGetError(); // clear GLEW's error for it
-  glfwSwapInterval(1);
   const GLubyte *renderer = glGetString(GL_RENDERER); // get renderer string
   const GLubyte *version = glGetString(GL_VERSION);   // version as a string
   std::cout << "Renderer: " << renderer << "\n";
   std::cout << "OpenGL version supported:" << version << "\n";
+  std::cout << "GL diagnostics: " << gl_debug::levelName(gl_debug::level())
+            << "\n";
+  gl_debug::install();
 
   return ret;
 }
 
 int main(int argc, char *argv[]) {
+  BenchOptions bench;
+  if (!parseBenchArgs(argc, argv, bench)) {
+    exit(EXIT_FAILURE);
+  }
+  // Input recording and replay, a replay also brings the seed and quality it
+  // was recorded with
+  InputLog input_log;
+  if (!bench.replay_file.empty()) {
+    if (!input_log.load(bench.replay_file)) {
+      exit(EXIT_FAILURE);
+    }
+    bench.seed = input_log.seed();
+    if (!input_log.quality().empty()) {
+      bench.quality = input_log.quality();
+    }
+  } else if (!bench.record_file.empty() &&
+             !input_log.startRecording(bench.record_file, bench.seed,
+                                       bench.quality)) {
+    exit(EXIT_FAILURE);
+  }
   auto start = std::chrono::high_resolution_clock::now();
-  GLFWwindow *window = init_glefw();
-  GUI gui(window);
-
-  glm::vec4 light_position = glm::vec4(0.0f, SUN_RADIUS, 0.0f, 1.0f);
-  MatrixPointers mats;
+  // Worker threads for asset loading and frame encoding
+  JobSystem workers;
+  auto boat_mesh_loaded =
+      workers.submit([]() { return util::LoadObj("../assets/rowboat.obj"); });
+  // --context egl runs without GLFW or any window system, no xvfb needed
+  bool surfaceless = bench.enabled && bench.context == BenchContext::EGL;
+  HeadlessContext headless_context;
+  GLFWwindow *window =
+      init_glefw(bench, surfaceless ? &headless_context : nullptr);
+  auto gui_owner = window ? std::unique_ptr<GUI>(new GUI(window))
+                          : std::unique_ptr<GUI>(
+                                new GUI(window_width, window_height));
+  GUI &gui = *gui_owner;
+
+  // The frame being rendered, published by the simulation thread
+  const FrameSnapshot *frame = nullptr;
 
   // Define MatrixPointers here for lambda to capture
   /*
@@ -167,43 +220,38 @@ int main(int argc, char *argv[]) {
   /*
    * The lambda functions below are used to retrieve data
    */
-  auto std_model_data = [&mats]() -> const void * {
-    return mats.model;
+  auto std_model_data = [&frame]() -> const void * {
+    return &frame->model[0][0];
   }; // This returns point to model matrix
-  auto std_view_data = [&mats]() -> const void * { return mats.view; };
-  auto std_camera_data = [&gui]() -> const void * {
-    return &gui.getCamera()[0];
+  auto std_view_data = [&frame]() -> const void * {
+    return &frame->view[0][0];
+  };
+  auto std_camera_data = [&frame]() -> const void * { return &frame->eye[0]; };
+  auto std_center_data = [&frame]() -> const void * {
+    return &frame->center[0];
+  };
+  auto std_proj_data = [&frame]() -> const void * {
+    return &frame->projection[0][0];
   };
-  auto std_center_data = [&gui]() -> const void * {
-    return &gui.getCenter()[0];
+  auto inv_proj_data = [&frame]() -> const void * {
+    return &frame->inv_proj_view[0][0];
   };
-  auto std_proj_data = [&mats]() -> const void * { return mats.projection; };
-  auto inv_proj_data = [&mats]() -> const void * { return mats.inv_proj_view; };
-  auto std_light_data = [&light_position]() -> const void * {
-    return &light_position[0];
+  auto std_light_data = [&frame]() -> const void * {
+    return &frame->light_position[0];
   };
-  float time_from_start;
-  auto prev = start;
-  auto std_time_data = [&start, &time_from_start, &prev,
-                        &gui]() -> const void * {
-    auto now = std::chrono::high_resolution_clock::now();
-    time_from_start = std::chrono::duration<float>(now - start).count();
-    float since_last = std::chrono::duration<float>(now - prev).count();
-    gui.incrementTimeOfDay(since_last);
-    prev = now;
-    return &time_from_start;
+  auto std_time_data = [&frame]() -> const void * { return &frame->time; };
+  auto std_time_of_day_data = [&frame]() -> const void * {
+    return &frame->time_of_day;
   };
-  auto std_time_of_day_data = [&gui]() -> const void * {
-    return &gui.getTimeOfDay();
+  auto prev_move_data = [&frame]() -> const void * {
+    return &frame->prev_move;
   };
-  auto prev_move_data = [&gui]() -> const void * {
-    return &gui.getPreviousMoveVec();
+  auto boat_pos_normal_data = [&frame]() -> const void * {
+    return &frame->boat_normal;
   };
-  glm::vec3 boat_pos_normal{0.0f};
-  auto boat_pos_normal_data = [&boat_pos_normal]() -> const void * {
-    return &boat_pos_normal;
+  auto is_raining_data = [&frame]() -> const void * {
+    return &frame->raining;
   };
-  auto is_raining_data = [&gui]() -> const void * { return &gui.isRaining(); };
 
   ShaderUniform std_model = {"model", matrix_binder, std_model_data};
   ShaderUniform std_view = {"view", matrix_binder, std_view_data};
@@ -226,7 +274,7 @@ int main(int argc, char *argv[]) {
   //
   // Boat render pass
   //
-  auto boat_mesh = util::LoadObj("../assets/rowboat.obj");
+  auto boat_mesh = boat_mesh_loaded.get();
   auto boat_pass_input = RenderDataInput{};
   boat_pass_input.assign(0, "vertex_position", boat_mesh.vertices.data(),
                          boat_mesh.vertices.size(), 4, GL_FLOAT);
@@ -240,112 +288,294 @@ int main(int argc, char *argv[]) {
       {std_model, std_light, std_center, std_view, std_proj, std_prev_move,
        std_boat_pos_normal, std_time_of_day},
       {"fragment_color"});
+  // Rotations keep the boat inside this distance of its center
+  float boat_radius = 0.0f;
+  for (const auto &vertex : boat_mesh.vertices) {
+    boat_radius = std::max(boat_radius, glm::length(glm::vec3(vertex)));
+  }
+
+  //
+  // Sky colour and sun colour lookup, shared by the sky, terrain and ocean
+  //
+  Atmosphere atmosphere;
+  auto atmosphere_uniforms = atmosphere.uniforms();
 
   //
-  // Sun render pass
+  // Sun render pass, a screen aligned impostor
   //
-  auto sun_pass_input = RenderDataInput{};
-  sun_pass_input.assign(0, "vertex_position", SUN_VERTICES.data(),
-                        SUN_VERTICES.size(), 4, GL_FLOAT);
-  sun_pass_input.assignIndex(SUN_FACES.data(), SUN_FACES.size(), 3);
-  RenderPass sun_pass(-1, sun_pass_input,
-                      {sun_vertex_shader, sun_geometry_shader,
-                       sun_fragment_shader, sun_tcs_shader, sun_tes_shader},
-                      {std_view, std_proj, std_light, std_time_of_day},
-                      {"fragment_color"});
+  auto sun_uniforms = std::vector<ShaderUniform>{std_view, std_proj, std_light};
+  sun_uniforms.insert(sun_uniforms.end(), atmosphere_uniforms.begin(),
+                      atmosphere_uniforms.end());
+  RenderPass sun_pass(-1, RenderDataInput{},
+                      {sun_vertex_shader, nullptr, sun_fragment_shader},
+                      sun_uniforms, {"fragment_color"});
 
   //
   // Skybox render pass
   //
-  RenderPass sky_pass(
-      -1, RenderDataInput{}, {sky_vertex_shader, nullptr, sky_fragment_shader},
-      {inv_proj_view, std_time_of_day, std_is_raining}, {"fragment_color"});
+  auto sky_uniforms = std::vector<ShaderUniform>{inv_proj_view, std_is_raining};
+  sky_uniforms.insert(sky_uniforms.end(), atmosphere_uniforms.begin(),
+                      atmosphere_uniforms.end());
+  RenderPass sky_pass(-1, RenderDataInput{},
+                      {sky_vertex_shader, nullptr, sky_fragment_shader},
+                      sky_uniforms, {"fragment_color"});
+
+  //
+  // Simulation state: terrain, waves and collision
+  //
+  // Equal seeds give identical terrain, waves and rain, see --seed
+  std::cout << "World seed: " << bench.seed << std::endl;
+  // The wave count changes the simulation, a replay has set the quality it
+  // was recorded with above
+  auto ocean_quality = OceanQuality::preset(bench.quality);
+  ocean_quality.fog = bench.fog;
+  std::cout << "Ocean quality: " << bench.quality << " ("
+            << ocean_quality.waves << " waves)" << std::endl;
+  World world(height_map_rows, height_map_cols, bench.seed, &workers,
+              ocean_quality.waves);
+  gui.world = &world;
 
   //
   // Terrain render pass
   //
-  TerrainRender terrainRender(height_map_rows, height_map_cols,
-                              {std_model, std_view, std_proj, std_light,
-                               std_camera, std_center, std_time,
-                               std_time_of_day, std_is_raining});
-  terrainRender.setStartTime(start);
+  auto terrain_uniforms = std::vector<ShaderUniform>{
+      std_model,  std_view,   std_proj, std_light,
+      std_camera, std_center, std_time, std_is_raining};
+  terrain_uniforms.insert(terrain_uniforms.end(), atmosphere_uniforms.begin(),
+                          atmosphere_uniforms.end());
+  TerrainRender terrainRender(world, terrain_uniforms, ocean_quality,
+                              &workers);
+  if (!bench.occlusion) {
+    terrainRender.toggleOcclusion();
+  }
   gui.terrainRender = &terrainRender;
 
+  //
+  // Benchmark replay
+  //
+  CameraPath bench_path;
+  BenchRecorder bench_recorder;
+  TextureToRender bench_target;
+  bool replaying = input_log.mode() == InputLog::Mode::Replay;
+  int bench_frames = 0;
+  if (bench.enabled) {
+    if (replaying) {
+      bench_frames = input_log.frames();
+    } else {
+      if (!bench_path.load(bench.path_file)) {
+        exit(EXIT_FAILURE);
+      }
+      bench_frames = int(bench_path.duration() / BenchRecorder::kStep) + 1;
+    }
+    if (bench.max_frames > 0) {
+      bench_frames = std::min(bench_frames, bench.max_frames);
+    }
+    if (!bench_recorder.open(bench.csv_file, bench_frames)) {
+      exit(EXIT_FAILURE);
+    }
+    if (window) {
+      glfwGetFramebufferSize(window, &window_width, &window_height);
+    }
+    bench_target.create(window_width, window_height);
+  }
+
+  //
+  // Simulation thread. Benchmarks, recordings and replays step it by a fixed
+  // BenchRecorder::kStep per frame so they are reproducible, live play
+  // follows the wall clock
+  //
+  bool fixed_clock =
+      bench.enabled || input_log.mode() == InputLog::Mode::Record;
+  Simulation simulation(world, gui, input_log,
+                        bench.enabled && !replaying ? &bench_path : nullptr,
+                        fixed_clock, bench.enabled ? bench_frames : 0, start);
+
   //
   // Rain render pass
   //
   RainRender rainRender(
-      height_map_rows, height_map_cols,
+      simulation.rainDrops(),
       {std_view, std_proj, std_light, std_camera, std_center});
 
+  //
+  // Frame capture, encoded on the worker threads
+  //
+  FrameCapture frameCapture(workers);
+  gui.frameCapture = &frameCapture;
+  if (bench.enabled && !bench.capture.empty()) {
+    if (bench.capture == "jpeg") {
+      frameCapture.start(window_width, window_height,
+                         FrameCapture::Format::JPEG, "bench");
+    } else {
+      frameCapture.start(window_width, window_height,
+                         FrameCapture::Format::Y4M, "bench.y4m");
+    }
+  }
+
+  //
+  // Draws, queued every frame and issued sorted by RenderQueue
+  //
+  auto draw_sky = std::function<void()>([&sky_pass]() {
+    sky_pass.setup();
+    PROFILE_GPU_SCOPE("sky");
+    CHECK_GL_ERROR(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+  });
+  auto draw_boat = std::function<void()>([&boat_pass, &boat_mesh]() {
+    boat_pass.setup();
+    PROFILE_GPU_SCOPE("boat");
+    CHECK_GL_ERROR(glDrawElements(GL_TRIANGLES,
+                                  boat_mesh.vertex_indices.size() * 3,
+                                  GL_UNSIGNED_INT, 0));
+  });
+  auto draw_sun = std::function<void()>([&sun_pass]() {
+    sun_pass.setup();
+    PROFILE_GPU_SCOPE("sun");
+    CHECK_GL_ERROR(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+  });
+  // The sky is drawn at the near plane and must not hide anything after it
+  auto sky_state = RenderState{};
+  sky_state.depth_write = false;
+  // The sun goes first of the transparent draws, its clear corners must not
+  // cut a square out of the ocean drawn over it
+  auto sun_state = RenderState{};
+  sun_state.blend = true;
+  sun_state.depth_write = false;
+  RenderQueue render_queue;
+
+  // State every draw shares, set once
+  auto &gl_state = GLState::instance();
+  gl_state.setEnabled(GL_DEPTH_TEST, true);
+  gl_state.setEnabled(GL_MULTISAMPLE, true);
+  gl_state.depthFunc(GL_LESS);
+  gl_state.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  gl_state.cullFace(GL_BACK);
+
   bool draw_terrain = true;
-  double previousTime = glfwGetTime();
+  bool first_frame = true;
+  // Seconds since start, glfwGetTime needs GLFW
+  auto seconds = [start]() {
+    return std::chrono::duration<double>(
+               std::chrono::high_resolution_clock::now() - start)
+        .count();
+  };
+  double previousTime = seconds();
+  double lastFrameTime = previousTime;
   int frameCount = 0;
-  while (!glfwWindowShouldClose(window)) {
-    boat_pos_normal = terrainRender.getWaveNormal(gui.getCenter());
+  size_t frameAllocations = alloc_counter::threadAllocations();
+  size_t simulationAllocations = 0;
+  simulation.start();
+  while (!gui.shouldClose()) {
+    // Simulated while the previous frame rendered, null once a benchmark or
+    // replay has run out of frames
+    frame = simulation.nextFrame();
+    if (!frame) {
+      break;
+    }
+    if (bench.enabled) {
+      bench_recorder.beginFrame();
+    }
+    simulationAllocations += frame->allocations;
+    PROFILE_BEGIN_FRAME();
+    gl_state.beginFrame();
     // FPS Counter
-    double currentTime = glfwGetTime();
+    double currentTime = seconds();
+    terrainRender.updateTessellationBudget(currentTime - lastFrameTime,
+                                           window_height);
+    lastFrameTime = currentTime;
     frameCount++;
     if (currentTime - previousTime >= 1.0) {
       // Display the frame count here any way you want.
-      std::cout << "FPS: " << frameCount << std::endl;
+      std::cout << "FPS: " << frameCount;
+      if (alloc_counter::enabled()) {
+        size_t allocations = alloc_counter::threadAllocations();
+        std::cout << " (" << allocations - frameAllocations +
+                                 simulationAllocations
+                  << " heap allocations)";
+        frameAllocations = allocations;
+        simulationAllocations = 0;
+      }
+      std::cout << std::endl;
+      PROFILE_REPORT(std::cout);
       frameCount = 0;
       previousTime = currentTime;
     }
 
-    // Calculating light_position
-    float time_of_day = gui.getTimeOfDay();
-    float angle = (time_of_day / gui.kMaxTimeOfDay) * 2 * M_PI;
-    glm::vec4 light_vec_from_center =
-        SUN_RADIUS * glm::vec4{0.0f, -cos(angle), sin(angle), 0.0f};
-    light_position = light_vec_from_center + glm::vec4(gui.getCenter(), 1.0f);
+    {
+      PROFILE_CPU_SCOPE("atmosphere");
+      atmosphere.update(frame->time_of_day);
+    }
 
     // Setup some basic window stuff.
-    glfwGetFramebufferSize(window, &window_width, &window_height);
+    if (window) {
+      glfwGetFramebufferSize(window, &window_width, &window_height);
+    }
+    if (bench.enabled) {
+      bench_target.bind();
+    }
     glViewport(0, 0, window_width, window_height);
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_MULTISAMPLE);
-    glEnable(GL_BLEND);
-    glEnable(GL_CULL_FACE);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glDepthFunc(GL_LESS);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glCullFace(GL_BACK);
-
-    gui.updatePosition();
-    gui.updateMatrices();
-    mats = gui.getMatrixPointers();
-
-    // Draw sky
-    sky_pass.setup();
-    glDepthMask(false);
-    CHECK_GL_ERROR(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
-    glDepthMask(true);
+    gl_state.countCalls(3);
 
-    // Draw terrain
+    // Queue the draws, flush() sorts them and issues them
+    render_queue.submit(RenderQueue::Layer::Background, 0.0f, sky_state,
+                        sky_pass, &draw_sky);
     if (draw_terrain) {
-      terrainRender.renderVisible(gui.getCamera());
+      terrainRender.submit(*frame, render_queue);
+    }
+    auto boat_extent = glm::vec3{boat_radius};
+    render_queue.submit(RenderQueue::Layer::Opaque,
+                        RenderQueue::boxDepth(frame->view,
+                                              frame->center - boat_extent,
+                                              frame->center + boat_extent),
+                        RenderState{}, boat_pass, &draw_boat);
+    // Part of the sky, behind every other transparent draw
+    render_queue.submit(RenderQueue::Layer::Transparent, kFar, sun_state,
+                        sun_pass, &draw_sun);
+    if (frame->raining) {
+      rainRender.submit(frame->rain, render_queue);
+    }
+    render_queue.flush();
+
+    // Screenshots and captures read the frame just drawn
+    gui.runActions(frame->actions);
+    frameCapture.capture();
+    if (bench.enabled) {
+      bench_recorder.endFrame(frame->raining, frame->allocations);
+      bench_target.unbind();
     }
 
-    // Draw boat
-    boat_pass.setup();
-    CHECK_GL_ERROR(glDrawElements(
-        GL_TRIANGLES, boat_mesh.vertex_indices.size() * 3, GL_UNSIGNED_INT, 0));
-
-    // Draw sun
-    sun_pass.setup();
-    CHECK_GL_ERROR(
-        glDrawElements(GL_PATCHES, SUN_FACES.size() * 3, GL_UNSIGNED_INT, 0));
-
-    // Draw rain
-    rainRender.update(gui.isRaining());
-
-    // Poll and swap.
-    glfwPollEvents();
-    glfwSwapBuffers(window);
+    // Poll and swap. Polled input goes to the simulation thread
+    if (window) {
+      glfwPollEvents();
+      glfwSwapBuffers(window);
+    } else {
+      // Nothing to present, submit the frame like a swap would
+      glFlush();
+    }
+    FrameArena::local().reset();
+    PROFILE_END_FRAME();
+    if (first_frame) {
+      // Startup cost: context, asset loading, shader and terrain builds
+      std::chrono::duration<double, std::milli> startup =
+          std::chrono::high_resolution_clock::now() - start;
+      std::cout << "Time to first frame: " << startup.count() << " ms"
+                << std::endl;
+      first_frame = false;
+    }
+  }
+  simulation.stop();
+  frameCapture.stop();
+  if (input_log.mode() == InputLog::Mode::Record) {
+    input_log.save(simulation.frames());
+  }
+  bool passed = true;
+  if (bench.enabled) {
+    passed = bench_recorder.finish();
+  }
+  if (window) {
+    glfwDestroyWindow(window);
+    glfwTerminate();
   }
-  glfwDestroyWindow(window);
-  glfwTerminate();
-  exit(EXIT_SUCCESS);
+  exit(passed ? EXIT_SUCCESS : EXIT_FAILURE);
 }
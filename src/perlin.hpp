@@ -1,29 +1,42 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
 #include <glm/glm.hpp>
 #include <random>
 
+/*
+ * Two gradient noise backends share the lattice and interpolation:
+ *
+ *  - gradientNoise, used for the terrain, picks one of eight fixed gradients
+ *    per lattice point from an integer hash of the point and a world seed.
+ *    Integer arithmetic is exact everywhere, so it stays artifact free far
+ *    from the origin, and with the same float operations in the same order
+ *    the GLSL port (terrain_clipmap.vert, terrain.geom) returns identical
+ *    values. Keep both in sync.
+ *  - perlin, the legacy sin() hash, kept to compare against in ocean_bench.
+ */
 namespace perlin {
-float kPi = 3.1415926535897932384626433832795f;
-float kBlockSize = 1.0f;
-float kMaxHeight = 50.0f;
+const float kPi = 3.1415926535897932384626433832795f;
+const float kBlockSize = 1.0f;
+const float kMaxHeight = 50.0f;
+const uint32_t kDefaultSeed = 0x2545f491u;
 
-float fade(float t) {
+inline float fade(float t) {
   return 6 * glm::pow(t, 5) - 15 * glm::pow(t, 4) + 10 * glm::pow(t, 3);
 }
 
-float random(const glm::vec2 &co) {
+inline float random(const glm::vec2 &co) {
   return glm::fract(glm::sin(glm::dot(co, glm::vec2(12.9898, 78.233))) *
                     43758.5453);
 }
 
-glm::vec2 randUnitVec(const glm::vec2 &xz) {
+inline glm::vec2 randUnitVec(const glm::vec2 &xz) {
   float angle = random(xz) * 2 * kPi;
   return glm::normalize(glm::vec2(glm::cos(angle), glm::sin(angle)));
 }
 
-float dotGridGradient(int ix, int iz, float x, float z) {
+inline float dotGridGradient(int ix, int iz, float x, float z) {
   // Generate seeded random unit gradient vector
   auto unit_gradient = randUnitVec(glm::vec2(ix, iz));
 
@@ -35,8 +48,8 @@ float dotGridGradient(int ix, int iz, float x, float z) {
   return (dx * unit_gradient[0] + dz * unit_gradient[1]);
 }
 
-// Compute Perlin noise for the given coordinates
-float perlin(float x, float z) {
+// Compute Perlin noise for the given coordinates, legacy sin() hash
+inline float perlin(float x, float z) {
   // Get coordinates of unit cell
   int x0 = std::floor(x);
   int x1 = x0 + 1;
@@ -60,22 +73,173 @@ float perlin(float x, float z) {
   return value;
 }
 
-float multipass_noise(float x, float z) {
+// Integer hash of a lattice point (lowbias32 finalizer)
+inline uint32_t hashLattice(int ix, int iz, uint32_t seed) {
+  uint32_t h = seed ^ (uint32_t(ix) * 0x8da6b343u);
+  h ^= uint32_t(iz) * 0xd8163841u;
+  h ^= h >> 16;
+  h *= 0x7feb352du;
+  h ^= h >> 15;
+  h *= 0x846ca68bu;
+  h ^= h >> 16;
+  return h;
+}
+
+// The eight unit gradients, indexed by the low bits of hashLattice. A table
+// rather than a switch, so loops over many points can vectorize.
+const float kGradientX[8] = {1.0f,         -1.0f,       0.0f,
+                             0.0f,         0.70710678f, 0.70710678f,
+                             -0.70710678f, -0.70710678f};
+const float kGradientZ[8] = {0.0f,        0.0f,         1.0f,
+                             -1.0f,       0.70710678f,  -0.70710678f,
+                             0.70710678f, -0.70710678f};
+
+// Dot product of the distance vector with the gradient selected by hash
+inline float latticeGradient(uint32_t hash, float dx, float dz) {
+  return dx * kGradientX[hash & 7u] + dz * kGradientZ[hash & 7u];
+}
+
+// Quintic fade in Horner form, no pow()
+inline float smootherstep(float t) {
+  return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+// Derivative of smootherstep
+inline float smootherstepSlope(float t) {
+  return 30.0f * t * t * (t * (t - 2.0f) + 1.0f);
+}
+
+inline float lerp(float a, float b, float t) { return a + (b - a) * t; }
+
+/**
+ * Gradient noise on the integer lattice, the gradient of each lattice point
+ * is selected by hashLattice. Lattice points are wrapped to period cells
+ * before hashing when period > 0, which makes the noise tile.
+ */
+inline float gradientNoise(float x, float z, uint32_t seed, int period = 0) {
+  int x0 = int(std::floor(x));
+  int z0 = int(std::floor(z));
+  float fx = x - float(x0);
+  float fz = z - float(z0);
+  auto corner = [=](int i, int j) {
+    int ix = x0 + i, iz = z0 + j;
+    if (period > 0) {
+      ix = ((ix % period) + period) % period;
+      iz = ((iz % period) + period) % period;
+    }
+    return latticeGradient(hashLattice(ix, iz, seed), fx - float(i),
+                           fz - float(j));
+  };
+  float wt_x = smootherstep(fx);
+  float wt_z = smootherstep(fz);
+  float ix0 = lerp(corner(0, 0), corner(1, 0), wt_x);
+  float ix1 = lerp(corner(0, 1), corner(1, 1), wt_x);
+  return lerp(ix0, ix1, wt_z);
+}
+
+// A noise or height value and its partial derivatives along x and z
+struct NoiseSample {
+  float value;
+  glm::vec2 gradient;
+};
+
+/**
+ * gradientNoise (not tiled) and its analytic gradient from one evaluation.
+ * The value is computed with the same operations in the same order, so it
+ * is bit-identical to gradientNoise.
+ */
+inline NoiseSample gradientNoiseAndGradient(float x, float z, uint32_t seed) {
+  int x0 = int(std::floor(x));
+  int z0 = int(std::floor(z));
+  float fx = x - float(x0);
+  float fz = z - float(z0);
+  uint32_t h00 = hashLattice(x0, z0, seed) & 7u;
+  uint32_t h10 = hashLattice(x0 + 1, z0, seed) & 7u;
+  uint32_t h01 = hashLattice(x0, z0 + 1, seed) & 7u;
+  uint32_t h11 = hashLattice(x0 + 1, z0 + 1, seed) & 7u;
+  float c00 = latticeGradient(h00, fx, fz);
+  float c10 = latticeGradient(h10, fx - 1.0f, fz);
+  float c01 = latticeGradient(h01, fx, fz - 1.0f);
+  float c11 = latticeGradient(h11, fx - 1.0f, fz - 1.0f);
+  float wt_x = smootherstep(fx);
+  float wt_z = smootherstep(fz);
+  float dwt_x = smootherstepSlope(fx);
+  float dwt_z = smootherstepSlope(fz);
+  float ix0 = lerp(c00, c10, wt_x);
+  float ix1 = lerp(c01, c11, wt_x);
+
+  // Each corner term is linear in the distance, its slope is the gradient
+  float ix0_dx = lerp(kGradientX[h00], kGradientX[h10], wt_x) +
+                 (c10 - c00) * dwt_x;
+  float ix1_dx = lerp(kGradientX[h01], kGradientX[h11], wt_x) +
+                 (c11 - c01) * dwt_x;
+  float ix0_dz = lerp(kGradientZ[h00], kGradientZ[h10], wt_x);
+  float ix1_dz = lerp(kGradientZ[h01], kGradientZ[h11], wt_x);
+  return {lerp(ix0, ix1, wt_z),
+          {lerp(ix0_dx, ix1_dx, wt_z),
+           lerp(ix0_dz, ix1_dz, wt_z) + (ix1 - ix0) * dwt_z}};
+}
+
+// Noise that repeats every period lattice cells, for baking textures
+inline float tileablePerlin(float x, float z, int period, uint32_t seed) {
+  return gradientNoise(x, z, seed, period);
+}
+
+/**
+ * Sum octaves of noise(x, z) at doubling frequencies. Amplitudes halve from
+ * 8/15, which keeps three octaves, the terrain default, within [-1, 1].
+ */
+template <typename Noise>
+inline float fractalSum(float x, float z, int octaves, Noise noise) {
   float sum = 0.0f;
   float amp = 8.0f / 15.0f;
   float freq_divisor = 1.0f;
-  for (int n = 0; n < 3; n++) {
-    sum += perlin(x * freq_divisor, z * freq_divisor) * amp;
+  for (int n = 0; n < octaves; n++) {
+    sum += noise(x * freq_divisor, z * freq_divisor) * amp;
     freq_divisor *= 2.0f;
     amp /= 2.0f;
   }
   return sum;
 }
 
-float getHeight(float x, float z) {
-  return multipass_noise(x / kBlockSize / 20.0f, z / kBlockSize / 20.0f) *
+const int kTerrainOctaves = 3;
+const float kTerrainScale = 20.0f; /* world units per lattice cell */
+
+inline float multipass_noise(float x, float z, uint32_t seed) {
+  return fractalSum(x, z, kTerrainOctaves, [seed](float u, float v) {
+    return gradientNoise(u, v, seed);
+  });
+}
+
+inline float getHeight(float x, float z, uint32_t seed) {
+  return multipass_noise(x / kBlockSize / kTerrainScale,
+                         z / kBlockSize / kTerrainScale, seed) *
              kMaxHeight * kBlockSize -
          8.0f;
 }
 
+/**
+ * getHeight and its slope (dh/dx, dh/dz) in one evaluation, so a normal,
+ * normalize(-dh/dx, 1, -dh/dz), needs no neighbouring heights. The height
+ * is bit-identical to getHeight.
+ */
+inline NoiseSample heightAndGradient(float x, float z, uint32_t seed) {
+  float u = x / kBlockSize / kTerrainScale;
+  float v = z / kBlockSize / kTerrainScale;
+  float sum = 0.0f;
+  glm::vec2 slope{0.0f};
+  float amp = 8.0f / 15.0f;
+  float freq_divisor = 1.0f;
+  for (int n = 0; n < kTerrainOctaves; n++) {
+    auto octave =
+        gradientNoiseAndGradient(u * freq_divisor, v * freq_divisor, seed);
+    sum += octave.value * amp;
+    slope += octave.gradient * (amp * freq_divisor);
+    freq_divisor *= 2.0f;
+    amp /= 2.0f;
+  }
+  return {sum * kMaxHeight * kBlockSize - 8.0f,
+          slope * (kMaxHeight / kTerrainScale)};
+}
+
 } /* namespace perlin */
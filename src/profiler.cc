@@ -0,0 +1,246 @@
+#include "profiler.h"
+
+#ifdef OCEAN_PROFILER
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+constexpr size_t Profiler::kStatWindow;
+constexpr size_t Profiler::kTraceEvents;
+constexpr size_t Profiler::kGpuFrames;
+constexpr size_t Profiler::kGpuHistory;
+
+Profiler &Profiler::instance() {
+  static Profiler profiler;
+  return profiler;
+}
+
+// Reserve everything up front so profiling does not allocate per frame
+Profiler::Profiler() : start_(Clock::now()), trace_(kTraceEvents) {
+  zones_.reserve(64);
+  for (size_t slot = 0; slot < kGpuFrames; slot++) {
+    gpu_pending_[slot].reserve(64);
+    gpu_queries_[slot].reserve(64);
+  }
+}
+
+void Profiler::beginFrame() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  render_thread_ = std::this_thread::get_id();
+  // The queries in this slot were issued kGpuFrames frames ago
+  if (frame_ >= kGpuFrames) {
+    resolveGpuFrame(frame_ - kGpuFrames);
+  }
+}
+
+void Profiler::endFrame() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Frames a zone did not run in would only pull its statistics to 0
+  for (auto &zone : zones_) {
+    if (!zone.hit) {
+      continue;
+    }
+    zone.samples[zone.count % kStatWindow] = float(zone.frame_ms);
+    zone.count++;
+    zone.frame_ms = 0.0;
+    zone.hit = false;
+  }
+  frame_++;
+}
+
+size_t Profiler::frame() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return frame_;
+}
+
+void Profiler::setWaitForGpu(bool wait) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  wait_for_gpu_ = wait;
+}
+
+void Profiler::flushGpu() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Oldest first, the frame in progress has not issued all of its zones
+  for (size_t i = kGpuFrames; i > 0; i--) {
+    if (frame_ >= i) {
+      resolveGpuFrame(frame_ - i);
+    }
+  }
+}
+
+bool Profiler::gpuFrameMs(size_t frame, double &ms) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto &total = gpu_frames_[frame % kGpuHistory];
+  if (total.frame != frame || !total.complete) {
+    return false;
+  }
+  ms = total.ms;
+  return true;
+}
+
+void Profiler::addCpuSample(const char *name, Clock::time_point start,
+                            Clock::time_point end) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Render thread scopes on row 1, GPU zones on row 2, other threads below
+  int tid = std::this_thread::get_id() == render_thread_ ? 1 : 3;
+  int zone = zoneIndex(name, false);
+  double start_us = sinceStart(start);
+  double duration_us = sinceStart(end) - start_us;
+  zones_[zone].frame_ms += duration_us / 1000.0;
+  zones_[zone].hit = true;
+  addTraceEvent(zone, tid, start_us, duration_us);
+}
+
+bool Profiler::gpuBegin(const char *name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (gpu_open_ >= 0) {
+    // Once, this would repeat every frame
+    if (!gpu_nesting_reported_) {
+      std::cerr << "Profiler: GPU zone " << name << " nested in "
+                << zones_[gpu_open_].name << ", ignored" << std::endl;
+      gpu_nesting_reported_ = true;
+    }
+    return false;
+  }
+  size_t slot = frame_ % kGpuFrames;
+  auto &pending = gpu_pending_[slot];
+  auto &queries = gpu_queries_[slot];
+  if (pending.size() == queries.size()) {
+    GLuint query = 0;
+    glGenQueries(1, &query);
+    queries.push_back(query);
+  }
+  gpu_open_ = zoneIndex(name, true);
+  unsigned query = queries[pending.size()];
+  pending.push_back({gpu_open_, query, sinceStart(Clock::now())});
+  glBeginQuery(GL_TIME_ELAPSED, query);
+  return true;
+}
+
+void Profiler::gpuEnd() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (gpu_open_ < 0) {
+    return;
+  }
+  glEndQuery(GL_TIME_ELAPSED);
+  gpu_open_ = -1;
+}
+
+/**
+ * Read back every query of a frame, without blocking unless wait_for_gpu_ is
+ * set. GPU zones are credited to the frame in which they are resolved, and
+ * placed on their own trace row starting at the CPU time they were
+ * submitted. The frame's own total goes to gpu_frames_.
+ */
+void Profiler::resolveGpuFrame(size_t frame) {
+  auto &pending = gpu_pending_[frame % kGpuFrames];
+  auto &total = gpu_frames_[frame % kGpuHistory];
+  if (total.frame == frame) {
+    return; /* flushGpu() got to it first */
+  }
+  total.frame = frame;
+  total.ms = 0.0;
+  total.complete = true;
+  for (const auto &sample : pending) {
+    GLint available = 0;
+    if (!wait_for_gpu_) {
+      glGetQueryObjectiv(sample.query, GL_QUERY_RESULT_AVAILABLE, &available);
+    }
+    if (!wait_for_gpu_ && !available) {
+      gpu_dropped_++;
+      total.complete = false;
+      continue;
+    }
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(sample.query, GL_QUERY_RESULT, &nanoseconds);
+    zones_[sample.zone].frame_ms += nanoseconds / 1e6;
+    zones_[sample.zone].hit = true;
+    total.ms += nanoseconds / 1e6;
+    addTraceEvent(sample.zone, 2, sample.start_us, nanoseconds / 1e3);
+  }
+  pending.clear();
+}
+
+int Profiler::zoneIndex(const char *name, bool gpu) {
+  for (size_t i = 0; i < zones_.size(); i++) {
+    if (zones_[i].gpu == gpu &&
+        (zones_[i].name == name || std::strcmp(zones_[i].name, name) == 0)) {
+      return int(i);
+    }
+  }
+  zones_.emplace_back();
+  zones_.back().name = name;
+  zones_.back().gpu = gpu;
+  zones_.back().first_frame = frame_;
+  return int(zones_.size() - 1);
+}
+
+double Profiler::sinceStart(Clock::time_point t) const {
+  return std::chrono::duration<double, std::micro>(t - start_).count();
+}
+
+void Profiler::addTraceEvent(int zone, int tid, double start_us,
+                             double duration_us) {
+  trace_[trace_next_ % kTraceEvents] = {zone, tid, start_us, duration_us};
+  trace_next_++;
+}
+
+void Profiler::report(std::ostream &os) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto window = std::array<float, kStatWindow>{};
+  os << std::fixed << std::setprecision(3);
+  for (const auto &zone : zones_) {
+    size_t n = std::min(zone.count, kStatWindow);
+    if (n == 0) {
+      continue;
+    }
+    std::copy(zone.samples.begin(), zone.samples.begin() + n, window.begin());
+    float min = *std::min_element(window.begin(), window.begin() + n);
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+      sum += window[i];
+    }
+    size_t p99 = std::min(n - 1, size_t(n * 0.99));
+    std::nth_element(window.begin(), window.begin() + p99, window.begin() + n);
+    // The frame in progress has not been counted yet
+    size_t frames = std::max<size_t>(frame_ - zone.first_frame, 1);
+    os << "  " << (zone.gpu ? "GPU " : "CPU ") << std::left << std::setw(18)
+       << zone.name << std::right << " min " << min << " avg " << sum / n
+       << " p99 " << window[p99] << " ms, in " << std::min(zone.count, frames)
+       << " of " << frames << " frames\n";
+  }
+  if (gpu_dropped_ > 0) {
+    os << "  " << gpu_dropped_ << " GPU samples dropped (not ready in time)\n";
+  }
+  os << std::defaultfloat;
+}
+
+bool Profiler::dumpChromeTrace(const std::string &filename) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::ofstream file{filename};
+  if (!file.is_open()) {
+    std::cerr << "Failed to open trace file: " << filename << std::endl;
+    return false;
+  }
+  size_t first = trace_next_ > kTraceEvents ? trace_next_ - kTraceEvents : 0;
+  file << "{\"traceEvents\":[\n";
+  for (size_t i = first; i < trace_next_; i++) {
+    const auto &event = trace_[i % kTraceEvents];
+    const auto &zone = zones_[event.zone];
+    file << (i == first ? "" : ",\n") << "{\"name\":\"" << zone.name
+         << "\",\"cat\":\"" << (zone.gpu ? "gpu" : "cpu")
+         << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.tid
+         << ",\"ts\":" << std::fixed << event.start_us
+         << ",\"dur\":" << event.duration_us << "}";
+  }
+  file << "\n]}\n";
+  std::cout << "Profiler trace written out to \"" << filename << "\""
+            << std::endl;
+  return true;
+}
+
+#endif
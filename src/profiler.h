@@ -0,0 +1,175 @@
+#pragma once
+
+/*
+ * Frame profiler: named CPU scopes and GL_TIME_ELAPSED zones around render
+ * passes. Every zone keeps a rolling window of its per-frame totals for
+ * min/avg/p99, over the frames it ran in only, so an intermittent zone such
+ * as a terrain rebuild shows its real cost, and reports how often it ran.
+ * The last few thousand scopes can be dumped as a Chrome trace
+ * (chrome://tracing, Perfetto).
+ *
+ * GPU queries are double-buffered: results of frame N are read at the start
+ * of frame N + 2 if they are available, and dropped otherwise, so the
+ * profiler never waits on the GPU (unless setWaitForGpu(), for benchmarks
+ * that need the GPU time of every frame, see gpuFrameMs()).
+ *
+ * CPU scopes may be opened on any thread, they are credited to the render
+ * thread's current frame and get their own trace row per thread. GPU zones
+ * and the frame boundaries belong to the render thread.
+ *
+ * Use the PROFILE_* macros only, configuring with -DENABLE_PROFILER=OFF
+ * compiles all of them to nothing.
+ */
+
+#ifdef OCEAN_PROFILER
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Profiler {
+public:
+  using Clock = std::chrono::high_resolution_clock;
+
+  static Profiler &instance();
+
+  void beginFrame();
+  void endFrame();
+  void addCpuSample(const char *name, Clock::time_point start,
+                    Clock::time_point end);
+  // False, and nothing to end, when another GPU zone is already open
+  bool gpuBegin(const char *name);
+  void gpuEnd();
+
+  // Frames ended so far, the index of the frame in progress
+  size_t frame() const;
+  // Read every GPU result back, blocking if it is not ready yet
+  void setWaitForGpu(bool wait);
+  // Resolve the GPU zones of the frames still in flight
+  void flushGpu();
+  // Sum of the GPU zones of frame, false until it is resolved, once it is
+  // older than kGpuHistory frames, or if any of its zones was dropped
+  bool gpuFrameMs(size_t frame, double &ms) const;
+
+  void report(std::ostream &os);
+  bool dumpChromeTrace(const std::string &filename) const;
+
+private:
+  static constexpr size_t kStatWindow = 240;   /* frames of history */
+  static constexpr size_t kTraceEvents = 16384; /* ring of trace events */
+  static constexpr size_t kGpuFrames = 2;      /* frames in flight */
+  static constexpr size_t kGpuHistory = 8;     /* frames of GPU totals */
+
+  struct Zone {
+    const char *name;
+    bool gpu;
+    double frame_ms = 0.0; /* accumulated during the current frame */
+    bool hit = false;      /* ran during the current frame */
+    std::array<float, kStatWindow> samples{};
+    size_t count = 0;       /* frames it ran in */
+    size_t first_frame = 0; /* in which it first ran */
+  };
+  struct TraceEvent {
+    int zone;
+    int tid; /* trace row */
+    double start_us;
+    double duration_us;
+  };
+  struct GpuSample {
+    int zone;
+    unsigned query;
+    double start_us;
+  };
+  struct GpuFrame {
+    size_t frame = SIZE_MAX;
+    double ms = 0.0;
+    bool complete = false;
+  };
+
+  Profiler();
+  int zoneIndex(const char *name, bool gpu);
+  double sinceStart(Clock::time_point t) const;
+  void addTraceEvent(int zone, int tid, double start_us, double duration_us);
+  void resolveGpuFrame(size_t frame);
+
+  mutable std::mutex mutex_;
+  std::thread::id render_thread_; /* the caller of beginFrame() */
+  Clock::time_point start_;
+  size_t frame_ = 0;
+  std::vector<Zone> zones_;
+  std::vector<TraceEvent> trace_;
+  size_t trace_next_ = 0;
+  std::array<std::vector<GpuSample>, kGpuFrames> gpu_pending_;
+  std::array<std::vector<unsigned>, kGpuFrames> gpu_queries_;
+  std::array<GpuFrame, kGpuHistory> gpu_frames_;
+  bool wait_for_gpu_ = false;
+  int gpu_open_ = -1; /* GL_TIME_ELAPSED zones cannot nest */
+  bool gpu_nesting_reported_ = false;
+  size_t gpu_dropped_ = 0;
+};
+
+class ProfileCpuScope {
+public:
+  explicit ProfileCpuScope(const char *name)
+      : name_(name), start_(Profiler::Clock::now()) {}
+  ~ProfileCpuScope() {
+    Profiler::instance().addCpuSample(name_, start_, Profiler::Clock::now());
+  }
+
+private:
+  const char *name_;
+  Profiler::Clock::time_point start_;
+};
+
+class ProfileGpuScope {
+public:
+  explicit ProfileGpuScope(const char *name)
+      : opened_(Profiler::instance().gpuBegin(name)) {}
+  ~ProfileGpuScope() {
+    // A nested scope leaves the zone it is nested in open
+    if (opened_) {
+      Profiler::instance().gpuEnd();
+    }
+  }
+
+private:
+  bool opened_;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_CPU_SCOPE(name)                                                \
+  ProfileCpuScope PROFILE_CONCAT(profile_cpu_scope_, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name)                                                \
+  ProfileGpuScope PROFILE_CONCAT(profile_gpu_scope_, __LINE__)(name)
+#define PROFILE_BEGIN_FRAME() Profiler::instance().beginFrame()
+#define PROFILE_END_FRAME() Profiler::instance().endFrame()
+#define PROFILE_REPORT(os) Profiler::instance().report(os)
+#define PROFILE_DUMP_TRACE(filename)                                           \
+  Profiler::instance().dumpChromeTrace(filename)
+
+#else
+
+#define PROFILE_CPU_SCOPE(name)                                                \
+  do {                                                                         \
+  } while (0)
+#define PROFILE_GPU_SCOPE(name)                                                \
+  do {                                                                         \
+  } while (0)
+#define PROFILE_BEGIN_FRAME()                                                  \
+  do {                                                                         \
+  } while (0)
+#define PROFILE_END_FRAME()                                                    \
+  do {                                                                         \
+  } while (0)
+#define PROFILE_REPORT(os)                                                     \
+  do {                                                                         \
+  } while (0)
+#define PROFILE_DUMP_TRACE(filename) ((void)(filename), false)
+
+#endif
@@ -1,19 +1,23 @@
 #pragma once
 
 #include "render_pass.h"
-#include <chrono>
+#include "render_queue.h"
+#include <functional>
 
+// Draws the rain drops the simulation moves, one instanced line per drop
 class RainRender {
 public:
-  RainRender(size_t rows, size_t cols, std::vector<ShaderUniform> uniforms);
+  RainRender(const std::vector<glm::vec3> &drops,
+             std::vector<ShaderUniform> uniforms);
 
-  void update(bool draw);
+  // Uploads drops and queues them as transparent lines around the camera.
+  // drops must have as many entries as the constructor was given
+  void submit(const std::vector<glm::vec3> &drops, RenderQueue &queue);
 
 private:
-  void move_particles(float time_delta);
+  void draw();
 
-  std::vector<glm::vec3> rain_points_;
+  size_t drop_count_;
   std::unique_ptr<RenderPass> rain_pass_;
-  std::chrono::high_resolution_clock::time_point prev =
-      std::chrono::high_resolution_clock::now();
+  std::function<void()> draw_rain_;
 };
@@ -1,4 +1,6 @@
 #include "render_pass.h"
+#include "gl_state.h"
+#include "profiler.h"
 #include <GL/glew.h>
 #include <debuggl.h>
 #include <iostream>
@@ -31,15 +33,15 @@ RenderDataInput::RenderDataInput() {}
 RenderPass::RenderPass(
     int vao, // -1: create new VAO, otherwise use given VAO
     const RenderDataInput &input,
-    const std::vector<const char *> shaders, // Order: VS, GS, FS, TCS, TES
-    const std::vector<ShaderUniform> uniforms,
-    const std::vector<const char *> output // Order: 0, 1, 2...
+    const std::vector<const char *> &shaders, // Order: VS, GS, FS, TCS, TES
+    const std::vector<ShaderUniform> &uniforms,
+    const std::vector<const char *> &output // Order: 0, 1, 2...
     )
     : vao_(vao), input_(input), uniforms_(uniforms) {
   if (vao_ < 0) {
     CHECK_GL_ERROR(glGenVertexArrays(1, (GLuint *)&vao_));
   }
-  CHECK_GL_ERROR(glBindVertexArray(vao_));
+  GLState::instance().bindVertexArray(vao_);
 
   // Program first
   vs_ = compileShader(shaders[0], GL_VERTEX_SHADER);
@@ -66,7 +68,7 @@ RenderPass::RenderPass(
   glbuffers_.resize(nbuffer);
   CHECK_GL_ERROR(glGenBuffers(nbuffer, glbuffers_.data()));
   for (int i = 0; i < input.getNBuffers(); i++) {
-    auto meta = input.getBufferMeta(i);
+    const auto &meta = input.getBufferMeta(i);
     CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER, glbuffers_[i]));
     CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER,
                                 meta.getElementSize() * meta.nelements,
@@ -94,7 +96,7 @@ RenderPass::RenderPass(
   CHECK_GL_PROGRAM_ERROR(sp_);
 
   if (input.hasIndex()) {
-    auto meta = input.getIndexMeta();
+    const auto &meta = input.getIndexMeta();
     CHECK_GL_ERROR(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glbuffers_.back()));
     CHECK_GL_ERROR(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                                 meta.getElementSize() * meta.nelements,
@@ -195,23 +197,29 @@ void RenderPass::createMaterialTexture() {
     int w = ma.texture->width;
     int h = ma.texture->height;
     // TODO: enable stride
-    // Translate RGB to RGBA for alignment
-    std::vector<unsigned int> dummy(w * h);
-    const unsigned char *bytes = ma.texture->bytes.data();
-    for (int row = 0; row < h; row++) {
-      for (int col = 0; col < w; col++) {
-        unsigned r = bytes[row * w * 3 + col * 3];
-        unsigned g = bytes[row * w * 3 + col * 3 + 1];
-        unsigned b = bytes[row * w * 3 + col * 3 + 1];
-        dummy[row * w + col] = r | (g << 8) | (b << 16) | (0xFF << 24);
+    // RGBA images (LoadJPEG with 4 channels) upload as is, RGB ones are
+    // translated to RGBA for alignment
+    std::vector<unsigned int> dummy;
+    const void *pixels = ma.texture->bytes.data();
+    if (ma.texture->channels != 4) {
+      dummy.resize(w * h);
+      const unsigned char *bytes = ma.texture->bytes.data();
+      for (int row = 0; row < h; row++) {
+        for (int col = 0; col < w; col++) {
+          unsigned r = bytes[row * w * 3 + col * 3];
+          unsigned g = bytes[row * w * 3 + col * 3 + 1];
+          unsigned b = bytes[row * w * 3 + col * 3 + 2];
+          dummy[row * w + col] = r | (g << 8) | (b << 16) | (0xFF << 24);
+        }
       }
+      pixels = dummy.data();
     }
     GLuint tex = 0;
     CHECK_GL_ERROR(glGenTextures(1, &tex));
     CHECK_GL_ERROR(glBindTexture(GL_TEXTURE_2D, tex));
     CHECK_GL_ERROR(glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, w, h));
     CHECK_GL_ERROR(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA,
-                                   GL_UNSIGNED_BYTE, dummy.data()));
+                                   GL_UNSIGNED_BYTE, pixels));
     // CHECK_GL_ERROR(glPixelStorei(GL_UNPACK_ROW_LENGTH, 0));
     std::cerr << __func__ << " load data into texture " << tex << " dim: " << w
               << " x " << h << std::endl;
@@ -235,7 +243,7 @@ RenderPass::~RenderPass() {
 void RenderPass::updateVBO(int position, const void *data, size_t size) {
   int bufferid = -1;
   for (int i = 0; i < input_.getNBuffers(); i++) {
-    auto meta = input_.getBufferMeta(i);
+    const auto &meta = input_.getBufferMeta(i);
     if (meta.position == position) {
       bufferid = i;
       break;
@@ -244,17 +252,29 @@ void RenderPass::updateVBO(int position, const void *data, size_t size) {
   if (bufferid < 0)
     throw __func__ + std::string(": error, can't find buffer with position ") +
         std::to_string(position);
-  auto meta = input_.getBufferMeta(bufferid);
+  const auto &meta = input_.getBufferMeta(bufferid);
   CHECK_GL_ERROR(glBindBuffer(GL_ARRAY_BUFFER, glbuffers_[bufferid]));
   CHECK_GL_ERROR(glBufferData(GL_ARRAY_BUFFER, size * meta.getElementSize(),
                               data, GL_STATIC_DRAW));
 }
 
+void RenderPass::updateIndex(const void *data, size_t size) {
+  if (!input_.hasIndex())
+    throw __func__ + std::string(": error, render pass has no index buffer");
+  const auto &meta = input_.getIndexMeta();
+  // The element array binding is part of the VAO state
+  GLState::instance().bindVertexArray(vao_);
+  CHECK_GL_ERROR(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, glbuffers_.back()));
+  CHECK_GL_ERROR(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                              size * meta.getElementSize(), data,
+                              GL_STATIC_DRAW));
+}
+
 void RenderPass::setup() {
-  // Switch to our object VAO.
-  CHECK_GL_ERROR(glBindVertexArray(vao_));
-  // Use our program.
-  CHECK_GL_ERROR(glUseProgram(sp_));
+  // Switch to our object VAO and program, unless they are still bound
+  auto &gl = GLState::instance();
+  gl.bindVertexArray(vao_);
+  gl.useProgram(sp_);
 
   bindUniforms(uniforms_, unilocs_);
 }
@@ -278,12 +298,14 @@ bool RenderPass::renderWithMaterial(int mid) {
 
 void RenderPass::bindUniforms(std::vector<ShaderUniform> &uniforms,
                               const std::vector<unsigned> &unilocs) {
+  PROFILE_CPU_SCOPE("uniform binding");
   for (size_t i = 0; i < uniforms.size(); i++) {
     const auto &uni = uniforms[i];
     // std::cerr << "binding " << uni.name << " to " << unilocs[i] << std::endl;
     auto ptr = uni.data_source();
     CHECK_GL_ERROR(uni.binder(unilocs[i], ptr));
   }
+  GLState::instance().countCalls(uniforms.size());
 }
 
 unsigned RenderPass::compileShader(const char *source_ptr, int type) {
@@ -96,9 +96,9 @@ public:
   void useMaterials(const std::vector<Material> &);
 
   int getNBuffers() const { return int(meta_.size()); }
-  RenderInputMeta getBufferMeta(int i) const { return meta_[i]; }
+  const RenderInputMeta &getBufferMeta(int i) const { return meta_[i]; }
   bool hasIndex() const { return has_index_; }
-  RenderInputMeta getIndexMeta() const { return index_meta_; }
+  const RenderInputMeta &getIndexMeta() const { return index_meta_; }
 
   bool hasMaterial() const { return !materials_.empty(); }
   size_t getNMaterials() const { return materials_.size(); }
@@ -128,14 +128,20 @@ public:
   RenderPass(
       int vao, // -1: create new VAO, otherwise use given VAO
       const RenderDataInput &input,
-      const std::vector<const char *> shaders, // Order: VS, GS, FS, TCS, TES
-      const std::vector<ShaderUniform> uniforms,
-      const std::vector<const char *> output // Order: 0, 1, 2...
+      const std::vector<const char *> &shaders, // Order: VS, GS, FS, TCS, TES
+      const std::vector<ShaderUniform> &uniforms,
+      const std::vector<const char *> &output // Order: 0, 1, 2...
   );
   ~RenderPass();
 
   unsigned getVAO() const { return unsigned(vao_); }
+  unsigned getProgram() const { return sp_; }
   void updateVBO(int position, const void *data, size_t nelement);
+  /*
+   * updateIndex: replace the contents of the index buffer, the element
+   * must match the element_length given to assignIndex.
+   */
+  void updateIndex(const void *data, size_t nelement);
   void setup();
   /*
    * Note: here we don't have an unified render() function, because the
@@ -0,0 +1,62 @@
+#include "render_queue.h"
+
+#include "config.h"
+#include "gl_state.h"
+#include <GL/glew.h>
+#include <algorithm>
+
+void RenderQueue::submit(Layer layer, float depth, const RenderState &state,
+                         const RenderPass &pass,
+                         const std::function<void()> *draw) {
+  uint64_t key = makeKey(layer, depth, pass.getProgram(), pass.getVAO(),
+                         items_.size());
+  items_.push_back({key, state, draw});
+}
+
+void RenderQueue::flush() {
+  std::sort(items_.begin(), items_.end(),
+            [](const Item &a, const Item &b) { return a.key < b.key; });
+  auto &gl = GLState::instance();
+  for (const auto &item : items_) {
+    gl.setEnabled(GL_BLEND, item.state.blend);
+    gl.setEnabled(GL_CULL_FACE, item.state.cull);
+    gl.setEnabled(GL_LINE_SMOOTH, item.state.line_smooth);
+    gl.depthMask(item.state.depth_write);
+    (*item.draw)();
+    gl.countCalls(1);
+  }
+  // Leave depth writes on for the next glClear
+  gl.depthMask(true);
+  items_.clear();
+}
+
+float RenderQueue::boxDepth(const glm::mat4 &view, const glm::vec3 &lo,
+                           const glm::vec3 &hi) {
+  if (lo.x > hi.x) {
+    return 0.0f;
+  }
+  float nearest = kFar;
+  float farthest = 0.0f;
+  for (int corner = 0; corner < 8; corner++) {
+    auto p = glm::vec4{(corner & 1) ? hi.x : lo.x, (corner & 2) ? hi.y : lo.y,
+                       (corner & 4) ? hi.z : lo.z, 1.0f};
+    // The camera looks down -z
+    float depth = -(view * p).z;
+    nearest = std::min(nearest, depth);
+    farthest = std::max(farthest, depth);
+  }
+  return 0.5f * (std::max(nearest, 0.0f) + std::max(farthest, 0.0f));
+}
+
+uint64_t RenderQueue::makeKey(Layer layer, float depth, unsigned program,
+                              unsigned vao, size_t sequence) {
+  constexpr uint64_t kDepthMax = (1u << 24) - 1;
+  uint64_t quantized =
+      uint64_t(std::min(std::max(depth / kFar, 0.0f), 1.0f) * kDepthMax);
+  if (layer == Layer::Transparent) {
+    quantized = kDepthMax - quantized;
+  }
+  return uint64_t(layer) << 62 | quantized << 38 |
+         uint64_t(program & 0xFFFF) << 22 | uint64_t(vao & 0xFFF) << 10 |
+         uint64_t(sequence & 0x3FF);
+}
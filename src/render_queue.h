@@ -0,0 +1,66 @@
+#pragma once
+
+#include "render_pass.h"
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Fixed function state of one draw, applied through GLState
+struct RenderState {
+  bool blend = false;
+  bool depth_write = true;
+  bool cull = true;
+  bool line_smooth = false;
+};
+
+/*
+ * The draws of one frame. Renderers submit them in any order, flush() sorts
+ * them by a 64 bit key and issues them with only the state changes the
+ * sorted order needs:
+ *
+ *   bits 62-63  layer: background, opaque, transparent
+ *   bits 38-61  view depth of the draw's bounds (see boxDepth), front to
+ *               back for opaque draws and back to front for transparent
+ *               ones
+ *   bits 22-37  program
+ *   bits 10-21  VAO
+ *   bits  0-9   submission order, so equal keys keep theirs
+ *
+ * Each draw callback sets up its pass and issues one draw call. Callbacks
+ * are passed and kept by pointer, so they must outlive the frame (members
+ * or locals of the render loop, never temporaries).
+ */
+class RenderQueue {
+public:
+  enum class Layer { Background, Opaque, Transparent };
+
+  explicit RenderQueue(size_t capacity = 32) { items_.reserve(capacity); }
+
+  // depth is the view depth of the draw, used to order its layer. Only the
+  // pointer is kept, draw must stay alive until flush().
+  void submit(Layer layer, float depth, const RenderState &state,
+              const RenderPass &pass, const std::function<void()> *draw);
+  void flush();
+
+  /**
+   * The view depth to submit a draw inside the box [lo, hi] with: the middle
+   * of the depths its corners span in front of the camera. A draw that fills
+   * the screen out to the horizon sorts behind a small one close by, even
+   * though both start right in front of the camera. 0 for an empty box.
+   */
+  static float boxDepth(const glm::mat4 &view, const glm::vec3 &lo,
+                        const glm::vec3 &hi);
+
+private:
+  struct Item {
+    uint64_t key;
+    RenderState state;
+    const std::function<void()> *draw;
+  };
+
+  static uint64_t makeKey(Layer layer, float depth, unsigned program,
+                          unsigned vao, size_t sequence);
+
+  std::vector<Item> items_;
+};
@@ -0,0 +1,41 @@
+#include "shader_variants.h"
+
+#include <cstring>
+#include <map>
+
+namespace {
+
+std::map<std::pair<const char *, std::string>, std::string> variants;
+}
+
+const char *shaderVariant(const char *source, const ShaderDefines &defines) {
+  if (defines.empty()) {
+    return source;
+  }
+  std::string block;
+  for (const auto &define : defines) {
+    block += "#define " + define.first + " " + define.second + "\n";
+  }
+  auto key = std::make_pair(source, block);
+  auto iter = variants.find(key);
+  if (iter != variants.end()) {
+    return iter->second.c_str();
+  }
+
+  // #version has to stay the first directive, the defines go after it
+  const char *split = source;
+  int line = 1;
+  if (const char *version = std::strstr(source, "#version")) {
+    const char *end = std::strchr(version, '\n');
+    split = end ? end + 1 : version + std::strlen(version);
+    for (const char *c = source; c < split; c++) {
+      line += *c == '\n';
+    }
+  }
+  std::string text(source, split);
+  if (text.empty() || text.back() != '\n') {
+    text += "\n";
+  }
+  text += block + "#line " + std::to_string(line) + "\n" + split;
+  return variants.emplace(key, std::move(text)).first->second.c_str();
+}
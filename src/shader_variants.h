@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// #define name and value of one shader permutation, in the order given
+using ShaderDefines = std::vector<std::pair<std::string, std::string>>;
+
+/*
+ * Shader permutations of the raw-string shaders: returns source with the
+ * defines inserted after its #version line (and a #line so compile errors
+ * still point at the original lines). Variants are built once and kept for
+ * the life of the program, so equal source and defines give the same
+ * pointer and RenderPass compiles each variant once. GL thread only.
+ */
+const char *shaderVariant(const char *source, const ShaderDefines &defines);
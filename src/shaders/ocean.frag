@@ -2,7 +2,7 @@ R"zzz(
 #version 430 core
 uniform vec3 center_position;
 uniform vec3 camera_position;
-uniform float time_of_day;
+uniform sampler2D atmosphere;
 uniform bool is_raining;
 in vec4 face_normal;
 in vec4 light_direction;
@@ -10,40 +10,32 @@ in vec4 world_position;
 in vec4 camera_direction;
 flat in vec3 offset;
 out vec4 fragment_color;
+#ifndef FOG
+#define FOG 1
+#endif
 
 const float fog_near_plane = 60.0f;
 const float fog_far_plane = 70.0f;
 const float transparency_scale = 20.0f;
 
-vec4 calculateSkyColor() {
-  if (is_raining) {
-    vec4 light_gray = vec4(0.66f, 0.66f, 0.66f, 1.0f);
-    vec4 dark_gray = vec4(0, 0, 0, 1.0f);
-    if (time_of_day < 300.0f || time_of_day > 1140.0f) { // Before 5 AM, After 7 PM
-      return dark_gray;
-    } else {
-      float scale = pow(abs(720.0f - time_of_day) / 420.0f, 2.0f);
-      return mix(light_gray, dark_gray, scale);
-    }
-  } else {
-    vec4 dark = vec4(0.1f, 0.1f, 0.3f, 1.0f);
-    vec4 bright_blue = vec4(0.53f, 0.81f, 0.92f, 1.0f);
-    if (time_of_day < 300.0f || time_of_day > 1140.0f) { // Before 5 AM, After 7 PM
-      return dark;
-    } else {
-      float scale = pow(abs(720.0f - time_of_day) / 420.0f, 2.0f);
-      return mix(bright_blue, dark, scale);
-    }
-  }
+// Atmosphere LUT: view elevation across, clear and stormy rows
+vec4 skyColor(float elevation) {
+  float width = float(textureSize(atmosphere, 0).x);
+  float u = (elevation * 0.5f + 0.5f) * (width - 1.0f) / width + 0.5f / width;
+  return texture(atmosphere, vec2(u, is_raining ? 0.75f : 0.25f));
 }
 
 vec4 processFog(in vec3 color) {
+  float transparency = 0.9f;
+#if FOG
   float dist = distance(world_position.xz, camera_position.xz);
 	float fog_coefficient = (fog_far_plane - dist) / (fog_far_plane - fog_near_plane);
 	fog_coefficient = clamp(fog_coefficient, 0.0f, 1.0f);
-	vec4 fog_color = calculateSkyColor();
-  float transparency = 0.9f;
+	vec4 fog_color = skyColor(normalize(world_position.xyz - camera_position).y);
 	return mix(fog_color, vec4(color, transparency), fog_coefficient);
+#else
+  return vec4(color, transparency);
+#endif
 }
 
 void main() {
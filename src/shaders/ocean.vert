@@ -1,14 +1,14 @@
 R"zzz(
 #version 430 core
 in vec4 vertex_position;
-in vec3 offset;
+in vec4 patch_rect;
 out vec3 off;
 
 void main() {
+	// Unit quad scaled to the patch (x, z, width, depth)
 	vec3 pos = vertex_position.xyz;
-	pos.x += offset.x;
-	pos.z += offset.z;
+	pos.xz = patch_rect.xy + pos.xz * patch_rect.zw;
 	gl_Position = vec4(pos, 1.0f);
-	off = offset;
+	off = vec3(patch_rect.x, 0.0f, patch_rect.y);
 }
 )zzz"
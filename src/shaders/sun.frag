@@ -1,9 +1,14 @@
-R"zzz(#version 400 core
-uniform float time_of_day;
+R"zzz(#version 430 core
+uniform vec4 sun_color;
+smooth in vec2 corner;
 out vec4 fragment_color;
 void main()
 {
-  // TODO: maybe scale the color based on time of day?
-  fragment_color = vec4(0.98, 0.83, 0.25, 1.0);
+  // Screen aligned quad, cut to a disc with a soft edge
+  float radius = length(corner);
+  if (radius > 1.0f) {
+    discard;
+  }
+  fragment_color = vec4(sun_color.rgb, 1.0f - smoothstep(0.9f, 1.0f, radius));
 }
 )zzz"
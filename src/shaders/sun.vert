@@ -1,7 +1,14 @@
-R"zzz(#version 400 core
-in vec4 vertex_position;
+R"zzz(#version 430 core
+uniform mat4 projection;
+uniform mat4 view;
+uniform vec4 light_position;
+// Same size as the tessellated sphere this replaces
+const float kSunRadius = 2.0f;
+smooth out vec2 corner;
 void main()
 {
-  gl_Position = vertex_position;
+  corner = vec2((gl_VertexID & 2) >> 1, 1 - (gl_VertexID & 1)) * 2.0 - 1.0;
+  vec4 center = view * vec4(light_position.xyz, 1.0f);
+  gl_Position = projection * vec4(center.xy + corner * kSunRadius, center.zw);
 }
 )zzz"
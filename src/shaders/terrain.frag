@@ -2,7 +2,7 @@ R"zzz(
 #version 430 core
 uniform vec3 center_position;
 uniform vec3 camera_position;
-uniform float time_of_day;
+uniform sampler2D atmosphere;
 uniform bool is_raining;
 in vec4 normal;
 in vec4 light_direction;
@@ -10,87 +10,30 @@ in vec4 world_position;
 in vec4 camera_direction;
 flat in vec3 offset;
 out vec4 fragment_color;
+#ifndef FOG
+#define FOG 1
+#endif
 
 const float kPi = 3.1415926535897932384626433832795f;
 const float fog_near_plane = 60.0f;
 const float fog_far_plane = 70.0f;
 
-float fade(float t) {
-  return 6 * pow(t, 5) - 15 * pow(t, 4) + 10 * pow(t, 3);
-}
-
-vec4 calculateSkyColor() {
-  if (is_raining) {
-    vec4 light_gray = vec4(0.66f, 0.66f, 0.66f, 1.0f);
-    vec4 dark_gray = vec4(0, 0, 0, 1.0f);
-    if (time_of_day < 300.0f || time_of_day > 1140.0f) { // Before 5 AM, After 7 PM
-      return dark_gray;
-    } else {
-      float scale = pow(abs(720.0f - time_of_day) / 420.0f, 2.0f);
-      return mix(light_gray, dark_gray, scale);
-    }
-  } else {
-    vec4 dark = vec4(0.1f, 0.1f, 0.3f, 1.0f);
-    vec4 bright_blue = vec4(0.53f, 0.81f, 0.92f, 1.0f);
-    if (time_of_day < 300.0f || time_of_day > 1140.0f) { // Before 5 AM, After 7 PM
-      return dark;
-    } else {
-      float scale = pow(abs(720.0f - time_of_day) / 420.0f, 2.0f);
-      return mix(bright_blue, dark, scale);
-    }
-  }
+// Atmosphere LUT: view elevation across, clear and stormy rows
+vec4 skyColor(float elevation) {
+  float width = float(textureSize(atmosphere, 0).x);
+  float u = (elevation * 0.5f + 0.5f) * (width - 1.0f) / width + 0.5f / width;
+  return texture(atmosphere, vec2(u, is_raining ? 0.75f : 0.25f));
 }
 
 vec4 processFog(in vec3 color) {
+#if FOG
 	float fog_coefficient = (fog_far_plane - distance(world_position.xz, camera_position.xz)) / (fog_far_plane - fog_near_plane);
 	fog_coefficient = clamp(fog_coefficient, 0.0f, 1.0f);
-	vec4 fog_color = calculateSkyColor();
+	vec4 fog_color = skyColor(normalize(world_position.xyz - camera_position).y);
 	return mix(fog_color, vec4(color, 1.0f), fog_coefficient);
-}
-
-float random(vec2 co) {
-	return fract(sin(dot(co, vec2(12.9898,78.233))) * 43758.5453);
-}
-
-vec2 randUnitVec(vec2 xz) {
-	float angle = random(xz) * 2 * kPi;
-	return normalize(vec2(cos(angle), sin(angle)));
-}
-
-float dotGridGradient(int iu, int iv, float u, float v) {
-	// Generate seeded random unit gradient vector
-	vec2 unit_gradient = randUnitVec(vec2(iu, iv));
-
-	// Compute distance vector
-	float du = u - float(iu);
-	float dv = v - float(iv);
-
-	// Return dot product
-	return (du * unit_gradient[0] + dv * unit_gradient[1]);
-}
-
-float perlin(float u, float v) {
-	// Get coordinates of unit cell
-	int u0 = int(floor(u));
-	int u1 = u0 + 1;
-	int v0 = int(floor(v));
-	int v1 = v0 + 1;
-
-	// Interpolation weights
-	float wt_u = fade(u - float(u0));
-	float wt_v = fade(v - float(v0));
-
-	// Interpolate between grid point gradients
-	float n0, n1, iu0, iu1, value;
-	n0 = dotGridGradient(u0, v0, u, v);
-	n1 = dotGridGradient(u1, v0, u, v);
-	iu0 = mix(n0, n1, wt_u);
-	n0 = dotGridGradient(u0, v1, u, v);
-	n1 = dotGridGradient(u1, v1, u, v);
-	iu1 = mix(n0, n1, wt_u);
-	value = mix(iu0, iu1, wt_v);
-
-	return value;
+#else
+	return vec4(color, 1.0f);
+#endif
 }
 
 float mod289(float x){return x - floor(x * (1.0 / 289.0)) * 289.0;}
@@ -0,0 +1,96 @@
+R"zzz(#version 430 core
+uniform mat4 projection;
+uniform mat4 model;
+uniform mat4 view;
+uniform vec4 light_position;
+uniform vec3 camera_position;
+in vec4 vertex_position;
+in vec4 vertex_normal;
+in vec3 coarse_normal;
+out vec4 normal;
+out vec4 light_direction;
+out vec4 camera_direction;
+out vec4 world_position;
+flat out vec3 offset;
+
+const float kPi = 3.1415926535897932384626433832795f;
+// Must match clipmap_render.cc
+const float kHalfExtent = 32.0f; // kClipmapGrid / 2 * kClipmapSpacing
+const float kMorphStart = 0.65f;
+const float kMorphEnd = 0.9f;
+
+uniform uint noise_seed;
+
+// Port of perlin::gradientNoise (perlin.hpp), keep the two in sync. The same
+// operations in the same order, with precise to rule out fused multiply-adds,
+// give the same values as the C++ version.
+uint hashLattice(int ix, int iz, uint seed) {
+  uint h = seed ^ (uint(ix) * 0x8da6b343u);
+  h ^= uint(iz) * 0xd8163841u;
+  h ^= h >> 16;
+  h *= 0x7feb352du;
+  h ^= h >> 15;
+  h *= 0x846ca68bu;
+  h ^= h >> 16;
+  return h;
+}
+
+const float kGradientX[8] = float[8](1.0f, -1.0f, 0.0f, 0.0f, 0.70710678f,
+                                     0.70710678f, -0.70710678f, -0.70710678f);
+const float kGradientZ[8] = float[8](0.0f, 0.0f, 1.0f, -1.0f, 0.70710678f,
+                                     -0.70710678f, 0.70710678f, -0.70710678f);
+
+float latticeGradient(uint hash, float dx, float dz) {
+  precise float value = dx * kGradientX[hash & 7u] + dz * kGradientZ[hash & 7u];
+  return value;
+}
+
+float smootherstep(float t) {
+  precise float value = t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+  return value;
+}
+
+float lerpNoise(float a, float b, float t) {
+  precise float value = a + (b - a) * t;
+  return value;
+}
+
+float gradientNoise(float x, float z, uint seed) {
+  int x0 = int(floor(x));
+  int z0 = int(floor(z));
+  precise float fx = x - float(x0);
+  precise float fz = z - float(z0);
+  float n00 = latticeGradient(hashLattice(x0, z0, seed), fx, fz);
+  float n10 = latticeGradient(hashLattice(x0 + 1, z0, seed), fx - 1.0f, fz);
+  float n01 = latticeGradient(hashLattice(x0, z0 + 1, seed), fx, fz - 1.0f);
+  float n11 =
+      latticeGradient(hashLattice(x0 + 1, z0 + 1, seed), fx - 1.0f, fz - 1.0f);
+  float wt_x = smootherstep(fx);
+  float wt_z = smootherstep(fz);
+  return lerpNoise(lerpNoise(n00, n10, wt_x), lerpNoise(n01, n11, wt_x), wt_z);
+}
+
+// Blend factor towards the next coarser level, 1 at the edge of the ring
+float morphFactor(float level) {
+  float extent = kHalfExtent * exp2(level);
+  vec2 d = abs(vertex_position.xz - camera_position.xz);
+  float dist = max(d.x, d.y);
+  return clamp((dist - kMorphStart * extent) / ((kMorphEnd - kMorphStart) * extent), 0.0f, 1.0f);
+}
+
+void main() {
+  float morph = morphFactor(vertex_normal.w);
+  vec4 position = vec4(vertex_position.x,
+                       mix(vertex_position.y, vertex_position.w, morph),
+                       vertex_position.z, 1.0f);
+
+  light_direction = vec4(normalize(light_position.xyz - position.xyz), 1.0f);
+  camera_direction = vec4(normalize(camera_position - position.xyz), 1.0f);
+  world_position = position;
+  gl_Position = projection * view * model * position;
+  vec3 perlin_normal = normalize(mix(vertex_normal.xyz, coarse_normal, morph));
+  perlin_normal.y += gradientNoise(position.x, position.z, noise_seed) * 0.8f;
+  normal = vec4(normalize(perlin_normal), 0.0f);
+  offset = vec3(vertex_position.x, 0.0f, vertex_position.z);
+}
+)zzz"
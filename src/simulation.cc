@@ -0,0 +1,192 @@
+#include "simulation.h"
+
+#include "alloc_counter.h"
+#include "bench.h"
+#include "config.h"
+#include "profiler.h"
+#include "world/frame_arena.h"
+#include "world/rain.h"
+#include <cmath>
+#include <glm/gtc/type_ptr.hpp>
+
+Simulation::Simulation(World &world, GUI &gui, InputLog &input_log,
+                       const CameraPath *path, bool fixed_clock,
+                       int max_frames, Clock::time_point start)
+    : world_(world), gui_(gui), input_log_(input_log), path_(path),
+      fixed_clock_(fixed_clock), max_frames_(max_frames), start_(start),
+      rain_(spawnRainDrops(world.heightfield().rows(),
+                           world.heightfield().cols(), world.seed())) {
+  input_.reserve(256);
+  if (!fixed_clock_) {
+    time_ = std::chrono::duration<double>(Clock::now() - start_).count();
+  }
+}
+
+Simulation::~Simulation() { stop(); }
+
+void Simulation::start() {
+  running_ = true;
+  thread_ = std::thread([this]() { run(); });
+}
+
+void Simulation::stop() {
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    running_ = false;
+  }
+  wake_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+const FrameSnapshot *Simulation::nextFrame() {
+  if (!frames_.acquire()) {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    wake_.wait(lock, [this]() {
+      return frames_.hasUnread() || finished_ || !running_;
+    });
+    lock.unlock();
+    if (!frames_.acquire()) {
+      return nullptr;
+    }
+  }
+  // The simulation may be waiting for this slot to free up
+  wake();
+  return &frames_.readBuffer();
+}
+
+void Simulation::run() {
+  allocations_ = alloc_counter::threadAllocations();
+  while (running_ && (max_frames_ <= 0 || frame_ < max_frames_)) {
+    step(frames_.writeBuffer());
+    {
+      std::unique_lock<std::mutex> lock(wake_mutex_);
+      wake_.wait(lock, [this]() { return !frames_.hasUnread() || !running_; });
+    }
+    frames_.publish();
+    wake();
+    frame_++;
+  }
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    finished_ = true;
+  }
+  wake_.notify_all();
+}
+
+void Simulation::wake() {
+  // Taking the mutex orders this after the other thread's predicate check,
+  // so the notification cannot fall between its check and its wait
+  { std::lock_guard<std::mutex> lock(wake_mutex_); }
+  wake_.notify_all();
+}
+
+/**
+ * Everything that used to run on the render thread before its draws, in the
+ * same order, ending with the input polled during the frame.
+ */
+void Simulation::step(FrameSnapshot &frame) {
+  PROFILE_CPU_SCOPE("simulation");
+  double previous_time = time_;
+  if (fixed_clock_) {
+    time_ = frame_ * double(BenchRecorder::kStep);
+  } else {
+    time_ = std::chrono::duration<double>(Clock::now() - start_).count();
+  }
+  float time_delta = float(time_ - previous_time);
+
+  if (path_) {
+    float path_time = frame_ * BenchRecorder::kStep;
+    glm::vec3 center, look;
+    path_->sample(path_time, center, look);
+    gui_.setPose(center, look);
+    gui_.setRaining(path_->isStormy(path_time));
+  }
+  // One minute of the day per second
+  gui_.incrementTimeOfDay(time_delta);
+  world_.advance(time_);
+
+  glm::vec3 boat_normal;
+  {
+    PROFILE_CPU_SCOPE("physics");
+    gui_.updatePosition();
+    boat_normal = world_.getWaveNormal(gui_.getCenter());
+  }
+  gui_.updateMatrices();
+  // Only the frames that rebuild count towards the zone
+  if (!world_.isCentered(gui_.getCamera())) {
+    PROFILE_CPU_SCOPE("terrain rebuild");
+    world_.recenter(gui_.getCamera());
+  }
+  {
+    PROFILE_CPU_SCOPE("rain");
+    moveRainDrops(rain_, time_delta);
+  }
+
+  float time_of_day = gui_.getTimeOfDay();
+  float angle = (time_of_day / gui_.kMaxTimeOfDay) * 2 * M_PI;
+  glm::vec4 light_vec_from_center =
+      SUN_RADIUS * glm::vec4{0.0f, -std::cos(angle), std::sin(angle), 0.0f};
+
+  frame.frame = frame_;
+  frame.time = float(time_);
+  frame.time_of_day = time_of_day;
+  frame.raining = gui_.isRaining();
+  frame.eye = gui_.getCamera();
+  frame.center = gui_.getCenter();
+  frame.prev_move = gui_.getPreviousMoveVec();
+  frame.boat_normal = boat_normal;
+  frame.light_position = light_vec_from_center + glm::vec4(frame.center, 1.0f);
+  auto mats = gui_.getMatrixPointers();
+  frame.model = glm::make_mat4(mats.model);
+  frame.view = glm::make_mat4(mats.view);
+  frame.projection = glm::make_mat4(mats.projection);
+  frame.inv_proj_view = glm::make_mat4(mats.inv_proj_view);
+  frame.waves = world_.waves().constants();
+  frame.rain = rain_;
+
+  // This slot may have missed rebuilds while it was with the other threads
+  const auto &field = world_.heightfield();
+  auto &terrain = frame.terrain;
+  if (terrain.version != world_.terrainVersion()) {
+    terrain.version = world_.terrainVersion();
+    terrain.x = field.cachedX();
+    terrain.z = field.cachedZ();
+    terrain.offsets = field.offsets();
+    terrain.heightVec = field.heightVec();
+    terrain.norm0 = field.norm0();
+    terrain.norm1 = field.norm1();
+    terrain.norm2 = field.norm2();
+    terrain.norm3 = field.norm3();
+  }
+
+  dispatchInput();
+  frame.actions = gui_.takeActions();
+  FrameArena::local().reset();
+  // The count is per thread, the render thread adds this to its own
+  size_t allocations = alloc_counter::threadAllocations();
+  frame.allocations = allocations - allocations_;
+  allocations_ = allocations;
+}
+
+/**
+ * Input polled by the render thread since the last step, stamped with this
+ * frame. A replay ignores it and dispatches the logged input instead.
+ */
+void Simulation::dispatchInput() {
+  gui_.takeInput(input_);
+  if (input_log_.mode() == InputLog::Mode::Replay) {
+    input_log_.replay(frame_, [this](const InputEvent &event) {
+      gui_.handleInput(event);
+    });
+    return;
+  }
+  input_log_.setFrame(frame_);
+  for (const auto &event : input_) {
+    if (input_log_.mode() == InputLog::Mode::Record) {
+      input_log_.record(event);
+    }
+    gui_.handleInput(event);
+  }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "camera_path.h"
+#include "frame_snapshot.h"
+#include "gui.h"
+#include "input_log.h"
+#include "world/triple_buffer.h"
+#include "world/world.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Runs the simulation side of every frame on its own thread: input, camera
+ * and boat physics, waves, terrain rebuilds and rain. Each step ends in a
+ * FrameSnapshot that is handed to the render thread through a lock-free
+ * TripleBuffer, so simulating frame N + 1 overlaps rendering frame N.
+ *
+ * No frame is ever dropped: the simulation publishes a frame only once the
+ * render thread has taken the previous one, which keeps fixed clock runs
+ * (--bench, --record, --replay) rendering exactly the frames they simulate.
+ * The mutex and condition variable only put an idle thread to sleep, the
+ * frames themselves never pass through a lock.
+ *
+ * While it runs, the simulation thread owns the World and the GUI state,
+ * the render thread must only read the snapshots.
+ */
+class Simulation {
+public:
+  using Clock = std::chrono::high_resolution_clock;
+
+  // path, if set, drives the camera and the weather (--bench), max_frames
+  // (0 for no limit) ends the simulation after that many frames
+  Simulation(World &world, GUI &gui, InputLog &input_log,
+             const CameraPath *path, bool fixed_clock, int max_frames,
+             Clock::time_point start);
+  ~Simulation();
+  Simulation(const Simulation &) = delete;
+  Simulation &operator=(const Simulation &) = delete;
+
+  void start();
+  void stop();
+
+  // Render thread: blocks until the next frame is published, nullptr once
+  // the simulation has finished and every frame was taken
+  const FrameSnapshot *nextFrame();
+
+  // Rain drops as spawned, for sizing the render side buffers
+  const std::vector<glm::vec3> &rainDrops() const { return rain_; }
+  // Frames simulated, read it once the simulation has stopped
+  int frames() const { return frame_; }
+
+private:
+  void run();
+  void step(FrameSnapshot &frame);
+  void dispatchInput();
+  void wake();
+
+  World &world_;
+  GUI &gui_;
+  InputLog &input_log_;
+  const CameraPath *path_;
+  bool fixed_clock_;
+  int max_frames_;
+  Clock::time_point start_;
+
+  int frame_ = 0;
+  double time_ = 0.0;
+  size_t allocations_ = 0; /* alloc_counter reading at the last frame */
+  std::vector<glm::vec3> rain_;
+  std::vector<InputEvent> input_;
+
+  TripleBuffer<FrameSnapshot> frames_;
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+  std::atomic<bool> finished_{false};
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+};
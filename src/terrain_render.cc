@@ -1,12 +1,12 @@
 #include "terrain_render.h"
 
 #include "perlin.hpp"
+#include "profiler.h"
 #include <GL/glew.h>
 #include <algorithm>
 #include <cmath>
-#include <glm/gtx/rotate_vector.hpp>
 #include <iostream>
-#include <random>
+#include <limits>
 
 const char *terrain_vertex_shader =
 #include "shaders/terrain.vert"
@@ -44,9 +44,11 @@ using std::array;
 using std::vector;
 
 constexpr float BLOCK_SIZE = 1.0f;
-constexpr int UPDATE_STEP = 5;
-constexpr double kPi = 3.141592653589793;
-constexpr double kG = 9.8000001;
+
+// Ocean tessellation budget
+constexpr float kTargetFrameTime = 1.0f / 60.0f;
+constexpr float kMinOceanTriangles = 20000.0f;
+constexpr float kMaxOceanTriangles = 400000.0f;
 
 // Defines a basic unit cube in 3-space
 const array<glm::vec4, 4> cube_vertices = {
@@ -57,340 +59,350 @@ const array<glm::vec4, 4> cube_vertices = {
 
 const array<glm::uvec3, 2> cube_faces = {{{2, 0, 1}, {1, 3, 2}}};
 
-// Wave simulation parameters
-constexpr int kNumWaves = 10;
-float gMedianWave = 30.0f; /* wavelengths sampled based on this average wave */
-float gMedianAmp = 0.10f;  /* amplitudes sampled based on this average amp */
-float gSteepness = 0.3f;   /* tunable *sharpness* of wave in [0, 1] */
-glm::vec3 gMedianDir = {0.5f, 0.1f, 0.5f}; /* sample directions relative */
-float kAngleRange = kPi / 3;               /* sample directions within  range */
-array<float, kNumWaves> gAmp{};
-array<float, kNumWaves> gFreq{};
-array<float, kNumWaves> gPhi{};
-array<glm::vec3, kNumWaves> gDir{};
-
-TerrainRender::TerrainRender(size_t rows, size_t cols,
-                             std::vector<ShaderUniform> uniforms)
-    : ticks_(0), rows_(rows), cols_(cols), cached_x_(0), cached_z_(0),
-      instanceOffsets_(rows * cols), sortedOffsets_(rows * cols),
-      heightVec_(rows * cols), norm0_(rows * cols), norm1_(rows * cols),
-      norm2_(rows * cols), norm3_(rows * cols) {
+// Ocean patch borders relative to the snapped ocean center. Patches near the
+// center are kOceanSnap wide so the tessellation can reach the same detail
+// near the boat as 1x1 patches did, the outer ones are wider.
+constexpr float kOceanSnap = 16.0f;
+const array<float, 9> kOceanPatchLines = {
+    {-96.0f, -64.0f, -32.0f, -16.0f, 0.0f, 16.0f, 32.0f, 64.0f, 96.0f}};
+
+// Baked tileable noise that perturbs the ocean normals
+constexpr int kNoiseTexels = 256;
+constexpr int kNoisePeriod = 32; /* lattice cells per tile, see ocean.tes */
+constexpr int kNoiseTextureUnit = 2;
+
+OceanQuality OceanQuality::preset(const std::string &name) {
+  OceanQuality quality;
+  if (name == "low") {
+    quality.waves = kLowWaves;
+    quality.perlin_normals = false;
+  } else if (name == "high") {
+    quality.waves = kHighWaves;
+  }
+  return quality;
+}
+
+TerrainRender::TerrainRender(const World &world,
+                             std::vector<ShaderUniform> uniforms,
+                             const OceanQuality &quality, JobSystem *jobs)
+    : ticks_(0), uploaded_version_(world.terrainVersion()),
+      noise_seed_(world.terrainSeed()),
+      draw_terrain_([this]() { drawTerrain(); }),
+      draw_ocean_([this]() { drawOcean(); }), culler_(jobs),
+      triangle_budget_(kMaxOceanTriangles) {
+
+  // Shader permutations, the wave arrays are sized for the world's waves
+  int wave_count = world.waves().constants().count;
+  auto terrain_defines = ShaderDefines{{"FOG", quality.fog ? "1" : "0"}};
+  auto ocean_defines = terrain_defines;
+  ocean_defines.push_back({"WAVE_COUNT", std::to_string(wave_count)});
+  ocean_defines.push_back(
+      {"PERLIN_NORMALS", quality.perlin_normals ? "1" : "0"});
 
   // WAVES
   // Binders
-  auto param_binder = [](int loc, const void *data) {
-    glUniform1fv(loc, kNumWaves, (const GLfloat *)data);
+  auto param_binder = [wave_count](int loc, const void *data) {
+    glUniform1fv(loc, wave_count, (const GLfloat *)data);
   };
-  auto dir_binder = [](int loc, const void *data) {
-    glUniform3fv(loc, kNumWaves, (const GLfloat *)data);
+  auto vec2_binder = [wave_count](int loc, const void *data) {
+    glUniform2fv(loc, wave_count, (const GLfloat *)data);
   };
-  auto int_binder = [](int loc, const void *data) {
-    glUniform1iv(loc, 1, (const GLint *)data);
+  auto vec3_binder = [wave_count](int loc, const void *data) {
+    glUniform3fv(loc, wave_count, (const GLfloat *)data);
   };
   auto float_binder = [](int loc, const void *data) {
     glUniform1fv(loc, 1, (const GLfloat *)data);
   };
+  auto uint_binder = [](int loc, const void *data) {
+    glUniform1uiv(loc, 1, (const GLuint *)data);
+  };
+  auto noise_binder = [](int loc, const void *data) {
+    glBindTextureUnit(kNoiseTextureUnit, *(const GLuint *)data);
+    glUniform1i(loc, kNoiseTextureUnit);
+  };
 
   // Data
-  auto amp_data = []() -> const void * { return gAmp.data(); };
-  auto freq_data = []() -> const void * { return gFreq.data(); };
-  auto phi_data = []() -> const void * { return gPhi.data(); };
-  auto dir_data = []() -> const void * { return gDir.data(); };
-  auto steepness_data = []() -> const void * { return &gSteepness; };
-  auto num_waves_data = []() -> const void * { return &kNumWaves; };
+  auto k_data = [this]() -> const void * { return wave().k.data(); };
+  auto amp_data = [this]() -> const void * { return wave().amp.data(); };
+  auto qad_data = [this]() -> const void * { return wave().qad.data(); };
+  auto dwa_data = [this]() -> const void * { return wave().dwa.data(); };
+  auto phase_data = [this]() -> const void * { return wave().phase.data(); };
+  auto qwa_data = [this]() -> const void * { return &wave().qwa; };
+  auto noise_data = [this]() -> const void * { return &noise_texture_; };
+  auto seed_data = [this]() -> const void * { return &noise_seed_; };
+  auto tess_scale_data = [this]() -> const void * { return &tess_scale_; };
+  auto viewport_height_data = [this]() -> const void * {
+    return &viewport_height_;
+  };
 
   // Uniforms
-  uniforms.push_back({"amp", param_binder, amp_data});
-  uniforms.push_back({"freq", param_binder, freq_data});
-  uniforms.push_back({"phi", param_binder, phi_data});
-  uniforms.push_back({"dir", dir_binder, dir_data});
-  uniforms.push_back({"steepness", float_binder, steepness_data});
-  uniforms.push_back({"num_waves", int_binder, num_waves_data});
+  uniforms.push_back({"wave_k", vec3_binder, k_data});
+  uniforms.push_back({"wave_amp", param_binder, amp_data});
+  uniforms.push_back({"wave_qad", vec2_binder, qad_data});
+  uniforms.push_back({"wave_dwa", vec2_binder, dwa_data});
+  uniforms.push_back({"wave_phase", param_binder, phase_data});
+  uniforms.push_back({"wave_qwa", float_binder, qwa_data});
+  uniforms.push_back({"normal_noise", noise_binder, noise_data});
+  uniforms.push_back({"noise_seed", uint_binder, seed_data});
+  uniforms.push_back({"tess_scale", float_binder, tess_scale_data});
+  uniforms.push_back({"viewport_height", float_binder, viewport_height_data});
 
   auto terrain_pass_input = RenderDataInput{};
   terrain_pass_input.assign(0, "vertex_position", cube_vertices.data(),
                             cube_vertices.size(), 4, GL_FLOAT);
 
   // Set up offsets for each instanced cube
-  updateInstanceOffsets(0, 0);
-  terrain_pass_input.assign(1, "offset", instanceOffsets_.data(),
-                            instanceOffsets_.size(), 3, GL_FLOAT, true);
-  terrain_pass_input.assign(2, "heightVec", heightVec_.data(),
-                            heightVec_.size(), 4, GL_FLOAT, true);
-  terrain_pass_input.assign(3, "norm0", norm0_.data(), norm0_.size(), 3,
-                            GL_FLOAT, true);
-  terrain_pass_input.assign(4, "norm1", norm1_.data(), norm1_.size(), 3,
-                            GL_FLOAT, true);
-  terrain_pass_input.assign(5, "norm2", norm2_.data(), norm2_.size(), 3,
-                            GL_FLOAT, true);
-  terrain_pass_input.assign(6, "norm3", norm3_.data(), norm3_.size(), 3,
-                            GL_FLOAT, true);
+  const auto &field = world.heightfield();
+  terrain_pass_input.assign(1, "offset", field.offsets().data(),
+                            field.offsets().size(), 3, GL_FLOAT, true);
+  terrain_pass_input.assign(2, "heightVec", field.heightVec().data(),
+                            field.heightVec().size(), 4, GL_FLOAT, true);
+  updateCellBounds(field.offsets(), field.heightVec());
+  terrain_pass_input.assign(3, "norm0", field.norm0().data(),
+                            field.norm0().size(), 3, GL_FLOAT, true);
+  terrain_pass_input.assign(4, "norm1", field.norm1().data(),
+                            field.norm1().size(), 3, GL_FLOAT, true);
+  terrain_pass_input.assign(5, "norm2", field.norm2().data(),
+                            field.norm2().size(), 3, GL_FLOAT, true);
+  terrain_pass_input.assign(6, "norm3", field.norm3().data(),
+                            field.norm3().size(), 3, GL_FLOAT, true);
   terrain_pass_input.assignIndex(cube_faces.data(), cube_faces.size(), 3);
 
   // Shader-related construct arguments for RenderPass
-  auto terrain_shaders =
-      vector<const char *>{{terrain_vertex_shader, terrain_geometry_shader,
-                            terrain_fragment_shader}};
+  auto terrain_shaders = vector<const char *>{
+      {terrain_vertex_shader, terrain_geometry_shader,
+       shaderVariant(terrain_fragment_shader, terrain_defines)}};
   auto output = vector<const char *>{{"fragment_color"}};
   this->terrain_pass_ = std::make_unique<RenderPass>(
       -1, terrain_pass_input, terrain_shaders, uniforms, output);
 
+  // Nested-ring LOD terrain, drawn instead of the per-cell quads
+  this->clipmap_ = std::make_unique<ClipmapRender>(
+      world.terrainSeed(), uniforms, terrain_defines);
+  culler_.setOccluders(clipmap_->occluders());
+
   // WATER
   auto ocean_pass_input = RenderDataInput{};
   ocean_pass_input.assign(0, "vertex_position", cube_vertices.data(),
                           cube_vertices.size(), 4, GL_FLOAT);
-  ocean_pass_input.assign(1, "offset", sortedOffsets_.data(),
-                          sortedOffsets_.size(), 3, GL_FLOAT, true);
+  updateOceanPatches(field.cachedX(), field.cachedZ());
+  ocean_pass_input.assign(1, "patch_rect", oceanPatches_.data(),
+                          oceanPatches_.size(), 4, GL_FLOAT, true);
+  visible_patches_.reserve(oceanPatches_.size());
+  uploaded_patches_ = oceanPatches_;
   ocean_pass_input.assignIndex(cube_faces.data(), cube_faces.size(), 3);
   auto ocean_shaders = vector<const char *>{
-      {ocean_vertex_shader, ocean_geometry_shader, ocean_fragment_shader,
-       ocean_tcs_shader, ocean_tes_shader}};
+      {ocean_vertex_shader, ocean_geometry_shader,
+       shaderVariant(ocean_fragment_shader, ocean_defines),
+       shaderVariant(ocean_tcs_shader, ocean_defines),
+       shaderVariant(ocean_tes_shader, ocean_defines)}};
   this->ocean_pass_ = std::make_unique<RenderPass>(
       -1, ocean_pass_input, ocean_shaders, uniforms, output);
 
-  // Initialize wave parameters
-  updateWaveParams();
+  glCreateQueries(GL_PRIMITIVES_GENERATED, ocean_queries_.size(),
+                  ocean_queries_.data());
+  createNoiseTexture();
 }
 
-void TerrainRender::renderVisible(glm::vec3 eye) {
-  int x_coord = std::floor(eye.x / BLOCK_SIZE);
-  int z_coord = std::floor(eye.z / BLOCK_SIZE);
+/**
+ * Bake one tile of Perlin noise into a repeating texture, the ocean TES
+ * samples it instead of evaluating the noise for every tessellated vertex.
+ */
+void TerrainRender::createNoiseTexture() {
+  auto texels = vector<float>(kNoiseTexels * kNoiseTexels);
+  float scale = float(kNoisePeriod) / kNoiseTexels;
+  for (int row = 0; row < kNoiseTexels; row++) {
+    for (int col = 0; col < kNoiseTexels; col++) {
+      texels[row * kNoiseTexels + col] =
+          perlin::tileablePerlin(col * scale, row * scale, kNoisePeriod,
+                                 noise_seed_);
+    }
+  }
+  glCreateTextures(GL_TEXTURE_2D, 1, &noise_texture_);
+  glTextureStorage2D(noise_texture_, 1, GL_R32F, kNoiseTexels, kNoiseTexels);
+  glTextureSubImage2D(noise_texture_, 0, 0, 0, kNoiseTexels, kNoiseTexels,
+                      GL_RED, GL_FLOAT, texels.data());
+  glTextureParameteri(noise_texture_, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTextureParameteri(noise_texture_, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTextureParameteri(noise_texture_, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTextureParameteri(noise_texture_, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
 
-  // Update wave parameters every ~3sec
+void TerrainRender::submit(const FrameSnapshot &frame, RenderQueue &queue) {
   ticks_++;
-  if (ticks_ % 180 == 0) {
-    // updateWaveParams();
+  frame_ = &frame;
+
+  // Upload the heightfield again whenever the world rebuilt it
+  const auto &field = frame.terrain;
+  if (field.version != uploaded_version_) {
+    terrain_pass_->updateVBO(1, field.offsets.data(), field.offsets.size());
+    terrain_pass_->updateVBO(2, field.heightVec.data(),
+                             field.heightVec.size());
+    terrain_pass_->updateVBO(3, field.norm0.data(), field.norm0.size());
+    terrain_pass_->updateVBO(4, field.norm1.data(), field.norm1.size());
+    terrain_pass_->updateVBO(5, field.norm2.data(), field.norm2.size());
+    terrain_pass_->updateVBO(6, field.norm3.data(), field.norm3.size());
+    updateOceanPatches(field.x, field.z);
+    updateCellBounds(field.offsets, field.heightVec);
+    uploaded_version_ = field.version;
+  }
+  if (use_clipmap_ && clipmap_->update(frame.eye)) {
+    culler_.setOccluders(clipmap_->occluders());
+  }
+  {
+    // Only the clipmap is an occluder
+    PROFILE_CPU_SCOPE("occlusion");
+    const OcclusionCuller *culler = nullptr;
+    if (use_clipmap_ && use_occlusion_) {
+      culler_.render(frame.projection * frame.view * frame.model);
+      culler = &culler_;
+    }
+    if (use_clipmap_) {
+      clipmap_->cull(culler);
+    }
+    cullOcean(culler);
   }
 
-  // Only update instanceOffsets_ if eye changes
-  if (x_coord / UPDATE_STEP != cached_x_ / UPDATE_STEP ||
-      z_coord / UPDATE_STEP != cached_z_ / UPDATE_STEP) {
-    updateInstanceOffsets(x_coord, z_coord);
-
-    terrain_pass_->updateVBO(1, instanceOffsets_.data(),
-                             instanceOffsets_.size());
-    terrain_pass_->updateVBO(2, heightVec_.data(), heightVec_.size());
-    terrain_pass_->updateVBO(3, norm0_.data(), norm0_.size());
-    terrain_pass_->updateVBO(4, norm1_.data(), norm1_.size());
-    terrain_pass_->updateVBO(5, norm2_.data(), norm2_.size());
-    terrain_pass_->updateVBO(6, norm3_.data(), norm3_.size());
-    ocean_pass_->updateVBO(1, sortedOffsets_.data(), sortedOffsets_.size());
+  // Ordered by what is actually drawn, after culling
+  auto terrain_lo = cells_lo_;
+  auto terrain_hi = cells_hi_;
+  if (use_clipmap_) {
+    clipmap_->bounds(terrain_lo, terrain_hi);
   }
+  const auto &terrain_pass = use_clipmap_ ? clipmap_->pass() : *terrain_pass_;
+  queue.submit(RenderQueue::Layer::Opaque,
+               RenderQueue::boxDepth(frame.view, terrain_lo, terrain_hi),
+               RenderState{}, terrain_pass, &draw_terrain_);
+  // The ocean is slightly transparent but still hides what is below it
+  auto ocean_state = RenderState{};
+  ocean_state.blend = true;
+  queue.submit(RenderQueue::Layer::Transparent,
+               RenderQueue::boxDepth(frame.view, ocean_lo_, ocean_hi_),
+               ocean_state, *ocean_pass_, &draw_ocean_);
+}
 
+void TerrainRender::drawTerrain() {
+  if (use_clipmap_) {
+    clipmap_->draw();
+    return;
+  }
   // Draw each cube, instanced
   terrain_pass_->setup();
-  glDrawElementsInstanced(GL_TRIANGLES, cube_faces.size() * 3, GL_UNSIGNED_INT,
-                          0, instanceOffsets_.size());
-  ocean_pass_->setup();
-  glDrawElementsInstanced(GL_PATCHES, cube_faces.size() * 3, GL_UNSIGNED_INT, 0,
-                          sortedOffsets_.size());
+  PROFILE_GPU_SCOPE("terrain");
+  glDrawElementsInstanced(GL_TRIANGLES, cube_faces.size() * 3,
+                          GL_UNSIGNED_INT, 0, frame_->terrain.offsets.size());
 }
 
-/**
- * Vary the ocean parameters with time to achieve a dynamic wave simulation.
- * This also allows us to achieve "stormy" weather vs. "sunny" weather.
- */
-void TerrainRender::updateWaveParams() {
-  static std::mt19937 engine(std::random_device{}());
-
-  double now = getTime();
-
-  // TODO: Update median wave and amplitude
-
-  // Resample wavelengths to generate new frequencies
-  auto lengths = array<float, kNumWaves>{};
-  auto freq_dist = std::uniform_real_distribution<float>(gMedianWave / 2.0,
-                                                         gMedianWave * 2.0);
-  std::generate(lengths.begin(), lengths.end(),
-                [&freq_dist]() { return freq_dist(engine); });
-  std::transform(lengths.begin(), lengths.end(), gFreq.begin(),
-                 [](const auto &wavelength) {
-                   return std::sqrt(kG * 2 * kPi / wavelength);
-                 });
-
-  // Derive amplitudes based on wavelengths (constant ratio)
-  auto amp_dist =
-      std::uniform_real_distribution<float>(gMedianAmp / 2.0, gMedianAmp * 2.0);
-  std::generate(gAmp.begin(), gAmp.end(),
-                [&amp_dist]() { return amp_dist(engine); });
-  /*
-    std::transform(lengths.begin(), lengths.end(), gAmp.begin(),
-                   [](const auto &wavelength) {
-                     return
-                     // return gMedianAmp / gMedianWave * wavelength;
-                   });*/
-
-  // Resample direction vectors
-  auto dir_dist =
-      std::uniform_real_distribution<float>(-kAngleRange / 2, kAngleRange / 2);
-  std::generate(gDir.begin(), gDir.end(), [&dir_dist]() {
-    return glm::rotateY(gMedianDir, dir_dist(engine));
-  });
-
-  // Update phase values
-  auto phase_dist = std::uniform_real_distribution<float>(-kPi, kPi);
-  std::generate(gPhi.begin(), gPhi.end(),
-                [&phase_dist]() { return phase_dist(engine); });
-}
-
-void TerrainRender::updateInstanceOffsets(int x, int z) {
-  int index = 0;
-  instanceOffsets_.resize(rows_ * cols_);
-  for (size_t i = 0; i < rows_; i++) {
-    for (size_t j = 0; j < cols_; j++) {
-      float newX = ((float)i - (float)(rows_ / 2) + (float)x) * BLOCK_SIZE;
-      float newZ = ((float)j - (float)(cols_ / 2) + (float)z) * BLOCK_SIZE;
-      float perlin = perlin::getHeight(newX, newZ);
-      instanceOffsets_[index++] = {newX, perlin, newZ};
-    }
+void TerrainRender::drawOcean() {
+  // Count the triangles the ocean generates, read back a frame later so the
+  // query never stalls the pipeline
+  ocean_pass_->setup();
+  {
+    PROFILE_GPU_SCOPE("ocean");
+    glBeginQuery(GL_PRIMITIVES_GENERATED, ocean_queries_[ticks_ % 2]);
+    glDrawElementsInstanced(GL_PATCHES, cube_faces.size() * 3, GL_UNSIGNED_INT,
+                            0, uploaded_patches_.size());
+    glEndQuery(GL_PRIMITIVES_GENERATED);
   }
-  index = 0;
-  heightVec_.resize(rows_ * cols_);
-  std::vector<glm::vec3> normals(rows_ * cols_);
-  for (size_t i = 0; i < rows_; i++) {
-    for (size_t j = 0; j < cols_; j++) {
-      float botLeft = instanceOffsets_[index].y;
-      glm::vec4 localHeights = glm::vec4{botLeft};
-      if (i < rows_ - 1) { // Up
-        localHeights[1] = instanceOffsets_[index + cols_].y;
-      }
-      if (j < cols_ - 1) { // Right
-        localHeights[2] = instanceOffsets_[index + 1].y;
-      }
-      if (i < rows_ - 1 && j < cols_ - 1) { // Diag
-        localHeights[3] = instanceOffsets_[index + cols_ + 1].y;
-      }
-      normals[index] = -glm::normalize(
-          glm::cross(glm::vec3{1.0f, localHeights[1] - botLeft, 0.0f},
-                     glm::vec3{0.0f, localHeights[2] - botLeft, 1.0f}));
-      heightVec_[index] = localHeights;
-      index++;
-    }
+  unsigned previous = ocean_queries_[(ticks_ + 1) % 2];
+  GLint available = 0;
+  if (ticks_ > 1) {
+    glGetQueryObjectiv(previous, GL_QUERY_RESULT_AVAILABLE, &available);
   }
-
-  index = 0;
-  for (size_t i = 0; i < rows_; i++) {
-    for (size_t j = 0; j < cols_; j++) {
-      norm0_[index] = normals[index];
-      norm1_[index] = (i < rows_ - 1) ? normals[index + cols_] : normals[index];
-      norm2_[index] = (j < cols_ - 1) ? normals[index + 1] : normals[index];
-      norm3_[index] = (i < rows_ - 1 && j < cols_ - 1)
-                          ? normals[index + cols_ + 1]
-                          : normals[index];
-      index++;
-    }
+  if (available) {
+    glGetQueryObjectuiv(previous, GL_QUERY_RESULT, &ocean_triangles_);
   }
-
-  sortedOffsets_ = instanceOffsets_;
-  glm::vec2 center_pos = {x, z};
-  std::sort(sortedOffsets_.begin(), sortedOffsets_.end(),
-            [&center_pos](const glm::vec3 &a, const glm::vec3 &b) {
-              return glm::distance(center_pos, glm::vec2{a.x, a.z}) <
-                     glm::distance(center_pos, glm::vec2{b.x, b.z});
-            });
-
-  cached_x_ = x;
-  cached_z_ = z;
 }
 
-bool TerrainRender::isPositionLegal(const glm::vec3 &loc) {
-  // Check that player (if treated as a line) lies above terrain
-  int i = int(int(floor(loc.x)) - cached_x_ + rows_ / 2);
-  int j = int(int(floor(loc.z)) - cached_z_ + cols_ / 2);
-  float currentBlockHeight = instanceOffsets_[i * cols_ + j].y;
-  if (currentBlockHeight >= 0.0f && loc.y < currentBlockHeight) {
-    return false;
+/**
+ * Steer the ocean tessellation from frame-time feedback. The triangle budget
+ * shrinks while frames run over kTargetFrameTime and grows back when there is
+ * headroom, and tess_scale_ follows the ratio between the budget and the
+ * number of triangles the ocean generated in an earlier frame.
+ */
+void TerrainRender::updateTessellationBudget(float frame_seconds,
+                                             int viewport_height) {
+  viewport_height_ = float(viewport_height);
+  if (frame_seconds > kTargetFrameTime * 1.05f) {
+    triangle_budget_ = std::max(triangle_budget_ * 0.95f, kMinOceanTriangles);
+  } else if (frame_seconds < kTargetFrameTime * 0.8f) {
+    triangle_budget_ = std::min(triangle_budget_ * 1.02f, kMaxOceanTriangles);
   }
-
-  // Check for collisions with left, right, front, back
-  float x_center = std::floor(loc.x);
-  float z_center = std::floor(loc.z);
-  auto loc_left = glm::vec3{x_center - 1.0f, 0, z_center};
-  auto loc_right = glm::vec3{x_center + 1.0f, 0, z_center};
-  auto loc_front = glm::vec3{x_center, 0, z_center + 1.0f};
-  auto loc_back = glm::vec3{x_center, 0, z_center - 1.0f};
-  auto loc_left_front = glm::vec3{x_center - 1.0f, 0, z_center + 1.0f};
-  auto loc_right_front = glm::vec3{x_center + 1.0f, 0, z_center + 1.0f};
-  auto loc_left_back = glm::vec3{x_center - 1.0f, 0, z_center - 1.0f};
-  auto loc_right_back = glm::vec3{x_center + 1.0f, 0, z_center - 1.0f};
-  auto neighbors = vector<glm::vec3>{
-      loc_left,       loc_right,       loc_front,     loc_back,
-      loc_left_front, loc_right_front, loc_left_back, loc_right_back};
-
-  for (const auto &neighbor : neighbors) {
-    // Check circle-rectangle intersection (xz-plane)
-    auto closest = glm::vec2{glm::clamp(loc.x, neighbor.x, neighbor.x + 1.0f),
-                             glm::clamp(loc.z, neighbor.z, neighbor.z + 1.0f)};
-    float distance = glm::distance(closest, {loc.x, loc.z});
-    if (distance < 0.25f) {
-      // Check heights (y)
-      int i = int(floor(neighbor.x)) - cached_x_ + rows_ / 2;
-      int j = int(floor(neighbor.z)) - cached_z_ + cols_ / 2;
-      auto block_height = instanceOffsets_[i * cols_ + j].y;
-      if (block_height >= 0.0f && loc.y < block_height) {
-        return false;
-      }
-    }
+  if (ocean_triangles_ > 0) {
+    // Triangle count grows with the square of the tessellation level
+    float target =
+        tess_scale_ * std::sqrt(triangle_budget_ / float(ocean_triangles_));
+    tess_scale_ = glm::clamp(glm::mix(tess_scale_, target, 0.25f), 0.05f, 1.0f);
   }
-
-  return true;
 }
 
-float TerrainRender::getWaveHeight(const glm::vec3 &loc) {
-  // Calculate wave height at a given location
-  float waveHeight = 0.0f;
-  // Naive sum of sines
-  /*for (size_t i = 0; i < gAmp.size(); i++) {
-    if (gAmp.at(i) == 0.0f) {
-      break;
+/**
+ * Lay out the ocean as a camera-following grid of a few dozen large patches
+ * (x, z, width, depth), which the TCS subdivides by their size on screen.
+ * The center snaps to kOceanSnap so patch borders stay fixed in the world.
+ */
+void TerrainRender::updateOceanPatches(int x, int z) {
+  float center_x = std::round(x * BLOCK_SIZE / kOceanSnap) * kOceanSnap;
+  float center_z = std::round(z * BLOCK_SIZE / kOceanSnap) * kOceanSnap;
+  oceanPatches_.clear();
+  for (size_t i = 0; i + 1 < kOceanPatchLines.size(); i++) {
+    for (size_t j = 0; j + 1 < kOceanPatchLines.size(); j++) {
+      oceanPatches_.emplace_back(center_x + kOceanPatchLines[i],
+                                 center_z + kOceanPatchLines[j],
+                                 kOceanPatchLines[i + 1] - kOceanPatchLines[i],
+                                 kOceanPatchLines[j + 1] - kOceanPatchLines[j]);
     }
-    waveHeight +=
-        gAmp.at(i) * glm::sin(glm::dot(glm::vec2(gDir.at(i).x, gDir.at(i).z),
-                                       glm::vec2(loc.x, loc.z)) *
-                                  gFreq.at(i) +
-                              getTime() * gPhi.at(i));
-  }*/
-  glm::vec2 loc_xz = {loc.x, loc.z};
-  for (size_t i = 0; i < kNumWaves; i++) {
-    glm::vec2 dir_xz = {gDir.at(i).x, gDir.at(i).z};
-    waveHeight += gAmp.at(i) * glm::sin(glm::dot(gFreq.at(i) * dir_xz, loc_xz) +
-                                        gPhi.at(i) * getTime());
   }
-  return waveHeight + 0.1875f;
 }
 
-glm::vec3 TerrainRender::getWaveNormal(const glm::vec3 &loc) {
-  glm::vec3 pos = loc;
-  pos.y = getWaveHeight(loc);
-  glm::vec3 norm = {0.0f, 1.0f, 0.0f};
-  for (size_t i = 0; i < kNumWaves; i++) {
-    float q = gSteepness / (gFreq.at(i) * gAmp.at(i) * kNumWaves);
-    float WA = gFreq.at(i) * gAmp.at(i);
-    float S = glm::sin(glm::dot(gFreq.at(i) * gDir.at(i), pos) +
-                       gPhi.at(i) * getTime());
-    float C = glm::cos(glm::dot(gFreq.at(i) * gDir.at(i), pos) +
-                       gPhi.at(i) * getTime());
-    glm::vec3 temp{0.0f};
-    temp.x = -(gDir.at(i).x * WA * C);
-    temp.z = -(gDir.at(i).z * WA * C);
-    temp.y = -(q * WA * S);
-    norm += temp;
+// Box around the instanced cells: BLOCK_SIZE quads at their offset in x and
+// z, at their corner heights (terrain.vert ignores the offset's y)
+void TerrainRender::updateCellBounds(const std::vector<glm::vec3> &offsets,
+                                     const std::vector<glm::vec4> &heights) {
+  cells_lo_ = glm::vec3{std::numeric_limits<float>::max()};
+  cells_hi_ = glm::vec3{-std::numeric_limits<float>::max()};
+  for (size_t i = 0; i < offsets.size(); i++) {
+    const auto &offset = offsets[i];
+    const auto &corners = heights[i];
+    float lowest = std::min(std::min(corners.x, corners.y),
+                            std::min(corners.z, corners.w));
+    float highest = std::max(std::max(corners.x, corners.y),
+                             std::max(corners.z, corners.w));
+    cells_lo_ = glm::min(cells_lo_, glm::vec3{offset.x, lowest, offset.z});
+    cells_hi_ = glm::max(cells_hi_, glm::vec3{offset.x + BLOCK_SIZE, highest,
+                                              offset.z + BLOCK_SIZE});
   }
-  return glm::normalize(norm);
 }
 
-void TerrainRender::toggle_storm(bool is_raining) {
-  if (is_raining) {
-    kAngleRange = kPi / 2;
-    gMedianWave = 150.0f;
-    gMedianAmp = 0.5f;
-    gSteepness = 0.2f;
-    updateWaveParams();
-  } else {
-    kAngleRange = kPi / 3;
-    gMedianWave = 30.0f;
-    gMedianAmp = 0.10f;
-    gSteepness = 0.3f;
-    updateWaveParams();
+/**
+ * Keep the ocean patches the terrain does not hide, null keeps all of them.
+ * The waves move the surface by at most the sum of their amplitudes up and
+ * down and of their q * amp sideways, which pads every patch's box. The
+ * instance buffer is only replaced when the set changes.
+ */
+void TerrainRender::cullOcean(const OcclusionCuller *culler) {
+  float rise = 1.0f;
+  float drift = 0.0f;
+  for (int i = 0; i < wave().count; i++) {
+    rise += std::abs(wave().amp[i]);
+    drift += glm::length(wave().qad[i]);
+  }
+  visible_patches_.clear();
+  ocean_lo_ = glm::vec3{std::numeric_limits<float>::max()};
+  ocean_hi_ = glm::vec3{-std::numeric_limits<float>::max()};
+  for (const auto &patch : oceanPatches_) {
+    auto lo = glm::vec3{patch.x - drift, -rise, patch.y - drift};
+    auto hi = glm::vec3{patch.x + patch.z + drift, rise,
+                        patch.y + patch.w + drift};
+    if (!culler || !culler->isOccluded(lo, hi)) {
+      visible_patches_.push_back(patch);
+      ocean_lo_ = glm::min(ocean_lo_, lo);
+      ocean_hi_ = glm::max(ocean_hi_, hi);
+    }
+  }
+  if (visible_patches_ != uploaded_patches_) {
+    ocean_pass_->updateVBO(1, visible_patches_.data(),
+                           visible_patches_.size());
+    uploaded_patches_ = visible_patches_;
   }
 }
@@ -1,44 +1,92 @@
 #pragma once
 
+#include "clipmap_render.h"
+#include "frame_snapshot.h"
 #include "render_pass.h"
-#include <chrono>
+#include "render_queue.h"
+#include "shader_variants.h"
+#include "world/occlusion_culler.h"
+#include "world/world.h"
+#include <array>
+#include <functional>
 #include <glm/glm.hpp>
 #include <memory>
+#include <string>
 
+/*
+ * Permutation of the ocean and terrain shaders (see shader_variants.h) and
+ * the wave count the world is created with, which picks the matching
+ * WaveKernel on the CPU.
+ */
+struct OceanQuality {
+  int waves = kNumWaves;
+  bool perlin_normals = true; /* baked noise added to the ocean normals */
+  bool fog = true;
+
+  // "low" (4 waves, no noise normals), "medium" (the default) or "high"
+  // (32 waves), medium for anything else
+  static OceanQuality preset(const std::string &name);
+};
+
+/*
+ * Draws the terrain and the ocean of a World. The world owns all of the
+ * simulation state, this only uploads it from the frame snapshots (the
+ * heightfield whenever the world rebuilt it, the wave constants as uniforms
+ * every frame) and keeps the GL side state such as the ocean tessellation
+ * budget. The world itself is only read while constructing.
+ *
+ * Every frame the clipmap terrain is rasterized as an occluder (see
+ * OcclusionCuller) and the clipmap chunks and ocean patches it hides are
+ * left out of the draws. The per cell terrain is not culled.
+ */
 class TerrainRender {
 public:
-  TerrainRender(size_t rows, size_t cols, std::vector<ShaderUniform> uniforms);
-  void renderVisible(glm::vec3 eye);
-  bool isPositionLegal(const glm::vec3 &loc);
-  float getWaveHeight(const glm::vec3 &loc);
-  void setStartTime(std::chrono::high_resolution_clock::time_point t) {
-    start_time_ = t;
-  }
-  float getTime() {
-    auto end = std::chrono::high_resolution_clock::now();
-    return std::chrono::duration<float>(end - start_time_).count();
-  }
+  // The ocean shaders are built for the world's wave count, the rest of
+  // their permutation comes from quality. Occluders are rasterized on jobs
+  // when it is set.
+  TerrainRender(const World &world, std::vector<ShaderUniform> uniforms,
+                const OceanQuality &quality = OceanQuality{},
+                JobSystem *jobs = nullptr);
+  // Uploads what changed and queues the terrain (opaque) and the ocean
+  // (transparent), frame must stay alive until the queue is flushed
+  void submit(const FrameSnapshot &frame, RenderQueue &queue);
 
-  glm::vec3 getWaveNormal(const glm::vec3 &loc);
-  void toggle_storm(bool is_raining);
+  void toggleClipmap() { use_clipmap_ = !use_clipmap_; }
+  void toggleOcclusion() { use_occlusion_ = !use_occlusion_; }
+  void updateTessellationBudget(float frame_seconds, int viewport_height);
 
 private:
-  void updateInstanceOffsets(int x, int z);
-  void updateWaveParams();
+  const WaveConstants &wave() const { return frame_->waves; }
+  void drawTerrain();
+  void drawOcean();
+  void updateOceanPatches(int x, int z);
+  void cullOcean(const OcclusionCuller *culler);
+  void updateCellBounds(const std::vector<glm::vec3> &offsets,
+                        const std::vector<glm::vec4> &heights);
+  void createNoiseTexture();
 
-  std::chrono::high_resolution_clock::time_point start_time_;
+  const FrameSnapshot *frame_ = nullptr; /* being rendered */
   size_t ticks_;
-  size_t rows_;
-  size_t cols_;
-  int cached_x_;
-  int cached_z_;
+  uint64_t uploaded_version_; /* heightfield currently in the VBOs */
+  uint32_t noise_seed_; /* world seed, for the shader side noise */
+  std::function<void()> draw_terrain_;
+  std::function<void()> draw_ocean_;
   std::unique_ptr<RenderPass> terrain_pass_;
   std::unique_ptr<RenderPass> ocean_pass_;
-  std::vector<glm::vec3> instanceOffsets_;
-  std::vector<glm::vec3> sortedOffsets_;
-  std::vector<glm::vec4> heightVec_;
-  std::vector<glm::vec3> norm0_;
-  std::vector<glm::vec3> norm1_;
-  std::vector<glm::vec3> norm2_;
-  std::vector<glm::vec3> norm3_;
+  std::unique_ptr<ClipmapRender> clipmap_;
+  bool use_clipmap_ = true;
+  OcclusionCuller culler_;
+  bool use_occlusion_ = true;
+  float tess_scale_ = 1.0f;
+  float viewport_height_ = 720.0f;
+  float triangle_budget_;
+  unsigned ocean_triangles_ = 0;
+  std::array<unsigned, 2> ocean_queries_;
+  unsigned noise_texture_ = 0;
+  std::vector<glm::vec4> oceanPatches_;
+  std::vector<glm::vec4> visible_patches_;  /* not hidden this frame */
+  std::vector<glm::vec4> uploaded_patches_; /* in the patch_rect VBO */
+  // Boxes for the draw order, see RenderQueue::boxDepth
+  glm::vec3 cells_lo_{0.0f}, cells_hi_{-1.0f}; /* per cell terrain */
+  glm::vec3 ocean_lo_{0.0f}, ocean_hi_{-1.0f}; /* visible patches */
 };
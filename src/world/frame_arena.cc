@@ -0,0 +1,35 @@
+#include "frame_arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+constexpr size_t FrameArena::kDefaultCapacity;
+
+FrameArena::FrameArena(size_t capacity)
+    : block_(new unsigned char[capacity]), capacity_(capacity) {}
+
+FrameArena &FrameArena::local() {
+  static thread_local FrameArena arena;
+  return arena;
+}
+
+void *FrameArena::allocate(size_t bytes, size_t alignment) {
+  auto base = reinterpret_cast<uintptr_t>(block_.get());
+  uintptr_t start = (base + offset_ + alignment - 1) & ~(alignment - 1);
+  if (start + bytes > base + capacity_) {
+    overflows_++;
+    return ::operator new(bytes);
+  }
+  offset_ = start + bytes - base;
+  high_water_ = std::max(high_water_, offset_);
+  return reinterpret_cast<void *>(start);
+}
+
+void FrameArena::deallocate(void *pointer) {
+  // Arena memory is released by reset() or a Scope, only overflows are freed
+  auto *bytes = static_cast<unsigned char *>(pointer);
+  if (bytes < block_.get() || bytes >= block_.get() + capacity_) {
+    ::operator delete(pointer);
+  }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/*
+ * Bump allocator for transient CPU data. Allocations are carved out of one
+ * block and released all at once, by reset() once a frame is presented or by
+ * a Scope going out of scope, so scratch buffers in hot paths never touch the
+ * heap. Every thread has its own arena, see local().
+ *
+ * Once the block is exhausted allocations fall back to the heap, and are
+ * counted in overflows(), rather than fail.
+ */
+class FrameArena {
+public:
+  static constexpr size_t kDefaultCapacity = 4 << 20; /* 4 MiB */
+
+  explicit FrameArena(size_t capacity = kDefaultCapacity);
+  FrameArena(const FrameArena &) = delete;
+  FrameArena &operator=(const FrameArena &) = delete;
+
+  // The calling thread's arena
+  static FrameArena &local();
+
+  void *allocate(size_t bytes, size_t alignment);
+  void deallocate(void *pointer);
+  void reset() { offset_ = 0; }
+
+  size_t used() const { return offset_; }
+  size_t highWater() const { return high_water_; }
+  size_t overflows() const { return overflows_; }
+
+  // Releases everything allocated from the arena during its lifetime
+  class Scope {
+  public:
+    explicit Scope(FrameArena &arena = FrameArena::local())
+        : arena_(arena), mark_(arena.offset_) {}
+    ~Scope() { arena_.offset_ = mark_; }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    FrameArena &arena_;
+    size_t mark_;
+  };
+
+private:
+  std::unique_ptr<unsigned char[]> block_;
+  size_t capacity_;
+  size_t offset_ = 0;
+  size_t high_water_ = 0;
+  size_t overflows_ = 0;
+};
+
+// STL allocator handing out FrameArena memory, deallocate is a no-op
+template <typename T> class ArenaAllocator {
+public:
+  using value_type = T;
+
+  ArenaAllocator(FrameArena &arena = FrameArena::local()) : arena_(&arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena()) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(arena_->allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T *pointer, size_t) { arena_->deallocate(pointer); }
+  FrameArena *arena() const { return arena_; }
+
+private:
+  FrameArena *arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+  return !(a == b);
+}
+
+template <typename T> using ArenaVector = std::vector<T, ArenaAllocator<T>>;
@@ -0,0 +1,109 @@
+#include "heightfield.h"
+
+#include "perlin.hpp"
+#include <cmath>
+
+Heightfield::Heightfield(size_t rows, size_t cols, uint32_t seed,
+                         JobSystem *jobs)
+    : rows_(rows), cols_(cols), seed_(seed), jobs_(jobs),
+      offsets_(rows * cols), heightVec_(rows * cols), norm0_(rows * cols),
+      norm1_(rows * cols), norm2_(rows * cols), norm3_(rows * cols) {
+  rebuild(0, 0);
+}
+
+void Heightfield::rebuild(int x, int z) {
+  if (jobs_) {
+    rebuildWith(x, z, [this](size_t count, auto fn) {
+      jobs_->parallelFor(count, kRebuildGrain, fn);
+    });
+  } else {
+    rebuildWith(x, z, [](size_t count, auto fn) { fn(size_t(0), count); });
+  }
+}
+
+void Heightfield::sampleRows(int x, int z, Corner *corners, size_t begin,
+                             size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    for (size_t j = 0; j <= cols_; j++) {
+      float newX =
+          ((float)i - (float)(rows_ / 2) + (float)x) * perlin::kBlockSize;
+      float newZ =
+          ((float)j - (float)(cols_ / 2) + (float)z) * perlin::kBlockSize;
+      auto sample = perlin::heightAndGradient(newX, newZ, seed_);
+      corners[i * (cols_ + 1) + j] = {
+          sample.value, glm::normalize(glm::vec3{-sample.gradient.x, 1.0f,
+                                                 -sample.gradient.y})};
+    }
+  }
+}
+
+void Heightfield::assembleRows(int x, int z, const Corner *corners,
+                               size_t begin, size_t end) {
+  size_t stride = cols_ + 1;
+  for (size_t i = begin; i < end; i++) {
+    for (size_t j = 0; j < cols_; j++) {
+      size_t index = i * cols_ + j;
+      const Corner *corner = corners + i * stride + j;
+      const Corner &up = corner[stride];
+      const Corner &right = corner[1];
+      const Corner &diag = corner[stride + 1];
+      float newX =
+          ((float)i - (float)(rows_ / 2) + (float)x) * perlin::kBlockSize;
+      float newZ =
+          ((float)j - (float)(cols_ / 2) + (float)z) * perlin::kBlockSize;
+      offsets_[index] = {newX, corner->height, newZ};
+      heightVec_[index] = {corner->height, up.height, right.height,
+                           diag.height};
+      norm0_[index] = corner->normal;
+      norm1_[index] = up.normal;
+      norm2_[index] = right.normal;
+      norm3_[index] = diag.normal;
+    }
+  }
+}
+
+// Height of the block at integer world coordinates, cells outside the window
+// count as open water
+float Heightfield::blockHeight(int x, int z) const {
+  int i = x - cached_x_ + int(rows_ / 2);
+  int j = z - cached_z_ + int(cols_ / 2);
+  if (i < 0 || j < 0 || i >= int(rows_) || j >= int(cols_)) {
+    return -1.0f;
+  }
+  return offsets_[i * cols_ + j].y;
+}
+
+bool Heightfield::isPositionLegal(const glm::vec3 &loc) const {
+  // Check that player (if treated as a line) lies above terrain
+  float currentBlockHeight =
+      blockHeight(int(std::floor(loc.x)), int(std::floor(loc.z)));
+  if (currentBlockHeight >= 0.0f && loc.y < currentBlockHeight) {
+    return false;
+  }
+
+  // Check for collisions with the eight surrounding blocks
+  float x_center = std::floor(loc.x);
+  float z_center = std::floor(loc.z);
+  for (int dx = -1; dx <= 1; dx++) {
+    for (int dz = -1; dz <= 1; dz++) {
+      if (dx == 0 && dz == 0) {
+        continue;
+      }
+      auto neighbor = glm::vec2{x_center + dx, z_center + dz};
+      // Check circle-rectangle intersection (xz-plane)
+      auto closest =
+          glm::vec2{glm::clamp(loc.x, neighbor.x, neighbor.x + 1.0f),
+                    glm::clamp(loc.z, neighbor.y, neighbor.y + 1.0f)};
+      float distance = glm::distance(closest, {loc.x, loc.z});
+      if (distance < 0.25f) {
+        // Check heights (y)
+        float block_height = blockHeight(int(neighbor.x), int(neighbor.y));
+        if (block_height >= 0.0f && loc.y < block_height) {
+          return false;
+        }
+      }
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "frame_arena.h"
+#include "job_system.h"
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+/*
+ * The rows x cols window of terrain cells around the player, sampled from
+ * perlin::heightAndGradient with the world seed. Each cell keeps its corner
+ * (offset) and the heights and normals of its four corners, which is what
+ * the instanced terrain pass draws. No GL in here, so it
+ * can be rebuilt and queried without a context.
+ *
+ * A rebuild samples the height and analytic normal of every cell corner
+ * (rows + 1 by cols + 1, so the window border gets real neighbours), each
+ * independently, then assembles the cells from their four corners. Both
+ * passes split their rows across threads.
+ */
+class Heightfield {
+public:
+  static constexpr size_t kRebuildGrain = 8; /* rows per job */
+
+  // Rebuilds are split into jobs on jobs when it is set
+  Heightfield(size_t rows, size_t cols, uint32_t seed,
+              JobSystem *jobs = nullptr);
+
+  void rebuild(int x, int z);
+  // rebuild() on another scheduler: parallel_for(rows, fn) must call
+  // fn(begin, end) over ranges covering [0, rows) and return once all ran
+  template <typename ParallelFor>
+  void rebuildWith(int x, int z, ParallelFor parallel_for);
+  bool isPositionLegal(const glm::vec3 &loc) const;
+
+  size_t rows() const { return rows_; }
+  size_t cols() const { return cols_; }
+  int cachedX() const { return cached_x_; }
+  int cachedZ() const { return cached_z_; }
+  uint32_t seed() const { return seed_; }
+  const std::vector<glm::vec3> &offsets() const { return offsets_; }
+  const std::vector<glm::vec4> &heightVec() const { return heightVec_; }
+  const std::vector<glm::vec3> &norm0() const { return norm0_; }
+  const std::vector<glm::vec3> &norm1() const { return norm1_; }
+  const std::vector<glm::vec3> &norm2() const { return norm2_; }
+  const std::vector<glm::vec3> &norm3() const { return norm3_; }
+
+private:
+  // Height and normal of one cell corner
+  struct Corner {
+    float height;
+    glm::vec3 normal;
+  };
+
+  void sampleRows(int x, int z, Corner *corners, size_t begin, size_t end);
+  void assembleRows(int x, int z, const Corner *corners, size_t begin,
+                    size_t end);
+  float blockHeight(int x, int z) const;
+
+  size_t rows_;
+  size_t cols_;
+  uint32_t seed_;
+  JobSystem *jobs_;
+  int cached_x_ = 0;
+  int cached_z_ = 0;
+  std::vector<glm::vec3> offsets_;
+  std::vector<glm::vec4> heightVec_;
+  std::vector<glm::vec3> norm0_;
+  std::vector<glm::vec3> norm1_;
+  std::vector<glm::vec3> norm2_;
+  std::vector<glm::vec3> norm3_;
+};
+
+template <typename ParallelFor>
+void Heightfield::rebuildWith(int x, int z, ParallelFor parallel_for) {
+  // Corner samples, only needed until they are copied into the cells
+  FrameArena::Scope scope;
+  auto samples = ArenaVector<Corner>((rows_ + 1) * (cols_ + 1));
+  Corner *corners = samples.data();
+  parallel_for(rows_ + 1, [this, x, z, corners](size_t begin, size_t end) {
+    sampleRows(x, z, corners, begin, end);
+  });
+  parallel_for(rows_, [this, x, z, corners](size_t begin, size_t end) {
+    assembleRows(x, z, corners, begin, end);
+  });
+  cached_x_ = x;
+  cached_z_ = z;
+}
@@ -0,0 +1,204 @@
+#include "job_system.h"
+
+namespace {
+
+// Set on the workers, so jobs they schedule stay on their own deque
+thread_local const JobSystem *worker_system = nullptr;
+thread_local size_t worker_index = 0;
+}
+
+// Fixed capacity deque of jobs, its owner pushes and pops at the back
+class JobSystem::Queue {
+public:
+  static constexpr size_t kCapacity = 1024;
+
+  bool push(const Job &job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (size_ == kCapacity) {
+      return false;
+    }
+    jobs_[(head_ + size_) % kCapacity] = job;
+    size_++;
+    return true;
+  }
+
+  bool popBack(Job &job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (size_ == 0) {
+      return false;
+    }
+    size_--;
+    job = jobs_[(head_ + size_) % kCapacity];
+    return true;
+  }
+
+  bool popFront(Job &job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (size_ == 0) {
+      return false;
+    }
+    job = jobs_[head_];
+    head_ = (head_ + 1) % kCapacity;
+    size_--;
+    return true;
+  }
+
+private:
+  std::mutex mutex_;
+  std::array<Job, kCapacity> jobs_;
+  size_t head_ = 0;
+  size_t size_ = 0;
+};
+
+JobSystem::JobSystem(size_t threads)
+    : shared_(new Queue()), background_(new Queue()) {
+  threads = std::max<size_t>(threads, 1);
+  for (size_t i = 0; i < threads; i++) {
+    queues_.emplace_back(new Queue());
+  }
+  for (size_t i = 0; i < threads; i++) {
+    workers_.emplace_back(&JobSystem::workerLoop, this, i);
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stopping_ = true;
+  }
+  sleep_cv_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+size_t JobSystem::defaultThreads() {
+  size_t cores = std::thread::hardware_concurrency();
+  return cores > 2 ? cores - 2 : 1;
+}
+
+void JobSystem::run(const Job &job, JobCounter *after) {
+  if (job.counter) {
+    job.counter->pending_.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (after) {
+    std::unique_lock<std::mutex> lock(after->mutex_);
+    if (after->pending_.load(std::memory_order_acquire) > 0) {
+      if (after->continuation_count_ < JobCounter::kMaxContinuations) {
+        after->continuations_[after->continuation_count_++] = job;
+        return;
+      }
+      // No room to park it, help the dependencies along instead
+      lock.unlock();
+      wait(*after);
+    }
+  }
+  schedule(job, false);
+}
+
+void JobSystem::runInBackground(const Job &job) {
+  if (job.counter) {
+    job.counter->pending_.fetch_add(1, std::memory_order_relaxed);
+  }
+  schedule(job, true);
+}
+
+void JobSystem::wait(JobCounter &counter) {
+  Job job;
+  while (!counter.done()) {
+    if (take(job, false)) {
+      execute(job);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  // The thread that finished the last job may still hold the mutex, take it
+  // once so the counter can be destroyed as soon as this returns
+  std::lock_guard<std::mutex> lock(counter.mutex_);
+}
+
+void JobSystem::schedule(const Job &job, bool background) {
+  Queue *queue = background_.get();
+  if (!background) {
+    bool worker = worker_system == this;
+    queue = worker ? queues_[worker_index].get() : shared_.get();
+  }
+  // Counted before it is visible, so a thief never takes queued_ below 0
+  queued_.fetch_add(1);
+  if (!queue->push(job)) {
+    queued_.fetch_sub(1);
+    execute(job);
+    return;
+  }
+  // A worker going to sleep checks queued_ after announcing itself in
+  // sleeping_, so either it sees this job or this sees it sleeping
+  if (sleeping_.load() > 0) {
+    { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+    sleep_cv_.notify_one();
+  }
+}
+
+/**
+ * Own deque newest first, then the shared queue, then steal the oldest job
+ * of another worker. Background jobs come last and only for the workers.
+ */
+bool JobSystem::take(Job &job, bool background) {
+  bool worker = worker_system == this;
+  bool found = (worker && queues_[worker_index]->popBack(job)) ||
+               shared_->popFront(job);
+  size_t count = queues_.size();
+  for (size_t i = 1; !found && i <= count; i++) {
+    size_t victim = worker ? (worker_index + i) % count : i - 1;
+    found = queues_[victim]->popFront(job);
+  }
+  if (!found && background) {
+    found = background_->popFront(job);
+  }
+  if (found) {
+    queued_.fetch_sub(1);
+  }
+  return found;
+}
+
+void JobSystem::execute(const Job &job) {
+  job.function(job.data, job.begin, job.end);
+  if (job.counter) {
+    finish(*job.counter);
+  }
+}
+
+void JobSystem::finish(JobCounter &counter) {
+  std::array<Job, JobCounter::kMaxContinuations> ready;
+  size_t ready_count = 0;
+  {
+    std::lock_guard<std::mutex> lock(counter.mutex_);
+    if (counter.pending_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      return;
+    }
+    ready_count = counter.continuation_count_;
+    std::copy_n(counter.continuations_.begin(), ready_count, ready.begin());
+    counter.continuation_count_ = 0;
+  }
+  for (size_t i = 0; i < ready_count; i++) {
+    schedule(ready[i], false);
+  }
+}
+
+void JobSystem::workerLoop(size_t index) {
+  worker_system = this;
+  worker_index = index;
+  Job job;
+  while (true) {
+    if (take(job, true)) {
+      execute(job);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    sleeping_.fetch_add(1);
+    sleep_cv_.wait(lock, [this]() { return queued_.load() > 0 || stopping_; });
+    sleeping_.fetch_sub(1);
+    if (queued_.load() == 0 && stopping_) {
+      return;
+    }
+  }
+}
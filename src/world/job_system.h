@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobCounter;
+
+/*
+ * A unit of work: function(data, begin, end). Plain data, so scheduling a
+ * job never allocates. When counter is set, the job is counted on it from
+ * the moment it is scheduled until it has finished.
+ */
+struct Job {
+  using Function = void (*)(void *data, size_t begin, size_t end);
+
+  Function function = nullptr;
+  void *data = nullptr;
+  size_t begin = 0;
+  size_t end = 0;
+  JobCounter *counter = nullptr;
+};
+
+// Number of unfinished jobs counted on it, see JobSystem::wait()
+class JobCounter {
+public:
+  JobCounter() = default;
+  JobCounter(const JobCounter &) = delete;
+  JobCounter &operator=(const JobCounter &) = delete;
+
+  bool done() const { return pending_.load(std::memory_order_acquire) == 0; }
+
+private:
+  friend class JobSystem;
+  static constexpr size_t kMaxContinuations = 16;
+
+  std::atomic<int> pending_{0};
+  std::mutex mutex_;
+  // Jobs waiting for this counter to reach 0
+  std::array<Job, kMaxContinuations> continuations_;
+  size_t continuation_count_ = 0;
+};
+
+/*
+ * Work-stealing job scheduler shared by the engine: terrain rebuilds, mesh
+ * loading, image decoding and frame encoding all run on its workers.
+ *
+ * Every worker owns a deque. Jobs a worker schedules go to the back of its
+ * own deque and it takes them back newest first, while idle workers steal
+ * the oldest jobs from the front of the others. Jobs scheduled from other
+ * threads (render, simulation) go through a shared queue, oldest first.
+ *
+ * A thread waiting for a counter runs queued jobs in the meantime, so waits
+ * can nest inside jobs without tying up the workers. Long running work that
+ * should not be picked up that way, such as encoding a captured frame, goes
+ * through runInBackground() or submit() instead, which only the workers run.
+ *
+ * The queues have a fixed capacity and a job that does not fit runs right
+ * away on the scheduling thread, so scheduling a Job never allocates.
+ * submit() does, for its task and future, and is meant for one-off work such
+ * as loading assets; per-frame work schedules Jobs. Jobs must not touch GL.
+ */
+class JobSystem {
+public:
+  // Defaults to one worker per core, minus the render and simulation threads
+  explicit JobSystem(size_t threads = defaultThreads());
+  // Finishes every queued job before joining
+  ~JobSystem();
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+
+  // Schedule job, or once every job counted on after is done if it is set.
+  // Jobs may schedule further jobs.
+  void run(const Job &job, JobCounter *after = nullptr);
+  // Schedule job on the background queue, which only the workers run, for
+  // long jobs that should not stall a thread in wait(). Waiting on their
+  // counter is fine, it just does not help them along.
+  void runInBackground(const Job &job);
+  // Runs queued jobs until every job counted on counter is done
+  void wait(JobCounter &counter);
+
+  /**
+   * Calls fn(begin, end) for consecutive ranges of at most grain items that
+   * cover [0, count), concurrently, and returns once all of them are done.
+   * The calling thread works on the ranges too.
+   */
+  template <typename F> void parallelFor(size_t count, size_t grain, F fn) {
+    if (count == 0) {
+      return;
+    }
+    grain = std::max<size_t>(grain, 1);
+    JobCounter counter;
+    Job job;
+    job.function = [](void *data, size_t begin, size_t end) {
+      (*static_cast<F *>(data))(begin, end);
+    };
+    job.data = &fn;
+    job.counter = &counter;
+    for (size_t begin = grain; begin < count; begin += grain) {
+      job.begin = begin;
+      job.end = std::min(begin + grain, count);
+      run(job);
+    }
+    fn(size_t(0), std::min(grain, count));
+    wait(counter);
+  }
+
+  // Background task with a result, started by a worker in submission order.
+  // Allocates the task and the future's shared state, unlike run()
+  template <typename F> auto submit(F task) -> std::future<decltype(task())> {
+    using Task = std::packaged_task<decltype(task())()>;
+    auto *packaged = new Task(std::move(task));
+    auto future = packaged->get_future();
+    Job job;
+    job.function = [](void *data, size_t, size_t) {
+      auto *packaged = static_cast<Task *>(data);
+      (*packaged)();
+      delete packaged;
+    };
+    job.data = packaged;
+    schedule(job, true);
+    return future;
+  }
+
+  size_t size() const { return workers_.size(); }
+  static size_t defaultThreads();
+
+private:
+  class Queue;
+
+  void schedule(const Job &job, bool background);
+  bool take(Job &job, bool background);
+  void execute(const Job &job);
+  void finish(JobCounter &counter);
+  void workerLoop(size_t index);
+
+  std::vector<std::unique_ptr<Queue>> queues_; /* one per worker */
+  std::unique_ptr<Queue> shared_;
+  std::unique_ptr<Queue> background_;
+  std::vector<std::thread> workers_;
+
+  // Workers sleep while nothing is queued
+  std::atomic<size_t> queued_{0};
+  std::atomic<size_t> sleeping_{0};
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+  std::atomic<bool> stopping_{false};
+};
@@ -0,0 +1,455 @@
+#include "navigation.h"
+
+#include "perlin.hpp"
+#include "shore_distance.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <utility>
+
+constexpr int NavGraph::kClusterCells;
+constexpr size_t NavGraph::kMaxClusters;
+constexpr int NavGraph::kSearchMargin;
+constexpr size_t PathPlanner::kDefaultBudget;
+
+namespace {
+
+const float kInfinity = std::numeric_limits<float>::infinity();
+const float kDiagonal = 1.41421356f;
+constexpr int kCells = NavGraph::kClusterCells * NavGraph::kClusterCells;
+constexpr int kHaloSide = NavGraph::kClusterCells + 2;
+
+// The 8 neighbours of a cell and what stepping to them costs, in cells
+const int kStepX[8] = {1, -1, 0, 0, 1, 1, -1, -1};
+const int kStepZ[8] = {0, 0, 1, -1, 1, -1, 1, -1};
+const float kStepCost[8] = {1.0f,      1.0f,      1.0f,      1.0f,
+                            kDiagonal, kDiagonal, kDiagonal, kDiagonal};
+
+int floorDiv(int value, int divisor) {
+  return value >= 0 ? value / divisor : -((divisor - 1 - value) / divisor);
+}
+
+glm::ivec2 clusterOf(const glm::ivec2 &cell) {
+  return {floorDiv(cell.x, NavGraph::kClusterCells),
+          floorDiv(cell.y, NavGraph::kClusterCells)};
+}
+
+uint64_t packKey(const glm::ivec2 &key) {
+  return (uint64_t(uint32_t(key.x)) << 32) | uint32_t(key.y);
+}
+
+// Octile distance, the shortest 8 neighbour route without obstacles
+float octile(const glm::ivec2 &a, const glm::ivec2 &b) {
+  int dx = std::abs(a.x - b.x), dz = std::abs(a.y - b.y);
+  return float(std::max(dx, dz)) +
+         (kDiagonal - 1.0f) * float(std::min(dx, dz));
+}
+
+// Min-heap of (cost, index) pairs on top of a std heap
+using HeapEntry = std::pair<float, int>;
+void heapPush(HeapEntry *heap, int &size, float cost, int index) {
+  heap[size++] = {cost, index};
+  std::push_heap(heap, heap + size, std::greater<HeapEntry>());
+}
+HeapEntry heapPop(HeapEntry *heap, int &size) {
+  std::pop_heap(heap, heap + size, std::greater<HeapEntry>());
+  return heap[--size];
+}
+}
+
+struct NavGraph::Cluster {
+  glm::ivec2 key;
+  // Water per cell, with a one cell border of the neighbouring clusters
+  std::array<bool, kHaloSide * kHaloSide> water;
+  std::vector<Portal> portals;
+  std::vector<float> costs; /* portals x portals, in cells */
+
+  glm::ivec2 origin() const { return key * kClusterCells; }
+  // Cells from -1 to kClusterCells, relative to origin()
+  bool isWater(int x, int z) const {
+    return water[(x + 1) * kHaloSide + z + 1];
+  }
+  int local(const glm::ivec2 &cell) const {
+    glm::ivec2 offset = cell - origin();
+    return offset.x * kClusterCells + offset.y;
+  }
+
+  /**
+   * Dijkstra over the cells of the cluster from local cell source, without
+   * leaving the cluster. distance and parent hold kCells entries, parent
+   * is -1 for the source and for cells it can not reach.
+   */
+  void distances(int source, float *distance, int *parent) const {
+    std::fill(distance, distance + kCells, kInfinity);
+    std::fill(parent, parent + kCells, -1);
+    // A cell is settled once and then pushes each of its neighbours once
+    HeapEntry heap[8 * kCells + 1];
+    int size = 0;
+    distance[source] = 0.0f;
+    heapPush(heap, size, 0.0f, source);
+    while (size > 0) {
+      HeapEntry top = heapPop(heap, size);
+      if (top.first > distance[top.second]) {
+        continue;
+      }
+      int x = top.second / kClusterCells, z = top.second % kClusterCells;
+      for (int step = 0; step < 8; step++) {
+        int nx = x + kStepX[step], nz = z + kStepZ[step];
+        if (nx < 0 || nz < 0 || nx >= kClusterCells || nz >= kClusterCells ||
+            !isWater(nx, nz) || !isWater(nx, z) || !isWater(x, nz)) {
+          continue;
+        }
+        int next = nx * kClusterCells + nz;
+        float cost = top.first + kStepCost[step];
+        if (cost < distance[next]) {
+          distance[next] = cost;
+          parent[next] = top.second;
+          heapPush(heap, size, cost, next);
+        }
+      }
+    }
+  }
+};
+
+NavGraph::NavGraph(uint32_t seed) : seed_(seed) {}
+
+bool NavGraph::isWater(int x, int z) const {
+  return perlin::getHeight(float(x) * perlin::kBlockSize,
+                           float(z) * perlin::kBlockSize,
+                           seed_) < ShoreDistance::kWaterLevel;
+}
+
+size_t NavGraph::cachedClusters() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return clusters_.size();
+}
+
+std::shared_ptr<const NavGraph::Cluster>
+NavGraph::cluster(const glm::ivec2 &key) const {
+  uint64_t packed = packKey(key);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = clusters_.find(packed);
+    if (found != clusters_.end()) {
+      found->second.last_used = ++clock_;
+      return found->second.cluster;
+    }
+  }
+  // Racing builds of one cluster give the same result, the first one stays
+  auto built = build(key);
+  built_++;
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto entry = clusters_.emplace(packed, CacheEntry{built, 0}).first;
+  entry->second.last_used = ++clock_;
+  auto cluster = entry->second.cluster;
+  if (clusters_.size() > kMaxClusters) {
+    // Drop the least recently used quarter at once, searches still holding
+    // one of them keep it alive
+    std::vector<uint64_t> stamps;
+    stamps.reserve(clusters_.size());
+    for (const auto &cached : clusters_) {
+      stamps.push_back(cached.second.last_used);
+    }
+    auto cut = stamps.begin() + kMaxClusters / 4;
+    std::nth_element(stamps.begin(), cut, stamps.end());
+    for (auto it = clusters_.begin(); it != clusters_.end();) {
+      it = it->second.last_used < *cut ? clusters_.erase(it) : std::next(it);
+    }
+  }
+  return cluster;
+}
+
+std::shared_ptr<const NavGraph::Cluster>
+NavGraph::build(const glm::ivec2 &key) const {
+  auto cluster = std::make_shared<Cluster>();
+  cluster->key = key;
+  glm::ivec2 origin = cluster->origin();
+  for (int x = -1; x <= kClusterCells; x++) {
+    for (int z = -1; z <= kClusterCells; z++) {
+      cluster->water[(x + 1) * kHaloSide + z + 1] =
+          isWater(origin.x + x, origin.y + z);
+    }
+  }
+
+  // Walk each border in the same direction as the cluster across it does,
+  // so both put the portal of a run on the same cells
+  struct Side {
+    glm::ivec2 first, along, across;
+  };
+  const Side sides[4] = {{{0, 0}, {0, 1}, {-1, 0}},
+                         {{kClusterCells - 1, 0}, {0, 1}, {1, 0}},
+                         {{0, 0}, {1, 0}, {0, -1}},
+                         {{0, kClusterCells - 1}, {1, 0}, {0, 1}}};
+  for (const Side &side : sides) {
+    int run = -1;
+    for (int t = 0; t <= kClusterCells; t++) {
+      glm::ivec2 cell = side.first + side.along * t;
+      glm::ivec2 other = cell + side.across;
+      bool open = t < kClusterCells && cluster->isWater(cell.x, cell.y) &&
+                  cluster->isWater(other.x, other.y);
+      if (open && run < 0) {
+        run = t;
+      } else if (!open && run >= 0) {
+        glm::ivec2 middle = side.first + side.along * ((run + t - 1) / 2);
+        cluster->portals.push_back({origin + middle, side.across});
+        run = -1;
+      }
+    }
+  }
+
+  size_t count = cluster->portals.size();
+  cluster->costs.resize(count * count);
+  float distance[kCells];
+  int parent[kCells];
+  for (size_t p = 0; p < count; p++) {
+    cluster->distances(cluster->local(cluster->portals[p].cell), distance,
+                       parent);
+    for (size_t q = 0; q < count; q++) {
+      cluster->costs[p * count + q] =
+          distance[cluster->local(cluster->portals[q].cell)];
+    }
+  }
+  return cluster;
+}
+
+/**
+ * A* over the portals of the clusters in the search box, plus a start and a
+ * goal node linked to the portals of their clusters (and to each other when
+ * they share one). Edges between two portals of one cluster cost the water
+ * distance inside it, the step across a border costs one cell. Every leg of
+ * the route is then retraced inside its cluster.
+ */
+bool NavGraph::findPath(const glm::vec3 &from, const glm::vec3 &to,
+                        NavPath &path) const {
+  path.waypoints.clear();
+  path.length = 0.0f;
+  glm::ivec2 start{int(std::floor(from.x / perlin::kBlockSize)),
+                   int(std::floor(from.z / perlin::kBlockSize))};
+  glm::ivec2 goal{int(std::floor(to.x / perlin::kBlockSize)),
+                  int(std::floor(to.z / perlin::kBlockSize))};
+  if (!isWater(start.x, start.y) || !isWater(goal.x, goal.y)) {
+    return false;
+  }
+  glm::ivec2 start_key = clusterOf(start), goal_key = clusterOf(goal);
+  glm::ivec2 box_lo = glm::min(start_key, goal_key) - kSearchMargin;
+  glm::ivec2 box_hi = glm::max(start_key, goal_key) + kSearchMargin;
+
+  // Clusters reached so far, each holding the nodes of its portals
+  struct Pinned {
+    std::shared_ptr<const Cluster> cluster;
+    int first_node;
+  };
+  struct Node {
+    int pinned;
+    int portal; /* -1 for the start and the goal */
+    float cost = kInfinity;
+    int parent = -1;
+    bool closed = false;
+  };
+  std::vector<Pinned> pinned;
+  std::unordered_map<uint64_t, int> pinned_index;
+  std::vector<Node> nodes(2, Node{0, -1});
+  const int kStart = 0, kGoal = 1;
+  auto pin = [&](const glm::ivec2 &key) {
+    auto found = pinned_index.find(packKey(key));
+    if (found != pinned_index.end()) {
+      return found->second;
+    }
+    int index = int(pinned.size());
+    pinned.push_back({cluster(key), int(nodes.size())});
+    for (size_t p = 0; p < pinned.back().cluster->portals.size(); p++) {
+      nodes.push_back({index, int(p)});
+    }
+    pinned_index.emplace(packKey(key), index);
+    return index;
+  };
+  // Pinning grows nodes, so not in the same expression as nodes[]
+  int start_pinned = pin(start_key);
+  int goal_pinned = pin(goal_key);
+  nodes[kStart].pinned = start_pinned;
+  nodes[kGoal].pinned = goal_pinned;
+  auto cell_of = [&](int node) {
+    if (node == kStart || node == kGoal) {
+      return node == kStart ? start : goal;
+    }
+    const Node &n = nodes[node];
+    return pinned[n.pinned].cluster->portals[n.portal].cell;
+  };
+
+  const Cluster &start_cluster = *pinned[nodes[kStart].pinned].cluster;
+  const Cluster &goal_cluster = *pinned[nodes[kGoal].pinned].cluster;
+  float from_start[kCells], to_goal[kCells];
+  int parent[kCells];
+  start_cluster.distances(start_cluster.local(start), from_start, parent);
+  goal_cluster.distances(goal_cluster.local(goal), to_goal, parent);
+
+  std::vector<HeapEntry> open;
+  auto relax = [&](int node, int next, float cost) {
+    float total = nodes[node].cost + cost;
+    if (cost == kInfinity || nodes[next].closed ||
+        total >= nodes[next].cost) {
+      return;
+    }
+    nodes[next].cost = total;
+    nodes[next].parent = node;
+    open.emplace_back(total + octile(cell_of(next), goal), next);
+    std::push_heap(open.begin(), open.end(), std::greater<HeapEntry>());
+  };
+  nodes[kStart].cost = 0.0f;
+  open.emplace_back(octile(start, goal), kStart);
+  while (!open.empty()) {
+    std::pop_heap(open.begin(), open.end(), std::greater<HeapEntry>());
+    int node = open.back().second;
+    open.pop_back();
+    if (nodes[node].closed) {
+      continue;
+    }
+    nodes[node].closed = true;
+    if (node == kGoal) {
+      break;
+    }
+    // Copied, pinning below can move pinned and nodes
+    Pinned here = pinned[nodes[node].pinned];
+    const Cluster &cluster = *here.cluster;
+    int count = int(cluster.portals.size());
+    if (node == kStart) {
+      for (int q = 0; q < count; q++) {
+        relax(node, here.first_node + q,
+              from_start[cluster.local(cluster.portals[q].cell)]);
+      }
+      if (start_key == goal_key) {
+        relax(node, kGoal, from_start[cluster.local(goal)]);
+      }
+      continue;
+    }
+    int p = nodes[node].portal;
+    const Portal &portal = cluster.portals[p];
+    for (int q = 0; q < count; q++) {
+      if (q != p) {
+        relax(node, here.first_node + q, cluster.costs[p * count + q]);
+      }
+    }
+    if (cluster.key == goal_key) {
+      relax(node, kGoal, to_goal[cluster.local(portal.cell)]);
+    }
+    glm::ivec2 partner = portal.cell + portal.across;
+    glm::ivec2 next_key = clusterOf(partner);
+    if (next_key.x < box_lo.x || next_key.y < box_lo.y ||
+        next_key.x > box_hi.x || next_key.y > box_hi.y) {
+      continue;
+    }
+    int next = pin(next_key);
+    const Cluster &next_cluster = *pinned[next].cluster;
+    for (size_t q = 0; q < next_cluster.portals.size(); q++) {
+      if (next_cluster.portals[q].cell == partner) {
+        relax(node, pinned[next].first_node + int(q), 1.0f);
+        break;
+      }
+    }
+  }
+  if (!nodes[kGoal].closed) {
+    return false;
+  }
+
+  // Retrace the legs, nodes in one cluster are joined through it
+  std::vector<int> route;
+  for (int node = kGoal; node != -1; node = nodes[node].parent) {
+    route.push_back(node);
+  }
+  std::reverse(route.begin(), route.end());
+  std::vector<glm::ivec2> cells{start};
+  float distance[kCells];
+  for (size_t leg = 1; leg < route.size(); leg++) {
+    glm::ivec2 leg_start = cell_of(route[leg - 1]);
+    glm::ivec2 leg_end = cell_of(route[leg]);
+    if (nodes[route[leg - 1]].pinned != nodes[route[leg]].pinned) {
+      cells.push_back(leg_end);
+      continue;
+    }
+    const Cluster &cluster = *pinned[nodes[route[leg]].pinned].cluster;
+    cluster.distances(cluster.local(leg_start), distance, parent);
+    size_t first = cells.size();
+    glm::ivec2 origin = cluster.origin();
+    for (int cell = cluster.local(leg_end); parent[cell] != -1;
+         cell = parent[cell]) {
+      cells.push_back(origin + glm::ivec2{cell / kClusterCells,
+                                          cell % kClusterCells});
+    }
+    std::reverse(cells.begin() + first, cells.end());
+  }
+
+  // Keep the cells where the heading changes
+  auto center = [](const glm::ivec2 &cell) {
+    return glm::vec3{(float(cell.x) + 0.5f) * perlin::kBlockSize,
+                     ShoreDistance::kWaterLevel,
+                     (float(cell.y) + 0.5f) * perlin::kBlockSize};
+  };
+  path.waypoints.push_back(center(cells.front()));
+  for (size_t i = 1; i < cells.size(); i++) {
+    glm::ivec2 step = cells[i] - cells[i - 1];
+    path.length += (step.x != 0 && step.y != 0 ? kDiagonal : 1.0f) *
+                   perlin::kBlockSize;
+    if (i + 1 == cells.size() || cells[i + 1] - cells[i] != step) {
+      path.waypoints.push_back(center(cells[i]));
+    }
+  }
+  return true;
+}
+
+PathPlanner::PathPlanner(const NavGraph &graph, JobSystem &jobs,
+                         size_t budget)
+    : graph_(graph), jobs_(jobs), budget_(budget) {}
+
+PathPlanner::~PathPlanner() { wait(); }
+
+uint32_t PathPlanner::request(const glm::vec3 &from, const glm::vec3 &to) {
+  uint32_t ticket = next_ticket_++;
+  auto request = std::make_unique<Request>();
+  request->from = from;
+  request->to = to;
+  request->graph = &graph_;
+  requests_.emplace(ticket, std::move(request));
+  queue_.push_back(ticket);
+  return ticket;
+}
+
+void PathPlanner::update() {
+  for (size_t started = 0; started < budget_ && !queue_.empty(); started++) {
+    Request *request = requests_.at(queue_.front()).get();
+    queue_.pop_front();
+    request->started = true;
+    Job job;
+    job.function = [](void *data, size_t, size_t) {
+      auto *request = static_cast<Request *>(data);
+      request->found =
+          request->graph->findPath(request->from, request->to, request->path);
+      request->done.store(true, std::memory_order_release);
+    };
+    job.data = request;
+    job.counter = &running_;
+    // A search can take milliseconds, keep it off threads waiting mid-frame
+    jobs_.runInBackground(job);
+  }
+}
+
+PathPlanner::Status PathPlanner::result(uint32_t ticket, NavPath &path) {
+  auto found = requests_.find(ticket);
+  if (found == requests_.end()) {
+    return Status::Unknown;
+  }
+  Request &request = *found->second;
+  if (!request.started) {
+    return Status::Queued;
+  }
+  if (!request.done.load(std::memory_order_acquire)) {
+    return Status::Running;
+  }
+  Status status = request.found ? Status::Found : Status::NotFound;
+  path = std::move(request.path);
+  requests_.erase(found);
+  return status;
+}
+
+void PathPlanner::wait() { jobs_.wait(running_); }
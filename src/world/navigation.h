@@ -0,0 +1,127 @@
+#pragma once
+
+#include "job_system.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <glm/glm.hpp>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Cell by cell route over water, see NavGraph::findPath
+struct NavPath {
+  std::vector<glm::vec3> waypoints; /* cell centers where the heading turns */
+  float length = 0.0f;
+};
+
+/*
+ * Hierarchical A* (HPA*) over the open water of the unbounded terrain. A
+ * cell is water when perlin::getHeight at its corner is below
+ * ShoreDistance::kWaterLevel, like Heightfield::isPositionLegal, and boats
+ * move between the 8 neighbours of a cell without cutting past land.
+ *
+ * The world is split into clusters of kClusterCells x kClusterCells cells,
+ * built on first use straight from the noise (no heightfield window needed)
+ * and cached, least recently used first out past kMaxClusters. Every run of
+ * open cells along a cluster border gets a portal at its middle, and a
+ * cluster keeps the water distances between its own portals, so both sides
+ * of a border find the same portals without seeing each other. A search runs
+ * A* over the portals, then follows each leg cell by cell inside its cluster.
+ *
+ * Searches only consider the clusters within kSearchMargin of the box around
+ * both ends, which bounds the work when there is no route. findPath() can run
+ * on any number of threads at once.
+ */
+class NavGraph {
+public:
+  static constexpr int kClusterCells = 16;
+  static constexpr size_t kMaxClusters = 4096;
+  static constexpr int kSearchMargin = 2; /* clusters */
+
+  // seed is the terrain seed, World::terrainSeed()
+  explicit NavGraph(uint32_t seed);
+
+  // Route between the cells of from and to, false if either is on land or
+  // no route stays within the search box
+  bool findPath(const glm::vec3 &from, const glm::vec3 &to,
+                NavPath &path) const;
+  bool isWater(int x, int z) const;
+
+  size_t cachedClusters() const;
+  size_t builtClusters() const { return built_.load(); }
+
+private:
+  struct Portal {
+    glm::ivec2 cell;   /* world cell */
+    glm::ivec2 across; /* step to the partner cell in the next cluster */
+  };
+  struct Cluster;
+  struct CacheEntry {
+    std::shared_ptr<const Cluster> cluster;
+    uint64_t last_used;
+  };
+
+  // Cached, or built (outside the lock) and cached
+  std::shared_ptr<const Cluster> cluster(const glm::ivec2 &key) const;
+  std::shared_ptr<const Cluster> build(const glm::ivec2 &key) const;
+
+  uint32_t seed_;
+  mutable std::mutex mutex_;
+  mutable std::unordered_map<uint64_t, CacheEntry> clusters_;
+  mutable uint64_t clock_ = 0;
+  mutable std::atomic<size_t> built_{0};
+};
+
+/*
+ * Path requests served in the background, e.g. for many AI boats. request()
+ * queues a search, update() starts at most budget of them per frame as
+ * background jobs, which only the workers run, and result() hands a finished
+ * path over once. Everything but the jobs themselves belongs to the thread
+ * that makes the requests.
+ */
+class PathPlanner {
+public:
+  static constexpr size_t kDefaultBudget = 16; /* searches per update() */
+
+  enum class Status { Queued, Running, Found, NotFound, Unknown };
+
+  // graph must outlive the planner
+  PathPlanner(const NavGraph &graph, JobSystem &jobs,
+              size_t budget = kDefaultBudget);
+  // Waits for the searches still running
+  ~PathPlanner();
+  PathPlanner(const PathPlanner &) = delete;
+  PathPlanner &operator=(const PathPlanner &) = delete;
+
+  uint32_t request(const glm::vec3 &from, const glm::vec3 &to);
+  // Start queued searches, oldest first, up to the budget
+  void update();
+  // Found moves the path into path and forgets the request, as does
+  // NotFound. Unknown for tickets that were already handed over.
+  Status result(uint32_t ticket, NavPath &path);
+  // Blocks until every started search is done
+  void wait();
+
+  size_t queued() const { return queue_.size(); }
+
+private:
+  struct Request {
+    glm::vec3 from;
+    glm::vec3 to;
+    NavPath path;
+    bool started = false;
+    bool found = false;
+    std::atomic<bool> done{false};
+    const NavGraph *graph;
+  };
+
+  const NavGraph &graph_;
+  JobSystem &jobs_;
+  size_t budget_;
+  uint32_t next_ticket_ = 0;
+  std::deque<uint32_t> queue_;
+  std::unordered_map<uint32_t, std::unique_ptr<Request>> requests_;
+  JobCounter running_;
+};
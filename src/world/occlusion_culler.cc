@@ -0,0 +1,347 @@
+#include "occlusion_culler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+constexpr int OcclusionCuller::kWidth;
+constexpr int OcclusionCuller::kHeight;
+constexpr int OcclusionCuller::kTileWidth;
+constexpr int OcclusionCuller::kTileHeight;
+constexpr int OcclusionCuller::kBlockSize;
+constexpr int OccluderMesh::kBlockQuads;
+
+namespace {
+
+constexpr int kTilesX = OcclusionCuller::kWidth / OcclusionCuller::kTileWidth;
+constexpr int kTilesY =
+    OcclusionCuller::kHeight / OcclusionCuller::kTileHeight;
+constexpr int kBlocksX = OcclusionCuller::kWidth / OcclusionCuller::kBlockSize;
+constexpr int kBlocksY =
+    OcclusionCuller::kHeight / OcclusionCuller::kBlockSize;
+
+// Anything closer to the eye than this is never culled, nor does it occlude
+constexpr float kMinW = 1e-2f;
+
+static_assert(OcclusionCuller::kTileWidth % 4 == 0,
+              "tiles are rasterized 4 pixels at a time");
+static_assert(OcclusionCuller::kTileWidth % OcclusionCuller::kBlockSize ==
+                      0 &&
+                  OcclusionCuller::kTileHeight %
+                          OcclusionCuller::kBlockSize ==
+                      0,
+              "min-depth blocks must not straddle tiles");
+
+// Edge functions lose too much precision far off screen
+bool inGuardBand(const glm::vec2 &screen) {
+  return std::abs(screen.x - 0.5f * OcclusionCuller::kWidth) <=
+             1.5f * OcclusionCuller::kWidth &&
+         std::abs(screen.y - 0.5f * OcclusionCuller::kHeight) <=
+             1.5f * OcclusionCuller::kHeight;
+}
+
+glm::vec2 toScreen(const glm::vec4 &clip) {
+  return {(clip.x / clip.w * 0.5f + 0.5f) * OcclusionCuller::kWidth,
+          (clip.y / clip.w * 0.5f + 0.5f) * OcclusionCuller::kHeight};
+}
+}
+
+void OccluderMesh::addTerrain(const float *heights, int verts,
+                              const glm::vec2 &origin, float spacing,
+                              const glm::ivec4 &hole) {
+  int blocks = (verts - 1 + kBlockQuads - 1) / kBlockQuads;
+  auto in_hole = [&hole](int bx, int bz) {
+    return bx * kBlockQuads >= hole.x &&
+           (bx + 1) * kBlockQuads <= hole.x + hole.z &&
+           bz * kBlockQuads >= hole.y &&
+           (bz + 1) * kBlockQuads <= hole.y + hole.w;
+  };
+  // Lowest vertex of a block, its edges included, so a wall between two
+  // blocks is below the surface on their shared edge
+  auto lowest = [heights, verts](int bx, int bz) {
+    float low = heights[bx * kBlockQuads * verts + bz * kBlockQuads];
+    int end_i = std::min((bx + 1) * kBlockQuads, verts - 1);
+    int end_j = std::min((bz + 1) * kBlockQuads, verts - 1);
+    for (int i = bx * kBlockQuads; i <= end_i; i++) {
+      for (int j = bz * kBlockQuads; j <= end_j; j++) {
+        low = std::min(low, heights[i * verts + j]);
+      }
+    }
+    return low;
+  };
+  auto corner = [&origin, spacing, verts](int i, int j) {
+    return glm::vec2{origin.x + float(std::min(i, verts - 1)) * spacing,
+                     origin.y + float(std::min(j, verts - 1)) * spacing};
+  };
+  auto quad = [this](const glm::vec3 &v00, const glm::vec3 &v01,
+                     const glm::vec3 &v10, const glm::vec3 &v11) {
+    unsigned base = unsigned(vertices.size());
+    vertices.push_back(v00);
+    vertices.push_back(v01);
+    vertices.push_back(v10);
+    vertices.push_back(v11);
+    triangles.emplace_back(base, base + 3, base + 2);
+    triangles.emplace_back(base, base + 1, base + 3);
+  };
+
+  for (int bx = 0; bx < blocks; bx++) {
+    for (int bz = 0; bz < blocks; bz++) {
+      if (in_hole(bx, bz)) {
+        continue;
+      }
+      float height = lowest(bx, bz);
+      glm::vec2 lo = corner(bx * kBlockQuads, bz * kBlockQuads);
+      glm::vec2 hi = corner((bx + 1) * kBlockQuads, (bz + 1) * kBlockQuads);
+      quad({lo.x, height, lo.y}, {lo.x, height, hi.y}, {hi.x, height, lo.y},
+           {hi.x, height, hi.y});
+      // Walls on the far x and z edges, from the lower of the two blocks
+      if (bx + 1 < blocks && !in_hole(bx + 1, bz)) {
+        float next = lowest(bx + 1, bz);
+        if (next != height) {
+          float low = std::min(height, next), high = std::max(height, next);
+          quad({hi.x, low, lo.y}, {hi.x, low, hi.y}, {hi.x, high, lo.y},
+               {hi.x, high, hi.y});
+        }
+      }
+      if (bz + 1 < blocks && !in_hole(bx, bz + 1)) {
+        float next = lowest(bx, bz + 1);
+        if (next != height) {
+          float low = std::min(height, next), high = std::max(height, next);
+          quad({lo.x, low, hi.y}, {hi.x, low, hi.y}, {lo.x, high, hi.y},
+               {hi.x, high, hi.y});
+        }
+      }
+    }
+  }
+}
+
+OcclusionCuller::OcclusionCuller(JobSystem *jobs)
+    : jobs_(jobs), depth_(size_t(kWidth * kHeight), 0.0f),
+      min_depth_(size_t(kBlocksX * kBlocksY), 0.0f) {}
+
+void OcclusionCuller::setOccluders(const OccluderMesh &occluders) {
+  // As much room as occluders has, so meshes that fill it never allocate
+  occluders_.vertices.reserve(occluders.vertices.capacity());
+  occluders_.triangles.reserve(occluders.triangles.capacity());
+  clip_.reserve(occluders.vertices.capacity());
+  setups_.reserve(occluders.triangles.capacity());
+  occluders_.vertices.assign(occluders.vertices.begin(),
+                             occluders.vertices.end());
+  occluders_.triangles.assign(occluders.triangles.begin(),
+                              occluders.triangles.end());
+}
+
+void OcclusionCuller::render(const glm::mat4 &view_projection) {
+  view_projection_ = view_projection;
+  const auto &vertices = occluders_.vertices;
+  clip_.resize(vertices.size());
+  for (size_t i = 0; i < vertices.size(); i++) {
+    clip_[i] = view_projection * glm::vec4(vertices[i], 1.0f);
+  }
+
+  setups_.clear();
+  for (const auto &triangle : occluders_.triangles) {
+    const glm::vec4 &c0 = clip_[triangle[0]];
+    const glm::vec4 &c1 = clip_[triangle[1]];
+    const glm::vec4 &c2 = clip_[triangle[2]];
+    // Clipping would only add occluders, dropping these is conservative
+    if (c0.w < kMinW || c1.w < kMinW || c2.w < kMinW) {
+      continue;
+    }
+    glm::vec2 p[3] = {toScreen(c0), toScreen(c1), toScreen(c2)};
+    if (!inGuardBand(p[0]) || !inGuardBand(p[1]) || !inGuardBand(p[2])) {
+      continue;
+    }
+    float d[3] = {1.0f / c0.w, 1.0f / c1.w, 1.0f / c2.w};
+    float area =
+        (p[1].x - p[0].x) * (p[2].y - p[0].y) -
+        (p[2].x - p[0].x) * (p[1].y - p[0].y);
+    if (std::abs(area) < 1e-6f) {
+      continue;
+    }
+    // Counter clockwise, so the inside is where every edge function is >= 0
+    if (area < 0.0f) {
+      std::swap(p[1], p[2]);
+      std::swap(d[1], d[2]);
+      area = -area;
+    }
+
+    Setup setup;
+    setup.x0 = std::max(
+        int(std::floor(std::min(std::min(p[0].x, p[1].x), p[2].x))), 0);
+    setup.y0 = std::max(
+        int(std::floor(std::min(std::min(p[0].y, p[1].y), p[2].y))), 0);
+    setup.x1 = std::min(
+        int(std::ceil(std::max(std::max(p[0].x, p[1].x), p[2].x))), kWidth);
+    setup.y1 = std::min(
+        int(std::ceil(std::max(std::max(p[0].y, p[1].y), p[2].y))), kHeight);
+    if (setup.x0 >= setup.x1 || setup.y0 >= setup.y1) {
+      continue;
+    }
+    // Pixels are covered by their center, pixel x, y being the square from
+    // (x, y) to (x + 1, y + 1). Centers on an edge count for both sides, so
+    // a mesh leaves no gaps between its triangles.
+    for (int edge = 0; edge < 3; edge++) {
+      const glm::vec2 &a = p[edge];
+      const glm::vec2 &b = p[(edge + 1) % 3];
+      float edge_a = a.y - b.y;
+      float edge_b = b.x - a.x;
+      setup.edge_a[edge] = edge_a;
+      setup.edge_b[edge] = edge_b;
+      setup.edge_c[edge] =
+          a.x * b.y - a.y * b.x + 0.5f * edge_a + 0.5f * edge_b;
+    }
+    // 1 / w is affine in screen space, taken at the farthest corner of the
+    // pixel
+    setup.depth_a = ((d[1] - d[0]) * (p[2].y - p[0].y) -
+                     (d[2] - d[0]) * (p[1].y - p[0].y)) /
+                    area;
+    setup.depth_b = ((d[2] - d[0]) * (p[1].x - p[0].x) -
+                     (d[1] - d[0]) * (p[2].x - p[0].x)) /
+                    area;
+    setup.depth_c = d[0] - setup.depth_a * p[0].x - setup.depth_b * p[0].y +
+                    std::min(setup.depth_a, 0.0f) +
+                    std::min(setup.depth_b, 0.0f);
+    setups_.push_back(setup);
+  }
+
+  auto rasterize = [this](size_t begin, size_t end) {
+    for (size_t tile = begin; tile < end; tile++) {
+      rasterizeTile(int(tile) % kTilesX, int(tile) / kTilesX);
+    }
+  };
+  size_t tiles = size_t(kTilesX * kTilesY);
+  if (jobs_) {
+    jobs_->parallelFor(tiles, 1, rasterize);
+  } else {
+    rasterize(0, tiles);
+  }
+}
+
+void OcclusionCuller::rasterizeTile(int tile_x, int tile_y) {
+  int tile_x0 = tile_x * kTileWidth, tile_x1 = tile_x0 + kTileWidth;
+  int tile_y0 = tile_y * kTileHeight, tile_y1 = tile_y0 + kTileHeight;
+  for (int y = tile_y0; y < tile_y1; y++) {
+    std::fill_n(depth_.begin() + y * kWidth + tile_x0, kTileWidth, 0.0f);
+  }
+
+  for (const auto &setup : setups_) {
+    int x0 = std::max(setup.x0, tile_x0) & ~3;
+    int x1 = std::min(setup.x1, tile_x1);
+    int y0 = std::max(setup.y0, tile_y0);
+    int y1 = std::min(setup.y1, tile_y1);
+    for (int y = y0; y < y1; y++) {
+      float *row = depth_.data() + y * kWidth;
+      float fy = float(y);
+#if defined(__SSE2__)
+      const __m128 steps = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+      __m128 edge[3], edge_step[3];
+      for (int i = 0; i < 3; i++) {
+        edge[i] = _mm_add_ps(
+            _mm_set1_ps(setup.edge_a[i] * float(x0) + setup.edge_b[i] * fy +
+                        setup.edge_c[i]),
+            _mm_mul_ps(_mm_set1_ps(setup.edge_a[i]), steps));
+        edge_step[i] = _mm_set1_ps(4.0f * setup.edge_a[i]);
+      }
+      __m128 depth = _mm_add_ps(
+          _mm_set1_ps(setup.depth_a * float(x0) + setup.depth_b * fy +
+                      setup.depth_c),
+          _mm_mul_ps(_mm_set1_ps(setup.depth_a), steps));
+      __m128 depth_step = _mm_set1_ps(4.0f * setup.depth_a);
+      const __m128 zero = _mm_setzero_ps();
+      for (int x = x0; x < x1; x += 4) {
+        __m128 inside = _mm_and_ps(_mm_cmpge_ps(edge[0], zero),
+                                   _mm_and_ps(_mm_cmpge_ps(edge[1], zero),
+                                              _mm_cmpge_ps(edge[2], zero)));
+        __m128 old = _mm_loadu_ps(row + x);
+        _mm_storeu_ps(row + x, _mm_max_ps(old, _mm_and_ps(inside, depth)));
+        for (int i = 0; i < 3; i++) {
+          edge[i] = _mm_add_ps(edge[i], edge_step[i]);
+        }
+        depth = _mm_add_ps(depth, depth_step);
+      }
+#else
+      for (int x = x0; x < x1; x++) {
+        float fx = float(x);
+        bool inside = true;
+        for (int i = 0; i < 3; i++) {
+          inside = inside && setup.edge_a[i] * fx + setup.edge_b[i] * fy +
+                                     setup.edge_c[i] >=
+                                 0.0f;
+        }
+        if (inside) {
+          row[x] = std::max(row[x], setup.depth_a * fx + setup.depth_b * fy +
+                                        setup.depth_c);
+        }
+      }
+#endif
+    }
+  }
+
+  // Farthest depth of every block in the tile
+  for (int by = tile_y0 / kBlockSize; by < tile_y1 / kBlockSize; by++) {
+    for (int bx = tile_x0 / kBlockSize; bx < tile_x1 / kBlockSize; bx++) {
+      float farthest = std::numeric_limits<float>::max();
+      for (int y = by * kBlockSize; y < (by + 1) * kBlockSize; y++) {
+        const float *row = depth_.data() + y * kWidth + bx * kBlockSize;
+        farthest = std::min(farthest, *std::min_element(row, row + kBlockSize));
+      }
+      min_depth_[by * kBlocksX + bx] = farthest;
+    }
+  }
+}
+
+bool OcclusionCuller::isOccluded(const glm::vec3 &lo,
+                                 const glm::vec3 &hi) const {
+  glm::vec2 screen_lo{std::numeric_limits<float>::max()};
+  glm::vec2 screen_hi{std::numeric_limits<float>::lowest()};
+  float nearest = 0.0f;
+  for (int corner = 0; corner < 8; corner++) {
+    glm::vec4 clip = view_projection_ * glm::vec4{corner & 1 ? hi.x : lo.x,
+                                                  corner & 2 ? hi.y : lo.y,
+                                                  corner & 4 ? hi.z : lo.z,
+                                                  1.0f};
+    if (clip.w < kMinW) {
+      return false;
+    }
+    glm::vec2 screen = toScreen(clip);
+    screen_lo = glm::min(screen_lo, screen);
+    screen_hi = glm::max(screen_hi, screen);
+    // w is linear over the box, so its nearest point is a corner
+    nearest = std::max(nearest, 1.0f / clip.w);
+  }
+  // One more pixel around it, an occluder edge covering the center of a
+  // pixel can still leave part of it open
+  int x0 = std::max(int(std::floor(screen_lo.x)) - 1, 0);
+  int y0 = std::max(int(std::floor(screen_lo.y)) - 1, 0);
+  int x1 = std::min(int(std::floor(screen_hi.x)) + 1, kWidth - 1);
+  int y1 = std::min(int(std::floor(screen_hi.y)) + 1, kHeight - 1);
+  // Off screen is for frustum culling to decide
+  if (x0 > x1 || y0 > y1) {
+    return false;
+  }
+
+  for (int by = y0 / kBlockSize; by <= y1 / kBlockSize; by++) {
+    for (int bx = x0 / kBlockSize; bx <= x1 / kBlockSize; bx++) {
+      if (min_depth_[by * kBlocksX + bx] > nearest) {
+        continue;
+      }
+      int px0 = std::max(x0, bx * kBlockSize);
+      int px1 = std::min(x1, (bx + 1) * kBlockSize - 1);
+      int py0 = std::max(y0, by * kBlockSize);
+      int py1 = std::min(y1, (by + 1) * kBlockSize - 1);
+      for (int y = py0; y <= py1; y++) {
+        const float *row = depth_.data() + y * kWidth;
+        for (int x = px0; x <= px1; x++) {
+          if (row[x] <= nearest) {
+            return false;
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
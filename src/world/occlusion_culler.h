@@ -0,0 +1,92 @@
+#pragma once
+
+#include "job_system.h"
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <vector>
+
+/*
+ * Triangles an OcclusionCuller rasterizes. The culler trusts them: they must
+ * not be in front of anything that is drawn, while gaps between them only
+ * cost culling.
+ */
+struct OccluderMesh {
+  static constexpr int kBlockQuads = 4; /* grid quads per addTerrain block */
+
+  std::vector<glm::vec3> vertices;
+  std::vector<glm::uvec3> triangles;
+
+  void clear() {
+    vertices.clear();
+    triangles.clear();
+  }
+  /**
+   * Occluders under a square grid of verts x verts terrain vertices at
+   * origin + (i, j) * spacing with heights[i * verts + j]. Every block of
+   * kBlockQuads x kBlockQuads quads becomes a flat quad at its lowest height
+   * with walls down to its lower neighbours, so they stay below any surface
+   * over the grid whose vertices are at least as high. Blocks inside the
+   * quads of hole (x, z, width, depth) are left out.
+   */
+  void addTerrain(const float *heights, int verts, const glm::vec2 &origin,
+                  float spacing, const glm::ivec4 &hole = glm::ivec4{0});
+};
+
+/*
+ * Software occlusion culling. Occluders (see OccluderMesh) are rasterized on
+ * the CPU into a small depth buffer, then the bounding boxes of whatever is
+ * about to be drawn are tested against it. A box is only reported occluded
+ * when every pixel around its screen rectangle is covered by an occluder
+ * nearer than the box, so culling does not remove anything visible, short of
+ * gaps in the occluders narrower than a pixel.
+ *
+ * The buffer holds 1 / w (larger is nearer, 0 is empty) because that is
+ * linear in screen space. It is split into kTileWidth x kTileHeight tiles
+ * that are rasterized as independent jobs, four pixels at a time with SSE
+ * (scalar where it is not available), and a min-depth level over
+ * kBlockSize square blocks lets most tests stop early.
+ *
+ * No GL in here, so it can run and be tested headless. render() and
+ * isOccluded() must not overlap, isOccluded() may run on several threads.
+ */
+class OcclusionCuller {
+public:
+  static constexpr int kWidth = 256;
+  static constexpr int kHeight = 128;
+  static constexpr int kTileWidth = 64;
+  static constexpr int kTileHeight = 32;
+  static constexpr int kBlockSize = 8; /* pixels per min-depth texel */
+
+  // Tiles are rasterized as jobs on jobs when it is set
+  explicit OcclusionCuller(JobSystem *jobs = nullptr);
+
+  // Copies the occluders. Only allocates when occluders has more room than
+  // any earlier mesh, so a mesh that is reserved once and refilled never does.
+  void setOccluders(const OccluderMesh &occluders);
+  // Rasterize the occluders as seen through view_projection
+  void render(const glm::mat4 &view_projection);
+  // True if the box (world space) is certainly hidden by the occluders
+  bool isOccluded(const glm::vec3 &lo, const glm::vec3 &hi) const;
+
+  size_t occluderTriangles() const { return occluders_.triangles.size(); }
+  // 1 / w per pixel, row 0 at the bottom of the screen
+  const float *depth() const { return depth_.data(); }
+
+private:
+  // Edge functions and depth plane of one triangle, in pixels
+  struct Setup {
+    float edge_a[3], edge_b[3], edge_c[3];
+    float depth_a, depth_b, depth_c;
+    int x0, y0, x1, y1; /* pixel bounds, exclusive end */
+  };
+
+  void rasterizeTile(int tile_x, int tile_y);
+
+  JobSystem *jobs_;
+  glm::mat4 view_projection_{1.0f};
+  OccluderMesh occluders_;
+  std::vector<glm::vec4> clip_; /* vertices in clip space */
+  std::vector<Setup> setups_;
+  std::vector<float> depth_;
+  std::vector<float> min_depth_; /* per kBlockSize block */
+};
@@ -0,0 +1,34 @@
+#include "rain.h"
+
+#include "rng.h"
+
+std::vector<glm::vec3> spawnRainDrops(size_t rows, size_t cols,
+                                      uint32_t seed) {
+  auto stream = rng::Stream(seed, rng::kRainStream);
+  auto drops = std::vector<glm::vec3>(rows * cols);
+  size_t index = 0;
+  for (size_t i = 0; i < rows; i++) {
+    for (size_t j = 0; j < cols; j++) {
+      uint64_t bits = stream.bits(i * cols + j);
+      if (bits & 1) {
+        continue;
+      }
+      float height = kResetThreshold + (kResetHeight - kResetThreshold) *
+                                           rng::toUnitFloat(bits);
+      drops[index++] = {float(i) - float(rows) / 2, height,
+                        float(j) - float(cols) / 2};
+    }
+  }
+  drops.resize(index);
+  return drops;
+}
+
+void moveRainDrops(std::vector<glm::vec3> &drops, float time_delta) {
+  for (auto &point : drops) {
+    if (point.y < kResetThreshold) {
+      point.y += kResetHeight - kResetThreshold;
+    } else {
+      point.y -= kRainSpeed * time_delta;
+    }
+  }
+}
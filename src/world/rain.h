@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+const float kRainSpeed = 50.0f;
+const float kResetHeight = 100.0f;
+const float kResetThreshold = 0.0f;
+
+// Drops at about half of the cells of a rows x cols grid, at random heights.
+// Each cell draws from its own counters of the seed's rain stream.
+std::vector<glm::vec3> spawnRainDrops(size_t rows, size_t cols,
+                                      uint32_t seed);
+
+// Let every drop fall for time_delta seconds, wrapping back up to the top
+void moveRainDrops(std::vector<glm::vec3> &drops, float time_delta);
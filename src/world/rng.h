@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Counter-based random numbers (SplitMix64). A value is a pure function of
+ * (seed, stream, counter) rather than the next state of an engine, so any
+ * wave, tile or particle can be generated on its own, in any order or in
+ * parallel, and the same seed always gives bit-identical results on every
+ * platform (unlike std distributions, whose output is implementation
+ * defined).
+ */
+namespace rng {
+
+// Independent streams of one world seed, never reorder these
+enum StreamId : uint32_t { kTerrainStream = 1, kWaveStream, kRainStream };
+
+constexpr uint64_t kGamma = 0x9e3779b97f4a7c15ull;
+
+// SplitMix64 finalizer
+inline uint64_t mix64(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+// Uniform in [0, 1) from the top 24 bits, exact in a float
+inline float toUnitFloat(uint64_t bits) {
+  return float(bits >> 40) * (1.0f / 16777216.0f);
+}
+
+class Stream {
+public:
+  Stream(uint32_t seed, StreamId id)
+      : key_(mix64((uint64_t(seed) << 32) | id)) {}
+
+  uint64_t bits(uint64_t counter) const {
+    return mix64(key_ + (counter + 1) * kGamma);
+  }
+  // Uniform in [lo, hi)
+  float uniform(uint64_t counter, float lo, float hi) const {
+    return lo + (hi - lo) * toUnitFloat(bits(counter));
+  }
+
+private:
+  uint64_t key_;
+};
+
+// 32-bit seed for code that takes its own seed, e.g. the terrain noise
+inline uint32_t streamSeed(uint32_t seed, StreamId id) {
+  return uint32_t(Stream(seed, id).bits(0) >> 32);
+}
+}
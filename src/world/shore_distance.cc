@@ -0,0 +1,154 @@
+#include "shore_distance.h"
+
+#include "frame_arena.h"
+#include "perlin.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+constexpr float ShoreDistance::kWaterLevel;
+constexpr size_t ShoreDistance::kRebuildGrain;
+
+namespace {
+
+const float kInfinity = std::numeric_limits<float>::infinity();
+
+/**
+ * 1D squared distance transform of count values, stride apart, in place:
+ * values[q] becomes the minimum over p of (q - p)^2 + values[p], from the
+ * lower envelope of those parabolas. Infinite values are not sites, a line
+ * without any stays infinite. Scratch holds count values, sites and
+ * count + 1 bounds.
+ */
+void transformLine(float *values, size_t stride, size_t count, float *input,
+                   int *sites, float *bounds) {
+  int top = -1;
+  for (size_t q = 0; q < count; q++) {
+    input[q] = values[q * stride];
+    if (input[q] == kInfinity) {
+      continue;
+    }
+    float fq = input[q] + float(q) * float(q);
+    // Pop the parabolas the new one is lower than from where they start
+    while (top >= 0) {
+      int p = sites[top];
+      float s = (fq - (input[p] + float(p) * float(p))) /
+                (2.0f * (float(q) - float(p)));
+      if (s > bounds[top]) {
+        sites[++top] = int(q);
+        bounds[top] = s;
+        break;
+      }
+      top--;
+    }
+    if (top < 0) {
+      sites[++top] = int(q);
+      bounds[top] = -kInfinity;
+    }
+  }
+  if (top < 0) {
+    return;
+  }
+  bounds[top + 1] = kInfinity;
+  int k = 0;
+  for (size_t q = 0; q < count; q++) {
+    while (bounds[k + 1] < float(q)) {
+      k++;
+    }
+    float d = float(q) - float(sites[k]);
+    values[q * stride] = d * d + input[sites[k]];
+  }
+}
+}
+
+ShoreDistance::ShoreDistance(const Heightfield &field, JobSystem *jobs)
+    : field_(field), jobs_(jobs), rows_(field.rows()), cols_(field.cols()),
+      to_land_((rows_ + 1) * (cols_ + 1)),
+      to_water_((rows_ + 1) * (cols_ + 1)),
+      distance_((rows_ + 1) * (cols_ + 1)) {
+  rebuild();
+}
+
+void ShoreDistance::rebuild() {
+  origin_ = glm::vec2{float(field_.cachedX()) - float(rows_ / 2),
+                      float(field_.cachedZ()) - float(cols_ / 2)} *
+            perlin::kBlockSize;
+  // The column pass needs every row done
+  if (jobs_) {
+    jobs_->parallelFor(rows_ + 1, kRebuildGrain,
+                       [this](size_t begin, size_t end) {
+                         transformRows(begin, end);
+                       });
+    jobs_->parallelFor(cols_ + 1, kRebuildGrain,
+                       [this](size_t begin, size_t end) {
+                         transformColumns(begin, end);
+                       });
+  } else {
+    transformRows(0, rows_ + 1);
+    transformColumns(0, cols_ + 1);
+  }
+}
+
+void ShoreDistance::transformRows(size_t begin, size_t end) {
+  FrameArena::Scope scope;
+  size_t count = cols_ + 1;
+  auto input = ArenaVector<float>(count);
+  auto sites = ArenaVector<int>(count);
+  auto bounds = ArenaVector<float>(count + 1);
+  const auto &heights = field_.heightVec();
+  for (size_t i = begin; i < end; i++) {
+    // Corners of the last row and column are the far corners of the cells
+    // before them
+    size_t cell_i = std::min(i, rows_ - 1);
+    for (size_t j = 0; j < count; j++) {
+      size_t cell_j = std::min(j, cols_ - 1);
+      const glm::vec4 &corners = heights[cell_i * cols_ + cell_j];
+      float height = corners[(i > cell_i ? 1 : 0) + (j > cell_j ? 2 : 0)];
+      bool land = height >= kWaterLevel;
+      to_land_[i * count + j] = land ? 0.0f : kInfinity;
+      to_water_[i * count + j] = land ? kInfinity : 0.0f;
+    }
+    transformLine(&to_land_[i * count], 1, count, input.data(),
+                  sites.data(), bounds.data());
+    transformLine(&to_water_[i * count], 1, count, input.data(),
+                  sites.data(), bounds.data());
+  }
+}
+
+void ShoreDistance::transformColumns(size_t begin, size_t end) {
+  FrameArena::Scope scope;
+  size_t count = rows_ + 1;
+  size_t stride = cols_ + 1;
+  auto input = ArenaVector<float>(count);
+  auto sites = ArenaVector<int>(count);
+  auto bounds = ArenaVector<float>(count + 1);
+  // Beyond any distance in the window, and finite so lookups can blend it
+  float far = float(rows_ + cols_);
+  for (size_t j = begin; j < end; j++) {
+    transformLine(&to_land_[j], stride, count, input.data(), sites.data(),
+                  bounds.data());
+    transformLine(&to_water_[j], stride, count, input.data(), sites.data(),
+                  bounds.data());
+    for (size_t i = 0; i < count; i++) {
+      size_t index = i * stride + j;
+      // One of the two is 0, the corner's own side
+      float cells = to_land_[index] > 0.0f
+                        ? std::sqrt(to_land_[index]) - 0.5f
+                        : 0.5f - std::sqrt(to_water_[index]);
+      distance_[index] = glm::clamp(cells, -far, far) * perlin::kBlockSize;
+    }
+  }
+}
+
+float ShoreDistance::distance(const glm::vec3 &loc) const {
+  float u = glm::clamp((loc.x - origin_.x) / perlin::kBlockSize, 0.0f,
+                       float(rows_));
+  float v = glm::clamp((loc.z - origin_.y) / perlin::kBlockSize, 0.0f,
+                       float(cols_));
+  size_t i = std::min(size_t(u), rows_ - 1);
+  size_t j = std::min(size_t(v), cols_ - 1);
+  float s = u - float(i);
+  float t = v - float(j);
+  return glm::mix(glm::mix(corner(i, j), corner(i, j + 1), t),
+                  glm::mix(corner(i + 1, j), corner(i + 1, j + 1), t), s);
+}
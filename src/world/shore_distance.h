@@ -0,0 +1,55 @@
+#pragma once
+
+#include "heightfield.h"
+#include "job_system.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+/*
+ * Signed distance to the coastline over the terrain window of a Heightfield,
+ * in world units: positive over water, negative on land, where land is
+ * everything at or above kWaterLevel (as in Heightfield::isPositionLegal).
+ * It is stored per cell corner, so a query is a bilinear lookup no matter how
+ * far away the shore is, e.g. for the clearance of a boat.
+ *
+ * A rebuild runs an exact Euclidean distance transform (Felzenszwalb and
+ * Huttenlocher) of the land and of the water corners, one pass over the rows
+ * and one over the columns, each split across threads. A corner's distance is
+ * the distance to the nearest corner on the other side less half a cell, so
+ * the coastline sits halfway between the two and is within half a cell of
+ * where the terrain actually crosses the water level.
+ *
+ * rebuild() after every heightfield rebuild; until then queries see the old
+ * window. Queries are const and can run on any number of threads at once.
+ */
+class ShoreDistance {
+public:
+  static constexpr float kWaterLevel = 0.0f;
+  static constexpr size_t kRebuildGrain = 16; /* rows or columns per job */
+
+  // field must outlive the distances. Rebuilds are split into jobs on jobs
+  // when it is set.
+  explicit ShoreDistance(const Heightfield &field, JobSystem *jobs = nullptr);
+
+  void rebuild();
+  // Distance at the xz position of loc, clamped to the window. The window
+  // is far from any shore when it holds only water (or only land).
+  float distance(const glm::vec3 &loc) const;
+  // Distance at cell corner (i, j) of the window, i <= rows and j <= cols
+  float corner(size_t i, size_t j) const {
+    return distance_[i * (cols_ + 1) + j];
+  }
+
+private:
+  void transformRows(size_t begin, size_t end);
+  void transformColumns(size_t begin, size_t end);
+
+  const Heightfield &field_;
+  JobSystem *jobs_;
+  size_t rows_;
+  size_t cols_;
+  glm::vec2 origin_{0.0f}; /* world xz of corner (0, 0) */
+  std::vector<float> to_land_;  /* squared, in cells */
+  std::vector<float> to_water_; /* squared, in cells */
+  std::vector<float> distance_;
+};
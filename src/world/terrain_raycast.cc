@@ -0,0 +1,276 @@
+#include "terrain_raycast.h"
+
+#include "perlin.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+constexpr int TerrainRaycaster::kTileCells;
+constexpr size_t TerrainRaycaster::kBatchGrain;
+const int TerrainRaycaster::kLevelOffsets[kLevels] = {0,    1024, 1280,
+                                                      1344, 1360, 1364};
+const int TerrainRaycaster::kTileNodes = 1365;
+
+namespace {
+
+// Large rather than infinite, so 0 * inverse stays 0 for axis aligned rays
+float safeInverse(float value) {
+  return std::abs(value) > 1e-12f ? 1.0f / value
+                                  : std::copysign(1e30f, value);
+}
+
+// Narrows [t_enter, t_exit] to where ray is over the xz box [lo, hi]
+bool clipToBox(const TerrainRay &ray, const glm::vec2 &inv_direction,
+               const glm::vec2 &lo, const glm::vec2 &hi, float &t_enter,
+               float &t_exit) {
+  float tx0 = (lo.x - ray.origin.x) * inv_direction.x;
+  float tx1 = (hi.x - ray.origin.x) * inv_direction.x;
+  float tz0 = (lo.y - ray.origin.z) * inv_direction.y;
+  float tz1 = (hi.y - ray.origin.z) * inv_direction.y;
+  t_enter = std::max(t_enter, std::max(std::min(tx0, tx1), std::min(tz0, tz1)));
+  t_exit = std::min(t_exit, std::min(std::max(tx0, tx1), std::max(tz0, tz1)));
+  return t_enter <= t_exit;
+}
+}
+
+bool intersectTerrainCell(const TerrainRay &ray, const glm::vec2 &cell_origin,
+                          float cell_size, const glm::vec4 &heights,
+                          float t_enter, float t_exit, TerrainHit &hit) {
+  // Cell local coordinates along the ray, u = u0 + du * t
+  float u0 = (ray.origin.x - cell_origin.x) / cell_size;
+  float w0 = (ray.origin.z - cell_origin.y) / cell_size;
+  float du = ray.direction.x / cell_size;
+  float dw = ray.direction.z / cell_size;
+  float slack = 1e-5f * (1.0f + std::abs(t_exit));
+
+  // Each triangle as the plane h = base + a * u + b * w, the first one
+  // covers u + w <= 1
+  const float h00 = heights[0], h10 = heights[1], h01 = heights[2],
+              h11 = heights[3];
+  const float base[2] = {h00, h01 + h10 - h11};
+  const float a[2] = {h10 - h00, h11 - h01};
+  const float b[2] = {h01 - h00, h11 - h10};
+  bool found = false;
+  for (int triangle = 0; triangle < 2; triangle++) {
+    // ray height minus surface height is linear in t
+    float f0 = ray.origin.y - base[triangle] - a[triangle] * u0 -
+               b[triangle] * w0;
+    float f1 = ray.direction.y - a[triangle] * du - b[triangle] * dw;
+    if (std::abs(f1) < 1e-12f) {
+      continue;
+    }
+    float t = -f0 / f1;
+    if (t < t_enter - slack || t > t_exit + slack || (found && t >= hit.t)) {
+      continue;
+    }
+    float diagonal = u0 + du * t + w0 + dw * t;
+    if (triangle == 0 ? diagonal > 1.0f + 1e-4f : diagonal < 1.0f - 1e-4f) {
+      continue;
+    }
+    found = true;
+    hit.t = std::max(t, t_enter);
+    hit.normal = glm::normalize(glm::vec3{-a[triangle] / cell_size, 1.0f,
+                                          -b[triangle] / cell_size});
+  }
+  if (found) {
+    hit.hit = true;
+    hit.position = ray.origin + ray.direction * hit.t;
+  }
+  return found;
+}
+
+TerrainRaycaster::TerrainRaycaster(const Heightfield &field, JobSystem *jobs)
+    : field_(field), jobs_(jobs) {
+  rebuild();
+}
+
+void TerrainRaycaster::rebuild() {
+  tiles_x_ = int(field_.rows() + kTileCells - 1) / kTileCells;
+  tiles_z_ = int(field_.cols() + kTileCells - 1) / kTileCells;
+  origin_ = glm::vec2{float(field_.cachedX()) - float(field_.rows() / 2),
+                      float(field_.cachedZ()) - float(field_.cols() / 2)} *
+            perlin::kBlockSize;
+  // Same size every rebuild, so this only allocates the first time
+  nodes_.resize(size_t(tiles_x_ * tiles_z_ * kTileNodes));
+  size_t tiles = size_t(tiles_x_ * tiles_z_);
+  auto build = [this](size_t begin, size_t end) {
+    for (size_t tile = begin; tile < end; tile++) {
+      buildTile(int(tile) / tiles_z_, int(tile) % tiles_z_);
+    }
+  };
+  if (jobs_) {
+    jobs_->parallelFor(tiles, 1, build);
+  } else {
+    build(0, tiles);
+  }
+}
+
+void TerrainRaycaster::buildTile(int tile_x, int tile_z) {
+  int tile = tile_x * tiles_z_ + tile_z;
+  Node *nodes = nodes_.data() + tile * kTileNodes;
+  const auto &heights = field_.heightVec();
+  // Cells past the window stay empty, no ray can cross them
+  for (int x = 0; x < kTileCells; x++) {
+    for (int z = 0; z < kTileCells; z++) {
+      size_t i = size_t(tile_x * kTileCells + x);
+      size_t j = size_t(tile_z * kTileCells + z);
+      Node &cell = nodes[z * kTileCells + x];
+      if (i >= field_.rows() || j >= field_.cols()) {
+        cell = {std::numeric_limits<float>::max(),
+                std::numeric_limits<float>::lowest()};
+        continue;
+      }
+      const glm::vec4 &corners = heights[i * field_.cols() + j];
+      cell = {std::min(std::min(corners[0], corners[1]),
+                       std::min(corners[2], corners[3])),
+              std::max(std::max(corners[0], corners[1]),
+                       std::max(corners[2], corners[3]))};
+    }
+  }
+  for (int level = 1; level < kLevels; level++) {
+    int size = kTileCells >> level;
+    const Node *finer = nodes + kLevelOffsets[level - 1];
+    Node *coarser = nodes + kLevelOffsets[level];
+    for (int z = 0; z < size; z++) {
+      for (int x = 0; x < size; x++) {
+        const Node &n00 = finer[(2 * z) * (2 * size) + 2 * x];
+        const Node &n10 = finer[(2 * z) * (2 * size) + 2 * x + 1];
+        const Node &n01 = finer[(2 * z + 1) * (2 * size) + 2 * x];
+        const Node &n11 = finer[(2 * z + 1) * (2 * size) + 2 * x + 1];
+        coarser[z * size + x] = {
+            std::min(std::min(n00.min, n10.min), std::min(n01.min, n11.min)),
+            std::max(std::max(n00.max, n10.max), std::max(n01.max, n11.max))};
+      }
+    }
+  }
+}
+
+TerrainHit TerrainRaycaster::cast(const TerrainRay &ray) const {
+  TerrainHit hit;
+  glm::vec2 inv_direction = {safeInverse(ray.direction.x),
+                             safeInverse(ray.direction.z)};
+  float t_enter = 0.0f;
+  float t_exit = ray.max_t;
+  float cell = perlin::kBlockSize;
+  glm::vec2 extent =
+      glm::vec2{float(field_.rows()), float(field_.cols())} * cell;
+  if (!clipToBox(ray, inv_direction, origin_, origin_ + extent, t_enter,
+                 t_exit)) {
+    return hit;
+  }
+
+  // Walk the tiles the ray crosses in order (Amanatides and Woo)
+  float tile_size = kTileCells * cell;
+  glm::vec3 entry = ray.origin + ray.direction * t_enter;
+  int tile_x = glm::clamp(int(std::floor((entry.x - origin_.x) / tile_size)),
+                          0, tiles_x_ - 1);
+  int tile_z = glm::clamp(int(std::floor((entry.z - origin_.y) / tile_size)),
+                          0, tiles_z_ - 1);
+  int step_x = ray.direction.x >= 0.0f ? 1 : -1;
+  int step_z = ray.direction.z >= 0.0f ? 1 : -1;
+  float next_x = (origin_.x + (tile_x + (step_x > 0)) * tile_size -
+                  ray.origin.x) *
+                 inv_direction.x;
+  float next_z = (origin_.y + (tile_z + (step_z > 0)) * tile_size -
+                  ray.origin.z) *
+                 inv_direction.y;
+  float delta_x = tile_size * std::abs(inv_direction.x);
+  float delta_z = tile_size * std::abs(inv_direction.y);
+  while (tile_x >= 0 && tile_x < tiles_x_ && tile_z >= 0 &&
+         tile_z < tiles_z_) {
+    float tile_exit = std::min(t_exit, std::min(next_x, next_z));
+    if (castTile(ray, inv_direction, tile_x, tile_z, t_enter, tile_exit,
+                 hit)) {
+      return hit;
+    }
+    if (tile_exit >= t_exit) {
+      break;
+    }
+    if (next_x < next_z) {
+      tile_x += step_x;
+      next_x += delta_x;
+    } else {
+      tile_z += step_z;
+      next_z += delta_z;
+    }
+    t_enter = tile_exit;
+  }
+  return hit;
+}
+
+/**
+ * Depth first over the tile's pyramid, children nearest along the ray first.
+ * A ray crosses at most three of the four children (near, one of the two
+ * sides, far), so the first cell hit is the nearest hit of the tile.
+ */
+bool TerrainRaycaster::castTile(const TerrainRay &ray,
+                                const glm::vec2 &inv_direction, int tile_x,
+                                int tile_z, float t_enter, float t_exit,
+                                TerrainHit &hit) const {
+  struct Entry {
+    int level, x, z;
+  };
+  Entry stack[3 * kLevels + 1];
+  int top = 0;
+  stack[top++] = {kLevels - 1, 0, 0};
+  int tile = tile_x * tiles_z_ + tile_z;
+  float cell = perlin::kBlockSize;
+  glm::vec2 tile_origin =
+      origin_ + glm::vec2{float(tile_x), float(tile_z)} * (kTileCells * cell);
+  int near_x = ray.direction.x >= 0.0f ? 0 : 1;
+  int near_z = ray.direction.z >= 0.0f ? 0 : 1;
+  while (top > 0) {
+    Entry entry = stack[--top];
+    float size = float(1 << entry.level) * cell;
+    glm::vec2 lo = tile_origin + glm::vec2{float(entry.x), float(entry.z)} *
+                                     size;
+    float node_enter = t_enter;
+    float node_exit = t_exit;
+    if (!clipToBox(ray, inv_direction, lo, lo + glm::vec2{size}, node_enter,
+                   node_exit)) {
+      continue;
+    }
+    // Skip nodes the ray passes entirely above or below
+    const Node &bounds = node(tile, entry.level, entry.x, entry.z);
+    float y_enter = ray.origin.y + ray.direction.y * node_enter;
+    float y_exit = ray.origin.y + ray.direction.y * node_exit;
+    float slack = 1e-4f * (1.0f + std::abs(y_enter) + std::abs(y_exit));
+    if (std::min(y_enter, y_exit) > bounds.max + slack ||
+        std::max(y_enter, y_exit) < bounds.min - slack) {
+      continue;
+    }
+    if (entry.level == 0) {
+      size_t i = size_t(tile_x * kTileCells + entry.x);
+      size_t j = size_t(tile_z * kTileCells + entry.z);
+      if (intersectTerrainCell(ray, lo, cell,
+                               field_.heightVec()[i * field_.cols() + j],
+                               node_enter, node_exit, hit)) {
+        return true;
+      }
+      continue;
+    }
+    // Pushed far first, so the near child is popped next
+    int level = entry.level - 1;
+    int x = entry.x * 2;
+    int z = entry.z * 2;
+    stack[top++] = {level, x + 1 - near_x, z + 1 - near_z};
+    stack[top++] = {level, x + near_x, z + 1 - near_z};
+    stack[top++] = {level, x + 1 - near_x, z + near_z};
+    stack[top++] = {level, x + near_x, z + near_z};
+  }
+  return false;
+}
+
+void TerrainRaycaster::castBatch(const TerrainRay *rays, TerrainHit *hits,
+                                 size_t count) const {
+  auto cast_range = [this, rays, hits](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      hits[i] = cast(rays[i]);
+    }
+  };
+  if (jobs_) {
+    jobs_->parallelFor(count, kBatchGrain, cast_range);
+  } else {
+    cast_range(0, count);
+  }
+}
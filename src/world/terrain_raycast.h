@@ -0,0 +1,85 @@
+#pragma once
+
+#include "heightfield.h"
+#include "job_system.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+// A ray, points are origin + t * direction for t in [0, max_t]
+struct TerrainRay {
+  glm::vec3 origin{0.0f};
+  glm::vec3 direction{0.0f, -1.0f, 0.0f};
+  float max_t = 1e30f;
+};
+
+struct TerrainHit {
+  bool hit = false;
+  float t = 0.0f;
+  glm::vec3 position{0.0f};
+  glm::vec3 normal{0.0f, 1.0f, 0.0f};
+};
+
+/**
+ * First crossing, from either side, of ray with the two triangles the
+ * terrain pass draws for one cell: corner heights in Heightfield::heightVec
+ * order, split along the (x + 1, z) to (x, z + 1) diagonal. Only crossings in
+ * [t_enter, t_exit] count, the part of the ray above the cell.
+ */
+bool intersectTerrainCell(const TerrainRay &ray, const glm::vec2 &cell_origin,
+                          float cell_size, const glm::vec4 &heights,
+                          float t_enter, float t_exit, TerrainHit &hit);
+
+/*
+ * Ray queries against the terrain window of a Heightfield (picking, lines of
+ * sight, sun visibility). The window is split into kTileCells square tiles,
+ * each with a min/max height pyramid over its cells. A ray walks the tiles
+ * it crosses in order and descends each pyramid front to back, skipping
+ * every node whose height range the ray passes entirely above or below, so
+ * only the few cells near a crossing are intersected.
+ *
+ * rebuild() after every heightfield rebuild; until then queries see the old
+ * window. Queries are const and can run on any number of threads at once.
+ */
+class TerrainRaycaster {
+public:
+  static constexpr int kTileCells = 32;
+  static constexpr size_t kBatchGrain = 256; /* rays per job */
+
+  // field must outlive the raycaster. Rebuilds and batches are split into
+  // jobs on jobs when it is set.
+  explicit TerrainRaycaster(const Heightfield &field,
+                            JobSystem *jobs = nullptr);
+
+  void rebuild();
+  TerrainHit cast(const TerrainRay &ray) const;
+  // hits[i] = cast(rays[i]), across the job system
+  void castBatch(const TerrainRay *rays, TerrainHit *hits,
+                 size_t count) const;
+
+private:
+  static constexpr int kLevels = 6; /* log2(kTileCells) + 1 */
+
+  struct Node {
+    float min;
+    float max;
+  };
+
+  void buildTile(int tile_x, int tile_z);
+  bool castTile(const TerrainRay &ray, const glm::vec2 &inv_direction,
+                int tile_x, int tile_z, float t_enter, float t_exit,
+                TerrainHit &hit) const;
+  const Node &node(int tile, int level, int x, int z) const {
+    return nodes_[tile * kTileNodes + kLevelOffsets[level] +
+                  z * (kTileCells >> level) + x];
+  }
+
+  static const int kLevelOffsets[kLevels];
+  static const int kTileNodes;
+
+  const Heightfield &field_;
+  JobSystem *jobs_;
+  int tiles_x_ = 0;
+  int tiles_z_ = 0;
+  glm::vec2 origin_{0.0f}; /* world xz of the window's first corner */
+  std::vector<Node> nodes_; /* per tile, level 0 (cells) first */
+};
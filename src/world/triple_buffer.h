@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Lock-free single producer, single consumer handoff of the latest value.
+ *
+ * Three slots rotate between the writer, the reader and the middle. The
+ * writer fills its slot and swaps it into the middle with publish(), the
+ * reader swaps the middle out with acquire() when it holds a value it has
+ * not seen yet. Neither side ever waits for the other or touches the slot
+ * the other one owns, so a value is immutable from the moment it is
+ * published until the reader lets go of it. A value that is published over
+ * before the reader gets to it is dropped, callers that need every value
+ * check hasUnread() before publishing.
+ *
+ * Slots keep their contents across rotations, so containers inside T keep
+ * their capacity and a steady state publish does not allocate.
+ */
+template <typename T> class TripleBuffer {
+public:
+  TripleBuffer() = default;
+  TripleBuffer(const TripleBuffer &) = delete;
+  TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+  // Writer side
+  T &writeBuffer() { return slots_[write_]; }
+  void publish() {
+    uint8_t old = middle_.exchange(uint8_t(write_ | kUnread),
+                                   std::memory_order_acq_rel);
+    write_ = old & kIndexMask;
+  }
+  // True until the reader has acquired the last published value
+  bool hasUnread() const {
+    return middle_.load(std::memory_order_acquire) & kUnread;
+  }
+
+  // Reader side, returns false (and keeps the old value) if nothing new
+  bool acquire() {
+    if (!hasUnread()) {
+      return false;
+    }
+    uint8_t old = middle_.exchange(read_, std::memory_order_acq_rel);
+    read_ = old & kIndexMask;
+    return true;
+  }
+  const T &readBuffer() const { return slots_[read_]; }
+
+private:
+  static constexpr uint8_t kIndexMask = 0x3;
+  static constexpr uint8_t kUnread = 0x4;
+
+  std::array<T, 3> slots_;
+  uint8_t write_ = 0;
+  uint8_t read_ = 1;
+  std::atomic<uint8_t> middle_{2};
+};
@@ -0,0 +1,101 @@
+#include "waves.h"
+
+#include <cmath>
+#include <glm/gtx/rotate_vector.hpp>
+
+bool isSupportedWaveCount(int count) {
+  return count == kLowWaves || count == kNumWaves || count == kHighWaves;
+}
+
+float waveHeight(const WaveConstants &wave, const glm::vec3 &loc) {
+  switch (wave.count) {
+  case kLowWaves:
+    return WaveKernel<kLowWaves>::height(wave, loc);
+  case kHighWaves:
+    return WaveKernel<kHighWaves>::height(wave, loc);
+  default:
+    return WaveKernel<kNumWaves>::height(wave, loc);
+  }
+}
+
+glm::vec3 waveNormal(const WaveConstants &wave, const glm::vec3 &loc) {
+  switch (wave.count) {
+  case kLowWaves:
+    return WaveKernel<kLowWaves>::normal(wave, loc);
+  case kHighWaves:
+    return WaveKernel<kHighWaves>::normal(wave, loc);
+  default:
+    return WaveKernel<kNumWaves>::normal(wave, loc);
+  }
+}
+
+constexpr double kPi = 3.141592653589793;
+constexpr double kG = 9.8000001;
+
+const WaveWeather kCalmWeather = {30.0f, 0.10f, 0.3f, float(kPi / 3),
+                                  glm::vec3{0.5f, 0.1f, 0.5f}};
+const WaveWeather kStormWeather = {150.0f, 0.5f, 0.2f, float(kPi / 2),
+                                   glm::vec3{0.5f, 0.1f, 0.5f}};
+
+WaveModel::WaveModel(uint32_t seed, int count)
+    : stream_(seed, rng::kWaveStream), weather_(kCalmWeather) {
+  constants_.count = isSupportedWaveCount(count) ? count : kNumWaves;
+  resample();
+}
+
+void WaveModel::setWeather(const WaveWeather &weather) {
+  weather_ = weather;
+  resample();
+}
+
+/**
+ * Vary the ocean parameters to achieve a dynamic wave simulation. This also
+ * allows us to achieve "stormy" weather vs. "sunny" weather.
+ */
+void WaveModel::resample() {
+  // Four draws per wave: wavelength, amplitude, direction and phase
+  size_t count = constants_.count;
+  uint64_t base = generation_++ * count * 4;
+  auto sample = [this, base](size_t wave, int draw, float lo, float hi) {
+    return stream_.uniform(base + wave * 4 + draw, lo, hi);
+  };
+  for (size_t i = 0; i < count; i++) {
+    // Resample wavelengths to generate new frequencies
+    float wavelength = sample(i, 0, weather_.median_wave / 2.0f,
+                              weather_.median_wave * 2.0f);
+    freq_[i] = std::sqrt(kG * 2 * kPi / wavelength);
+    // Sample amplitudes around the median
+    amp_[i] = sample(i, 1, weather_.median_amp / 2.0f,
+                     weather_.median_amp * 2.0f);
+    // Resample direction vectors
+    float angle =
+        sample(i, 2, -weather_.angle_range / 2, weather_.angle_range / 2);
+    dir_[i] = glm::rotateY(weather_.median_dir, angle);
+    // Update phase values
+    phi_[i] = sample(i, 3, float(-kPi), float(kPi));
+  }
+
+  // Time-invariant wave constants
+  float steepness = weather_.steepness;
+  for (size_t i = 0; i < count; i++) {
+    float q = steepness / (freq_[i] * amp_[i] * count);
+    glm::vec2 dir_xz = {dir_[i].x, dir_[i].z};
+    constants_.k[i] = freq_[i] * dir_[i];
+    constants_.amp[i] = amp_[i];
+    constants_.qad[i] = q * amp_[i] * dir_xz;
+    constants_.dwa[i] = dir_xz * freq_[i] * amp_[i];
+  }
+  constants_.qwa = steepness / count;
+}
+
+/**
+ * Advance the wave phases to time (in seconds), once per frame. Phases are
+ * wrapped in double precision so long sessions do not lose float precision.
+ */
+void WaveModel::advance(double time) {
+  for (int i = 0; i < constants_.count; i++) {
+    // fmod keeps the sign of phi, negative phases wrap up into [0, 2pi)
+    double phase = std::fmod(phi_[i] * time, 2.0 * kPi);
+    constants_.phase[i] = float(phase < 0.0 ? phase + 2.0 * kPi : phase);
+  }
+}
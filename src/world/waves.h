@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <glm/glm.hpp>
+#include "rng.h"
+#include <cstdint>
+
+// Wave counts with a WaveKernel and an ocean shader variant (WAVE_COUNT)
+constexpr int kLowWaves = 4;
+constexpr int kNumWaves = 10; /* default */
+constexpr int kHighWaves = 32;
+constexpr int kMaxWaves = kHighWaves;
+
+bool isSupportedWaveCount(int count);
+
+/*
+ * Per-frame constants of the Gerstner wave sum, derived from the sampled wave
+ * parameters so neither the shaders nor the CPU-side sampling redo per-wave
+ * work per vertex. The first count entries of the arrays are uploaded as-is
+ * to the wave_* uniforms.
+ */
+struct WaveConstants {
+  int count = kNumWaves; /* waves in use */
+  std::array<glm::vec3, kMaxWaves> k{};   /* freq * dir */
+  std::array<float, kMaxWaves> amp{};     /* amplitude */
+  std::array<glm::vec2, kMaxWaves> qad{}; /* Gerstner q * amp * dir.xz */
+  std::array<glm::vec2, kMaxWaves> dwa{}; /* dir.xz * freq * amp */
+  std::array<float, kMaxWaves> phase{};   /* phi * time, in [0, 2pi) */
+  float qwa = 0.0f; /* q * freq * amp, same for every wave */
+};
+
+/*
+ * The wave sum over exactly N waves. N is a compile time constant so the
+ * loops unroll, like those of the ocean shaders compiled with WAVE_COUNT N.
+ */
+template <int N> struct WaveKernel {
+  static_assert(N > 0 && N <= kMaxWaves, "wave count out of range");
+
+  // Water surface height (sum of sines) at the xz of loc
+  static float height(const WaveConstants &wave, const glm::vec3 &loc) {
+    float height = 0.0f;
+    for (int i = 0; i < N; i++) {
+      height += wave.amp[i] * glm::sin(wave.k[i].x * loc.x +
+                                       wave.k[i].z * loc.z + wave.phase[i]);
+    }
+    return height + 0.1875f;
+  }
+
+  // Gerstner surface normal at the xz of loc
+  static glm::vec3 normal(const WaveConstants &wave, const glm::vec3 &loc) {
+    glm::vec3 pos = {loc.x, height(wave, loc), loc.z};
+    glm::vec3 norm = {0.0f, 1.0f, 0.0f};
+    for (int i = 0; i < N; i++) {
+      float theta = glm::dot(wave.k[i], pos) + wave.phase[i];
+      float S = glm::sin(theta);
+      float C = glm::cos(theta);
+      norm.x -= wave.dwa[i].x * C;
+      norm.z -= wave.dwa[i].y * C;
+      norm.y -= wave.qwa * S;
+    }
+    return glm::normalize(norm);
+  }
+};
+
+// The kernel for wave.count
+float waveHeight(const WaveConstants &wave, const glm::vec3 &loc);
+glm::vec3 waveNormal(const WaveConstants &wave, const glm::vec3 &loc);
+
+// Distributions the individual waves are sampled from
+struct WaveWeather {
+  float median_wave;    /* wavelengths sampled based on this average wave */
+  float median_amp;     /* amplitudes sampled based on this average amp */
+  float steepness;      /* tunable *sharpness* of wave in [0, 1] */
+  float angle_range;    /* sample directions within range */
+  glm::vec3 median_dir; /* sample directions relative to this */
+};
+
+extern const WaveWeather kCalmWeather;
+extern const WaveWeather kStormWeather;
+
+/*
+ * The ocean of one world: count waves sampled from the current weather
+ * with the world's wave stream, and their constants at the last time passed
+ * to advance(). Every resample draws from its own range of counters, so the
+ * waves only depend on the seed and on how often the weather changed.
+ */
+class WaveModel {
+public:
+  // count must be supported, see isSupportedWaveCount()
+  explicit WaveModel(uint32_t seed, int count = kNumWaves);
+
+  void setWeather(const WaveWeather &weather);
+  void advance(double time);
+
+  const WaveConstants &constants() const { return constants_; }
+  float height(const glm::vec3 &loc) const {
+    return waveHeight(constants_, loc);
+  }
+  glm::vec3 normal(const glm::vec3 &loc) const {
+    return waveNormal(constants_, loc);
+  }
+
+private:
+  void resample();
+
+  rng::Stream stream_;
+  uint64_t generation_ = 0; /* resamples so far */
+  WaveWeather weather_;
+  std::array<float, kMaxWaves> amp_{};
+  std::array<float, kMaxWaves> freq_{};
+  std::array<float, kMaxWaves> phi_{};
+  std::array<glm::vec3, kMaxWaves> dir_{};
+  WaveConstants constants_;
+};
@@ -0,0 +1,39 @@
+#include "world.h"
+
+#include "perlin.hpp"
+#include <cmath>
+
+// Rebuild the terrain window every UPDATE_STEP cells of movement
+constexpr int UPDATE_STEP = 5;
+
+World::World(size_t rows, size_t cols, uint32_t seed, JobSystem *jobs,
+             int wave_count)
+    : seed_(seed), heightfield_(rows, cols,
+                                rng::streamSeed(seed, rng::kTerrainStream),
+                                jobs),
+      raycaster_(heightfield_, jobs), shore_(heightfield_, jobs),
+      waves_(seed, wave_count) {}
+
+bool World::isCentered(const glm::vec3 &eye) const {
+  int x_coord = std::floor(eye.x / perlin::kBlockSize);
+  int z_coord = std::floor(eye.z / perlin::kBlockSize);
+  return x_coord / UPDATE_STEP == heightfield_.cachedX() / UPDATE_STEP &&
+         z_coord / UPDATE_STEP == heightfield_.cachedZ() / UPDATE_STEP;
+}
+
+bool World::recenter(const glm::vec3 &eye) {
+  if (isCentered(eye)) {
+    return false;
+  }
+  int x_coord = std::floor(eye.x / perlin::kBlockSize);
+  int z_coord = std::floor(eye.z / perlin::kBlockSize);
+  heightfield_.rebuild(x_coord, z_coord);
+  raycaster_.rebuild();
+  shore_.rebuild();
+  terrain_version_++;
+  return true;
+}
+
+void World::setStormy(bool stormy) {
+  waves_.setWeather(stormy ? kStormWeather : kCalmWeather);
+}
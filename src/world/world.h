@@ -0,0 +1,72 @@
+#pragma once
+
+#include "heightfield.h"
+#include "rng.h"
+#include "shore_distance.h"
+#include "terrain_raycast.h"
+#include "waves.h"
+#include <glm/glm.hpp>
+
+/*
+ * Simulation state of one world: the terrain window around the player, the
+ * waves and the collision, shore distance and ray queries on top of them.
+ * Everything is instance data and nothing here touches GL, so several worlds
+ * can be stepped side by side (one per thread) and the renderers only read
+ * from it.
+ */
+class World {
+public:
+  // seed drives the terrain noise, the wave sampling and the rain, each from
+  // its own rng stream, so equal seeds give bit-identical worlds. Terrain
+  // rebuilds run on jobs when it is set. wave_count picks the WaveKernel.
+  World(size_t rows, size_t cols, uint32_t seed, JobSystem *jobs = nullptr,
+        int wave_count = kNumWaves);
+  // The raycaster and the shore distances point into the heightfield
+  World(const World &) = delete;
+  World &operator=(const World &) = delete;
+
+  // Keep the terrain window around eye, true when it was rebuilt
+  bool recenter(const glm::vec3 &eye);
+  // Whether recenter(eye) would leave the terrain window as it is
+  bool isCentered(const glm::vec3 &eye) const;
+  // Advance the waves to time (seconds since the world started)
+  void advance(double time) { waves_.advance(time); }
+  void setStormy(bool stormy);
+
+  bool isPositionLegal(const glm::vec3 &loc) const {
+    return heightfield_.isPositionLegal(loc);
+  }
+  // Signed distance to the coastline, positive over water
+  float shoreDistance(const glm::vec3 &loc) const {
+    return shore_.distance(loc);
+  }
+  float getWaveHeight(const glm::vec3 &loc) const {
+    return waves_.height(loc);
+  }
+  glm::vec3 getWaveNormal(const glm::vec3 &loc) const {
+    return waves_.normal(loc);
+  }
+  // First terrain crossing of ray within the terrain window
+  TerrainHit raycast(const TerrainRay &ray) const {
+    return raycaster_.cast(ray);
+  }
+  void raycast(const TerrainRay *rays, TerrainHit *hits, size_t count) const {
+    raycaster_.castBatch(rays, hits, count);
+  }
+
+  const Heightfield &heightfield() const { return heightfield_; }
+  const ShoreDistance &shore() const { return shore_; }
+  const WaveModel &waves() const { return waves_; }
+  uint32_t seed() const { return seed_; }
+  uint32_t terrainSeed() const { return heightfield_.seed(); }
+  // Bumped whenever recenter() rebuilds the heightfield
+  uint64_t terrainVersion() const { return terrain_version_; }
+
+private:
+  uint32_t seed_;
+  uint64_t terrain_version_ = 0;
+  Heightfield heightfield_;
+  TerrainRaycaster raycaster_;
+  ShoreDistance shore_;
+  WaveModel waves_;
+};